@@ -517,24 +517,11 @@ Vec3f CoarseInitializer::calcResAndGS(int lvl, Mat88f &H_out, Vec8f &b_out,
     point->isGood_new = true;
     point->energy_new[0] = energy;
 
-    /// because using 128 bits is equivalent to adding 4 number at a times, so i += 4.
+    /// 4 (SSE), 8 (AVX2) or 16 (AVX-512) pattern pixels at a time, the rest one by one.
     // update Hessian matrix.
-    for(int i=0; i+3<patternNum; i+=4)
-      acc9.updateSSE(_mm_load_ps(((float*)(&dp0))+i),
-                     _mm_load_ps(((float*)(&dp1))+i),
-                     _mm_load_ps(((float*)(&dp2))+i),
-                     _mm_load_ps(((float*)(&dp3))+i),
-                     _mm_load_ps(((float*)(&dp4))+i),
-                     _mm_load_ps(((float*)(&dp5))+i),
-                     _mm_load_ps(((float*)(&dp6))+i),
-                     _mm_load_ps(((float*)(&dp7))+i),
-                     _mm_load_ps(((float*)(&r))+i));
-
-    /// add the extra value after 0, 4, 8 because SSE2 is added in 128 units, the extra is added separately.
-    for(int i=((patternNum>>2)<<2); i < patternNum; i++)
-      acc9.updateSingle((float)dp0[i],(float)dp1[i],(float)dp2[i],(float)dp3[i],
-                        (float)dp4[i],(float)dp5[i],(float)dp6[i],(float)dp7[i],
-                        (float)r[i]);
+    const float* J9[9] = {dp0.data(), dp1.data(), dp2.data(), dp3.data(),
+                          dp4.data(), dp5.data(), dp6.data(), dp7.data(), r.data()};
+    acc9.updateBatch(J9, 0, patternNum);
   }
 
   E.finish();
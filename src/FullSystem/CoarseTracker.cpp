@@ -34,6 +34,7 @@
 #include "FullSystem/HessianBlocks.h"
 #include "FullSystem/Residuals.h"
 #include "FullSystem/ImmaturePoint.h"
+#include "FullSystem/dso_g2o_solver.hpp"
 #include "OptimizationBackend/EnergyFunctionalStructs.h"
 #include "IOWrapper/ImageRW.h"
 #include <algorithm>
@@ -78,6 +79,8 @@ CoarseTracker::CoarseTracker(int ww, int hh)
   debugPlot = debugPrint = true;
   w[0]=h[0]=0;
   refFrameID=-1;
+  red=0;
+  lastQuality=TRACKING_FULL;
 }
 
 
@@ -151,123 +154,7 @@ void CoarseTracker::makeCoarseDepthForFirstFrame(FrameHessian* fh) {
 
   }
 
-  for(int lvl=1; lvl<pyrLevelsUsed; lvl++){
-    int lvlm1 = lvl-1;
-    int wl = w[lvl], hl = h[lvl], wlm1 = w[lvlm1];
-
-    float* idepth_l = idepth[lvl];
-    float* weightSums_l = weightSums[lvl];
-
-    float* idepth_lm = idepth[lvlm1];
-    float* weightSums_lm = weightSums[lvlm1];
-
-    for(int y=0;y<hl;y++)
-      for(int x=0;x<wl;x++) {
-        int bidx = 2*x   + 2*y*wlm1;
-        idepth_l[x + y*wl] = idepth_lm[bidx] +
-                             idepth_lm[bidx+1] +
-                             idepth_lm[bidx+wlm1] +
-                             idepth_lm[bidx+wlm1+1];
-
-        weightSums_l[x + y*wl] = weightSums_lm[bidx] +
-                                 weightSums_lm[bidx+1] +
-                                 weightSums_lm[bidx+wlm1] +
-                                 weightSums_lm[bidx+wlm1+1];
-      }
-  }
-
-  // dilate idepth by 1.
-  for(int lvl=0; lvl<2; lvl++) {
-    int numIts = 1;
-
-    for(int it=0;it<numIts;it++) {
-      int wh = w[lvl]*h[lvl]-w[lvl];
-      int wl = w[lvl];
-
-      float* weightSumsl = weightSums[lvl];
-      float* weightSumsl_bak = weightSums_bak[lvl];
-
-      memcpy(weightSumsl_bak, weightSumsl, w[lvl]*h[lvl]*sizeof(float));
-
-      float* idepthl = idepth[lvl];	// dont need to make a temp copy of depth, since I only
-
-      // read values with weightSumsl>0, and write ones with weightSumsl<=0.
-      for(int i=w[lvl];i<wh;i++) {
-        if(weightSumsl_bak[i] <= 0) {
-          float sum=0, num=0, numn=0;
-          if(weightSumsl_bak[i+1+wl] > 0) { sum += idepthl[i+1+wl]; num+=weightSumsl_bak[i+1+wl]; numn++;}
-          if(weightSumsl_bak[i-1-wl] > 0) { sum += idepthl[i-1-wl]; num+=weightSumsl_bak[i-1-wl]; numn++;}
-          if(weightSumsl_bak[i+wl-1] > 0) { sum += idepthl[i+wl-1]; num+=weightSumsl_bak[i+wl-1]; numn++;}
-          if(weightSumsl_bak[i-wl+1] > 0) { sum += idepthl[i-wl+1]; num+=weightSumsl_bak[i-wl+1]; numn++;}
-          if(numn>0) {idepthl[i] = sum/numn; weightSumsl[i] = num/numn;}
-        }
-      }
-    }
-  }
-
-  // dilate idepth by 1 (2 on lower levels).
-  for(int lvl=2; lvl<pyrLevelsUsed; lvl++) {
-    int wh = w[lvl]*h[lvl]-w[lvl];
-    int wl = w[lvl];
-    float* weightSumsl = weightSums[lvl];
-    float* weightSumsl_bak = weightSums_bak[lvl];
-    memcpy(weightSumsl_bak, weightSumsl, w[lvl]*h[lvl]*sizeof(float));
-    float* idepthl = idepth[lvl];	// dotnt need to make a temp copy of depth, since I only
-    // read values with weightSumsl>0, and write ones with weightSumsl<=0.
-    for(int i=w[lvl];i<wh;i++) {
-      if(weightSumsl_bak[i] <= 0) {
-        float sum=0, num=0, numn=0;
-
-        if(weightSumsl_bak[i+1] > 0) { sum += idepthl[i+1]; num+=weightSumsl_bak[i+1]; numn++;}
-        if(weightSumsl_bak[i-1] > 0) { sum += idepthl[i-1]; num+=weightSumsl_bak[i-1]; numn++;}
-        if(weightSumsl_bak[i+wl] > 0) { sum += idepthl[i+wl]; num+=weightSumsl_bak[i+wl]; numn++;}
-        if(weightSumsl_bak[i-wl] > 0) { sum += idepthl[i-wl]; num+=weightSumsl_bak[i-wl]; numn++;}
-        if(numn>0) {idepthl[i] = sum/numn; weightSumsl[i] = num/numn;}
-      }
-    }
-  }
-
-  // normalize idepths and weights.
-  for(int lvl=0; lvl<pyrLevelsUsed; lvl++) {
-    float* weightSumsl = weightSums[lvl];
-    float* idepthl = idepth[lvl];
-    Eigen::Vector3f* dIRefl = lastRef->dIp[lvl];
-
-    int wl = w[lvl], hl = h[lvl];
-
-    int lpc_n=0;
-    float* lpc_u = pc_u[lvl];
-    float* lpc_v = pc_v[lvl];
-    float* lpc_idepth = pc_idepth[lvl];
-    float* lpc_color = pc_color[lvl];
-
-
-    for(int y=2;y<hl-2;y++)
-      for(int x=2;x<wl-2;x++) {
-        int i = x+y*wl;
-
-        if(weightSumsl[i] > 0) {
-          idepthl[i] /= weightSumsl[i];
-          lpc_u[lpc_n] = x;
-          lpc_v[lpc_n] = y;
-          lpc_idepth[lpc_n] = idepthl[i];
-          lpc_color[lpc_n] = dIRefl[i][0];
-
-          if(!std::isfinite(lpc_color[lpc_n]) || !(idepthl[i]>0)) {
-            idepthl[i] = -1;
-            continue;	// just skip if something is wrong.
-          }
-          lpc_n++;
-        }
-        else
-          idepthl[i] = -1;
-
-        weightSumsl[i] = 1;
-      }
-
-    pc_n[lvl] = lpc_n;
-    //printf("pc_n[lvl] is %d \n", lpc_n);
-  }
+  makeCoarseDepthPyramid();
 }
 
 /// use the inverse depth of the point projected on the current frame to genrate the inverse depth value of the point on each pyramid level.
@@ -287,210 +174,134 @@ void CoarseTracker::makeCoarseDepthL0(std::vector<FrameHessian*> frameHessians,
   K1(1, 2) = Hcalib.cyl();
 
   /// STEP1: calculate the idepth weights and weighted idepths of other pixels on the 0 level of the latest frame projections.
-  for(FrameHessian* fh : frameHessians) {
-    for(PointHessian* ph : fh->pointHessians) {
+  /// the stereo check of every point is independent, so it is done in parallel; the splatting stays in order.
+  refPoints.clear();
+  for(FrameHessian* fh : frameHessians)
+    for(PointHessian* ph : fh->pointHessians)
       /// the last residul of the point is normal.
       /// the last time after optimization was set to 0 to indicate that the points were not deleted and the residuals were deleted.
       //contains information about residuals to the last two (!) frames. ([0] = latest, [1] = the one before).
-      if(ph->lastResiduals[0].first != 0 && ph->lastResiduals[0].second == ResState::IN) {
-        PointFrameResidual* r = ph->lastResiduals[0].first;
+      if(ph->lastResiduals[0].first != 0 && ph->lastResiduals[0].second == ResState::IN)
+        refPoints.push_back(ph);
 
-        /// the residula of the point is good, the target of the last optimization is the ref.
-        assert(r->efResidual->isActive() && r->target == lastRef);
+  refPointIdepth.resize(refPoints.size());
 
-        /// rounded.
-        int u = r->centerProjectedTo[0] + 0.5f;
-        int v = r->centerProjectedTo[1] + 0.5f;
+  if(red != 0 && multiThreading)
+    red->reduce(boost::bind(&CoarseTracker::makeCoarseDepthL0_Reductor, this, fh_target, fh_right, K1, &Hcalib, _1, _2, _3, _4), 0, refPoints.size(), 50);
+  else
+    makeCoarseDepthL0_Reductor(fh_target, fh_right, K1, &Hcalib, 0, refPoints.size(), 0, 0);
 
-        ImmaturePoint* pt_track = new ImmaturePoint((float)u, (float)v, fh_target, &Hcalib);
+  for(unsigned int k=0; k<refPoints.size(); k++) {
+    PointHessian* ph = refPoints[k];
+    PointFrameResidual* r = ph->lastResiduals[0].first;
 
-        pt_track->u_stereo = pt_track->u;
-        pt_track->v_stereo = pt_track->v;
+    /// rounded.
+    int u = r->centerProjectedTo[0] + 0.5f;
+    int v = r->centerProjectedTo[1] + 0.5f;
 
-        // free to debug
-        pt_track->idepth_min_stereo = r->centerProjectedTo[2] * 0.1f;
-        pt_track->idepth_max_stereo = r->centerProjectedTo[2] * 1.9f;
+    /// inverse covariance weight.
+    float weight = sqrtf(1e-3 / (ph->efPoint->HdiF+1e-12));
 
-        ImmaturePointStatus pt_track_right = pt_track->traceStereo(fh_right, K1, 1);
+    /// weighted.
+    idepth[0][u+w[0]*v] += refPointIdepth[k] * weight;
+    weightSums[0][u+w[0]*v] += weight;
+  }
 
-        float new_idepth = 0;
+  makeCoarseDepthPyramid();
+}
 
-        if (pt_track_right == ImmaturePointStatus::IPS_GOOD) {
-          ImmaturePoint* pt_track_back = new ImmaturePoint(pt_track->lastTraceUV(0), pt_track->lastTraceUV(1), fh_right, &Hcalib);
-          pt_track_back->u_stereo = pt_track_back->u;
-          pt_track_back->v_stereo = pt_track_back->v;
+/// idepth of refPoints [min,max): left-right checked static stereo, or the projected idepth if that fails.
+void CoarseTracker::makeCoarseDepthL0_Reductor(FrameHessian* fh_target, FrameHessian* fh_right, Mat33f K1, CalibHessian* Hcalib,
+                                               int min, int max, Vec10* stats, int tid) {
+  for(int k=min; k<max; k++) {
+    PointFrameResidual* r = refPoints[k]->lastResiduals[0].first;
 
+    /// the residula of the point is good, the target of the last optimization is the ref.
+    assert(r->efResidual->isActive() && r->target == lastRef);
 
-          pt_track_back->idepth_min_stereo = r->centerProjectedTo[2] * 0.1f;
-          pt_track_back->idepth_max_stereo = r->centerProjectedTo[2] * 1.9f;
+    /// rounded.
+    int u = r->centerProjectedTo[0] + 0.5f;
+    int v = r->centerProjectedTo[1] + 0.5f;
 
-          ImmaturePointStatus pt_track_left = pt_track_back->traceStereo(fh_target, K1, 0);
+    ImmaturePoint* pt_track = new ImmaturePoint((float)u, (float)v, fh_target, Hcalib);
 
-          float depth = 1.0f/pt_track->idepth_stereo;
-          float u_delta = abs(pt_track->u - pt_track_back->lastTraceUV(0));
+    pt_track->u_stereo = pt_track->u;
+    pt_track->v_stereo = pt_track->v;
 
-          if(u_delta<1 && depth > 0 && depth < 50) {
-            new_idepth = pt_track->idepth_stereo;
-            delete pt_track;
-            delete pt_track_back;
-          }
-          else {
+    // free to debug
+    pt_track->idepth_min_stereo = r->centerProjectedTo[2] * 0.1f;
+    pt_track->idepth_max_stereo = r->centerProjectedTo[2] * 1.9f;
 
-            new_idepth = r->centerProjectedTo[2];
-            delete pt_track;
-            delete pt_track_back;
-          }
-        }
-        else {
-          new_idepth = r->centerProjectedTo[2];
-          delete pt_track;
-        }
+    ImmaturePointStatus pt_track_right = pt_track->traceStereo(fh_right, K1, 1);
 
-        /// inverse covariance weight.
-        float weight = sqrtf(1e-3 / (ph->efPoint->HdiF+1e-12));
+    float new_idepth = 0;
 
-        /// weighted.
-        idepth[0][u+w[0]*v] += new_idepth * weight;
-        weightSums[0][u+w[0]*v] += weight;
-      }
-    }
-  }
+    if (pt_track_right == ImmaturePointStatus::IPS_GOOD) {
+      ImmaturePoint* pt_track_back = new ImmaturePoint(pt_track->lastTraceUV(0), pt_track->lastTraceUV(1), fh_right, Hcalib);
+      pt_track_back->u_stereo = pt_track_back->u;
+      pt_track_back->v_stereo = pt_track_back->v;
 
-  /// STEP2: generate idepth and weight from the lower level to the upper level.
-  for(int lvl=1; lvl<pyrLevelsUsed; lvl++) {
-    int lvlm1 = lvl-1;
-    int wl = w[lvl], hl = h[lvl], wlm1 = w[lvlm1];
-
-    float* idepth_l = idepth[lvl];
-    float* weightSums_l = weightSums[lvl];
-
-    float* idepth_lm = idepth[lvlm1];
-    float* weightSums_lm = weightSums[lvlm1];
-
-    for(int y=0;y<hl;y++) {
-      for(int x=0;x<wl;x++) {
-        int bidx = 2*x + 2*y*wlm1;
-        /// ? why don;t you divide by 4?
-        /// ! divide the weight by the sum of nice!
-        idepth_l[x + y*wl] = idepth_lm[bidx] +
-                             idepth_lm[bidx+1] +
-                             idepth_lm[bidx+wlm1] +
-                             idepth_lm[bidx+wlm1+1];
-
-        weightSums_l[x + y*wl] = weightSums_lm[bidx] +
-                                 weightSums_lm[bidx+1] +
-                                 weightSums_lm[bidx+wlm1] +
-                                 weightSums_lm[bidx+wlm1+1];
+
+      pt_track_back->idepth_min_stereo = r->centerProjectedTo[2] * 0.1f;
+      pt_track_back->idepth_max_stereo = r->centerProjectedTo[2] * 1.9f;
+
+      ImmaturePointStatus pt_track_left = pt_track_back->traceStereo(fh_target, K1, 0);
+
+      float depth = 1.0f/pt_track->idepth_stereo;
+      float u_delta = abs(pt_track->u - pt_track_back->lastTraceUV(0));
+
+      if(u_delta<1 && depth > 0 && depth < 50) {
+        new_idepth = pt_track->idepth_stereo;
+        delete pt_track;
+        delete pt_track_back;
       }
-    }
-  }
+      else {
 
-  /// STEP3: 0 and 1 levels for pixels without depth, fill them with four points inclined at 45 degrees around.
-  // dilate idepth by 1.
-  for(int lvl=0; lvl<2; lvl++) {
-    int numIts = 1;
-
-    for(int it=0; it<numIts; it++) {
-      /// a blank line.
-      int wh = w[lvl]*h[lvl]-w[lvl];
-      int wl = w[lvl];
-
-      float* weightSumsl = weightSums[lvl];
-      float* weightSumsl_bak = weightSums_bak[lvl];
-
-      /// backup.
-      memcpy(weightSumsl_bak, weightSumsl, w[lvl]*h[lvl]*sizeof(float));
-
-      float* idepthl = idepth[lvl];	// dont need to make a temp copy of depth, since I only
-
-      // read values with weightSumsl>0, and write ones with weightSumsl<=0.
-      /// a blank line above and below.
-      for(int i=w[lvl]; i<wh; i++) {
-        if(weightSumsl_bak[i] <= 0) {
-          /// use the points on four cornders to fill the ones without depth.
-          /// bug: not very good for the points on the vertical edge, use the previous two lines to calculate.
-          float sum=0, num=0, numn=0;
-
-          if(weightSumsl_bak[i+1+wl] > 0) {
-            sum += idepthl[i+1+wl];
-            num+=weightSumsl_bak[i+1+wl];
-            numn++;
-          }
-          if(weightSumsl_bak[i-1-wl] > 0) {
-            sum += idepthl[i-1-wl];
-            num+=weightSumsl_bak[i-1-wl];
-            numn++;
-          }
-          if(weightSumsl_bak[i+wl-1] > 0) {
-            sum += idepthl[i+wl-1];
-            num+=weightSumsl_bak[i+wl-1];
-            numn++;
-          }
-          if(weightSumsl_bak[i-wl+1] > 0) {
-            sum += idepthl[i-wl+1];
-            num+=weightSumsl_bak[i-wl+1];
-            numn++;
-          }
-
-          if(numn>0) {
-            idepthl[i] = sum/numn;
-            weightSumsl[i] = num/numn;
-          }
-        }
+        new_idepth = r->centerProjectedTo[2];
+        delete pt_track;
+        delete pt_track_back;
       }
     }
-  }
-
-  /// STEP4: 2 levels up, for pixels with no depth, fill with four points up, down, left and right.
-  // dilate idepth by 1 (2 on lower levels).
-  for(int lvl=2; lvl<pyrLevelsUsed; lvl++) {
-    int wh = w[lvl]*h[lvl]-w[lvl];
-    int wl = w[lvl];
-
-    float* weightSumsl = weightSums[lvl];
-    float* weightSumsl_bak = weightSums_bak[lvl];
+    else {
+      new_idepth = r->centerProjectedTo[2];
+      delete pt_track;
+    }
 
-    memcpy(weightSumsl_bak, weightSumsl, w[lvl]*h[lvl]*sizeof(float));
+    refPointIdepth[k] = new_idepth;
+  }
+}
 
-    float* idepthl = idepth[lvl];	// dotnt need to make a temp copy of depth, since I only
+void CoarseTracker::makeCoarseDepthPyramid() {
+  bool useThreads = red != 0 && multiThreading;
 
-    // read values with weightSumsl>0, and write ones with weightSumsl<=0.
-    for(int i=w[lvl];i<wh;i++) {
-      if(weightSumsl_bak[i] <= 0) {
-        float sum=0, num=0, numn=0;
-        if(weightSumsl_bak[i+1] > 0) {
-          sum += idepthl[i+1];
-          num+=weightSumsl_bak[i+1];
-          numn++;
-        }
-        if(weightSumsl_bak[i-1] > 0) {
-          sum += idepthl[i-1];
-          num+=weightSumsl_bak[i-1];
-          numn++;
-        }
-        if(weightSumsl_bak[i+wl] > 0) {
-          sum += idepthl[i+wl];
-          num+=weightSumsl_bak[i+wl];
-          numn++;
-        }
-        if(weightSumsl_bak[i-wl] > 0) {
-          sum += idepthl[i-wl];
-          num+=weightSumsl_bak[i-wl];
-          numn++;
-        }
+  /// STEP2: generate idepth and weight from the lower level to the upper level.
+  for(int lvl=1; lvl<pyrLevelsUsed; lvl++) {
+    if(useThreads)
+      red->reduce(boost::bind(&CoarseTracker::downsampleDepthReductor, this, lvl, _1, _2, _3, _4), 0, h[lvl]);
+    else
+      downsampleDepthReductor(lvl, 0, h[lvl], 0, 0);
+  }
 
-        if(numn>0) {
-          idepthl[i] = sum/numn;
-          weightSumsl[i] = num/numn;
-        }
-      }
-    }
+  /// STEP3/4: fill pixels without depth from their neighbours, once per level.
+  for(int lvl=0; lvl<pyrLevelsUsed; lvl++) {
+    /// backup.
+    memcpy(weightSums_bak[lvl], weightSums[lvl], w[lvl]*h[lvl]*sizeof(float));
+
+    /// a blank line above and below.
+    if(useThreads)
+      red->reduce(boost::bind(&CoarseTracker::dilateDepthReductor, this, lvl, _1, _2, _3, _4), 1, h[lvl]-1);
+    else
+      dilateDepthReductor(lvl, 1, h[lvl]-1, 0, 0);
   }
 
   /// STEP5: normalize the idepth of the point and assign it to the member variable pc_n
   // normalize idepths and weights.
   for(int lvl=0; lvl<pyrLevelsUsed; lvl++) {
-    float* weightSumsl = weightSums[lvl];
+    if(useThreads)
+      red->reduce(boost::bind(&CoarseTracker::normalizeDepthReductor, this, lvl, _1, _2, _3, _4), 2, h[lvl]-2);
+    else
+      normalizeDepthReductor(lvl, 2, h[lvl]-2, 0, 0);
+
     float* idepthl = idepth[lvl];
     Eigen::Vector3f* dIRefl = lastRef->dIp[lvl];
 
@@ -504,35 +315,134 @@ void CoarseTracker::makeCoarseDepthL0(std::vector<FrameHessian*> frameHessians,
     float* lpc_idepth = pc_idepth[lvl];
     float* lpc_color = pc_color[lvl];
 
+    /// normalizeDepthReductor marked everything invalid with -1.
     for(int y=2;y<hl-2;y++)
       for(int x=2;x<wl-2;x++) {
         int i = x+y*wl;
+        if(!(idepthl[i] > 0)) continue;
 
-        /// valued.
-        if(weightSumsl[i] > 0) {
-          idepthl[i] /= weightSumsl[i];
-          lpc_u[lpc_n] = x;
-          lpc_v[lpc_n] = y;
-          lpc_idepth[lpc_n] = idepthl[i];
-          lpc_color[lpc_n] = dIRefl[i][0];
-
-          if(!std::isfinite(lpc_color[lpc_n]) || !(idepthl[i]>0)) {
-            idepthl[i] = -1;
-            // just skip if something is wrong.
-            continue;
-          }
-          lpc_n++;
-        }
-        else
-          idepthl[i] = -1;
-
-        /// after the evaluation, it becomes 1.
-        weightSumsl[i] = 1;
+        lpc_u[lpc_n] = x;
+        lpc_v[lpc_n] = y;
+        lpc_idepth[lpc_n] = idepthl[i];
+        lpc_color[lpc_n] = dIRefl[i][0];
+        lpc_n++;
       }
+
     pc_n[lvl] = lpc_n;
   }
 }
 
+/// rows [min,max) of level lvl: sum of the 2x2 idepths and weights of level lvl-1.
+void CoarseTracker::downsampleDepthReductor(int lvl, int min, int max, Vec10* stats, int tid) {
+  int lvlm1 = lvl-1;
+  int wl = w[lvl], wlm1 = w[lvlm1];
+
+  float* idepth_l = idepth[lvl];
+  float* weightSums_l = weightSums[lvl];
+
+  float* idepth_lm = idepth[lvlm1];
+  float* weightSums_lm = weightSums[lvlm1];
+
+  for(int y=min;y<max;y++) {
+    int x=0;
+#ifdef __SSE2__
+    /// 4 output pixels from 2 rows of 8 input pixels.
+    for(; x+3<wl; x+=4) {
+      int bidx = 2*x + 2*y*wlm1;
+
+      __m128 a0 = _mm_loadu_ps(idepth_lm+bidx), a1 = _mm_loadu_ps(idepth_lm+bidx+4);
+      __m128 b0 = _mm_loadu_ps(idepth_lm+bidx+wlm1), b1 = _mm_loadu_ps(idepth_lm+bidx+wlm1+4);
+      __m128 sa = _mm_add_ps(a0,b0), sb = _mm_add_ps(a1,b1);
+      _mm_storeu_ps(idepth_l + x + y*wl, _mm_add_ps(_mm_shuffle_ps(sa, sb, _MM_SHUFFLE(2,0,2,0)),
+                                                    _mm_shuffle_ps(sa, sb, _MM_SHUFFLE(3,1,3,1))));
+
+      a0 = _mm_loadu_ps(weightSums_lm+bidx); a1 = _mm_loadu_ps(weightSums_lm+bidx+4);
+      b0 = _mm_loadu_ps(weightSums_lm+bidx+wlm1); b1 = _mm_loadu_ps(weightSums_lm+bidx+wlm1+4);
+      sa = _mm_add_ps(a0,b0); sb = _mm_add_ps(a1,b1);
+      _mm_storeu_ps(weightSums_l + x + y*wl, _mm_add_ps(_mm_shuffle_ps(sa, sb, _MM_SHUFFLE(2,0,2,0)),
+                                                        _mm_shuffle_ps(sa, sb, _MM_SHUFFLE(3,1,3,1))));
+    }
+#endif
+    for(; x<wl; x++) {
+      int bidx = 2*x + 2*y*wlm1;
+      /// ? why don;t you divide by 4?
+      /// ! divide the weight by the sum of nice!
+      idepth_l[x + y*wl] = idepth_lm[bidx] +
+                           idepth_lm[bidx+1] +
+                           idepth_lm[bidx+wlm1] +
+                           idepth_lm[bidx+wlm1+1];
+
+      weightSums_l[x + y*wl] = weightSums_lm[bidx] +
+                               weightSums_lm[bidx+1] +
+                               weightSums_lm[bidx+wlm1] +
+                               weightSums_lm[bidx+wlm1+1];
+    }
+  }
+}
+
+/// rows [min,max) of level lvl: pixels without depth take the mean of their valid neighbours in weightSums_bak.
+/// levels 0 and 1 use the four diagonal neighbours, higher levels the four direct ones.
+void CoarseTracker::dilateDepthReductor(int lvl, int min, int max, Vec10* stats, int tid) {
+  int wl = w[lvl];
+
+  float* weightSumsl = weightSums[lvl];
+  float* weightSumsl_bak = weightSums_bak[lvl];
+
+  // dont need to make a temp copy of depth, since I only
+  // read values with weightSumsl>0, and write ones with weightSumsl<=0.
+  float* idepthl = idepth[lvl];
+
+  int o1, o2, o3, o4;
+  if(lvl<2) { o1 = 1+wl; o2 = -1-wl; o3 = wl-1; o4 = -wl+1; }
+  else { o1 = 1; o2 = -1; o3 = wl; o4 = -wl; }
+
+  for(int i=min*wl; i<max*wl; i++) {
+    if(weightSumsl_bak[i] <= 0) {
+      float sum=0, num=0, numn=0;
+
+      if(weightSumsl_bak[i+o1] > 0) { sum += idepthl[i+o1]; num+=weightSumsl_bak[i+o1]; numn++; }
+      if(weightSumsl_bak[i+o2] > 0) { sum += idepthl[i+o2]; num+=weightSumsl_bak[i+o2]; numn++; }
+      if(weightSumsl_bak[i+o3] > 0) { sum += idepthl[i+o3]; num+=weightSumsl_bak[i+o3]; numn++; }
+      if(weightSumsl_bak[i+o4] > 0) { sum += idepthl[i+o4]; num+=weightSumsl_bak[i+o4]; numn++; }
+
+      if(numn>0) {
+        idepthl[i] = sum/numn;
+        weightSumsl[i] = num/numn;
+      }
+    }
+  }
+}
+
+/// rows [min,max) of level lvl: divide by the weight sum, invalid pixels get idepth -1.
+void CoarseTracker::normalizeDepthReductor(int lvl, int min, int max, Vec10* stats, int tid) {
+  float* weightSumsl = weightSums[lvl];
+  float* idepthl = idepth[lvl];
+  Eigen::Vector3f* dIRefl = lastRef->dIp[lvl];
+
+  int wl = w[lvl];
+
+  for(int y=min;y<max;y++)
+    for(int x=2;x<wl-2;x++) {
+      int i = x+y*wl;
+
+      /// valued.
+      if(weightSumsl[i] > 0) {
+        idepthl[i] /= weightSumsl[i];
+
+        if(!std::isfinite(dIRefl[i][0]) || !(idepthl[i]>0)) {
+          idepthl[i] = -1;
+          // just skip if something is wrong.
+          continue;
+        }
+      }
+      else
+        idepthl[i] = -1;
+
+      /// after the evaluation, it becomes 1.
+      weightSumsl[i] = 1;
+    }
+}
+
 /// for the residual b/w the  latest frame and the reference frame being tracked, find H and b.
 void CoarseTracker::calcGSSSE(int lvl, Mat88 &H_out, Vec8 &b_out, SE3 refToNew, AffLight aff_g2l) {
   acc.initialize();
@@ -823,16 +733,56 @@ void CoarseTracker::setCoarseTrackingRef(std::vector<FrameHessian*> frameHessian
   firstCoarseRMSE=-1;
 }
 
+/// Post-iteration action of the tracking optimizer: ends the current pyramid level (force stop flag)
+/// once the pose update of an iteration is below setting_trackingMinUpdate, or the frame deadline has passed.
+class CoarseTrackingStopAction : public g2o::HyperGraphAction {
+ public:
+  CoarseTrackingStopAction(VertexSE3PoseDSO* vtx_pose, bool* stop,
+                           const std::chrono::steady_clock::time_point* deadline)
+      : hitDeadline(false), vtx_pose_(vtx_pose), stop_(stop), deadline_(deadline)
+  {}
+
+  /// called before optimizing a level.
+  void startLevel() {
+    lastPose_ = vtx_pose_->estimate();
+    *stop_ = false;
+  }
+
+  virtual g2o::HyperGraphAction* operator()(const g2o::HyperGraph* graph,
+                                            g2o::HyperGraphAction::Parameters* parameters = 0) {
+    SE3 pose = vtx_pose_->estimate();
+    double update = (pose * lastPose_.inverse()).log().norm();
+    lastPose_ = pose;
+
+    if(setting_trackingMinUpdate > 0 && update < setting_trackingMinUpdate)
+      *stop_ = true;
+
+    if(deadline_ != 0 && std::chrono::steady_clock::now() > *deadline_) {
+      *stop_ = true;
+      hitDeadline = true;
+    }
+    return this;
+  }
+
+  bool hitDeadline;
+
+ private:
+  VertexSE3PoseDSO* vtx_pose_;
+  bool* stop_;
+  const std::chrono::steady_clock::time_point* deadline_;
+  SE3 lastPose_;
+};
+
 /// track new frames, optimize poses and photometric parameters.
 bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
                                       SE3 &lastToNew_out,
                                       AffLight &aff_g2l_out,
                                       int coarsestLvl,
                                       Vec5 minResForAbort,
+                                      const std::chrono::steady_clock::time_point* deadline,
                                       IOWrap::Output3DWrapper* wrap)
 {
-  auto linear_solver = g2o::make_unique<g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>>();
-  auto block_solver = g2o::make_unique<g2o::BlockSolverX>(std::move(linear_solver));
+  auto block_solver = util::MakeBlockSolverX(8);
   block_solver->setSchur(true);
 
   // auto algorithm = new g2o::OptimizationAlgorithmGaussNewton(std::move(block_solver));
@@ -854,6 +804,7 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
 
   lastResiduals.setConstant(NAN);
   lastFlowIndicators.setConstant(1000);
+  lastQuality = TRACKING_FULL;
 
   newFrame = newFrameHessian;
 
@@ -883,11 +834,34 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
   /// whether repeated calculation.
   bool haveRepeated = false;
 
+  /// adaptive schedule: a level ends early on a small pose update or on the deadline.
+  /// Shares the force stop flag with the terminate action, it is reset for every level.
+  bool stopLevel = false;
+  CoarseTrackingStopAction stopAction(vtx_pose, &stopLevel, deadline);
+  if(setting_trackingMinUpdate > 0 || deadline != 0) {
+    optimizer->setForceStopFlag(&stopLevel);
+    optimizer->addPostIterationAction(&stopAction);
+  }
+
+  /// time spent on level 1, to predict level 0 (more pixels by w[0]*h[0] / (w[1]*h[1])).
+  float level1Ms = -1;
+  bool skippedLevel0 = false;
+
   /// use the pyramid for tracking, starting from the top down.
   for(int lvl=coarsestLvl; lvl>=0; lvl--) {
     // Mat88 H;
     // Vec8 b;
 
+    /// STEP0: level 0 would miss the deadline, keep the pose of level 1.
+    if(lvl == 0 && deadline != 0 && level1Ms >= 0) {
+      float remainingMs = std::chrono::duration<float, std::milli>(*deadline - std::chrono::steady_clock::now()).count();
+      if(level1Ms * (w[0]*h[0]) / (float)(w[1]*h[1]) > remainingMs) {
+        skippedLevel0 = true;
+        break;
+      }
+    }
+    std::chrono::steady_clock::time_point tLevel = std::chrono::steady_clock::now();
+
     float levelCutoffRepeat=1;
 
     /// STEP1: calculate the residual error, gurantee that at most 60% of the residual error is greater than the threshold, calculate the normal equation.
@@ -923,6 +897,7 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
     optimizer->initializeOptimization(lvl);
     optimizer->setVerbose(false);
     std::cout << "[*] LV " << lvl << ", optimizing... " << std::endl;
+    stopAction.startLevel();
     optimizer->optimize(maxIterations[lvl]);
     for(int iteration=0; iteration < maxIterations[lvl]; iteration++) {
       /// STEP2.1: calculate the increment.
@@ -1032,6 +1007,9 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
     if(lastResiduals[lvl] > 1.5*minResForAbort[lvl])
       return false;
 
+    if(lvl == 1)
+      level1Ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tLevel).count();
+
 
     if(levelCutoffRepeat > 1 && !haveRepeated) {
       lvl++; /// re-calculate this level.
@@ -1040,6 +1018,15 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
     }
   }
 
+  /// level 1 stands in for level 0: its RMSE is in the same intensity units, the squared pixel shifts are scaled to level 0.
+  if(skippedLevel0) {
+    lastResiduals[0] = lastResiduals[1];
+    lastFlowIndicators *= (w[0]*h[0]) / (float)(w[1]*h[1]);
+    lastQuality = TRACKING_LEVEL1;
+  }
+  else if(stopAction.hitDeadline)
+    lastQuality = TRACKING_TRUNCATED;
+
   // set!
   lastToNew_out = vtx_pose->estimate();
   aff_g2l_out = vtx_photo->estimate();
@@ -1192,8 +1179,11 @@ CoarseDistanceMap::CoarseDistanceMap(int ww, int hh) {
   /// calculated on the 0 level, so divide by 4.
   fwdWarpedIDDistFinal = new float[ww*hh/4];
 
-  bfsList1 = new Eigen::Vector2i[ww*hh/4];
-  bfsList2 = new Eigen::Vector2i[ww*hh/4];
+  colDist = new float[ww*hh/4];
+
+  /// one lower envelope per thread, for one row of level 1.
+  envelopeIdx = new int[NUM_THREADS*(ww/2+1)];
+  envelopeZ = new float[NUM_THREADS*(ww/2+2)];
 
   int fac = 1 << (pyrLevelsUsed-1);
 
@@ -1202,12 +1192,14 @@ CoarseDistanceMap::CoarseDistanceMap(int ww, int hh) {
   coarseProjectionGridNum = new int[ww*hh/(fac*fac)];
 
   w[0]=h[0]=0;
+  red=0;
 }
 
 CoarseDistanceMap::~CoarseDistanceMap() {
   delete[] fwdWarpedIDDistFinal;
-  delete[] bfsList1;
-  delete[] bfsList2;
+  delete[] colDist;
+  delete[] envelopeIdx;
+  delete[] envelopeZ;
   delete[] coarseProjectionGrid;
   delete[] coarseProjectionGridNum;
 }
@@ -1220,12 +1212,12 @@ void CoarseDistanceMap::makeDistanceMap(std::vector<FrameHessian*> frameHessians
   int w1 = w[1];
   int h1 = h[1];
   int wh1 = w1*h1;
+
+  /// seeds are 0, everything else "infinitely" far away.
   for(int i=0;i<wh1;i++)
-    fwdWarpedIDDistFinal[i] = 1000;
+    colDist[i] = 1e10;
 
   // make coarse tracking templates for latstRef.
-  int numItems = 0;
-
   for(FrameHessian* fh : frameHessians) {
     if(frame == fh) continue;
 
@@ -1245,130 +1237,136 @@ void CoarseDistanceMap::makeDistanceMap(std::vector<FrameHessian*> frameHessians
 
       if(!(u > 0 && v > 0 && u < w[1] && v < h[1])) continue;
 
-      fwdWarpedIDDistFinal[u+w1*v]=0;
-      bfsList1[numItems] = Eigen::Vector2i(u,v);
-      numItems++;
+      colDist[u+w1*v]=0;
     }
   }
 
-  growDistBFS(numItems);
+  /// exact euclidean distance transform in two separable passes:
+  /// first the distance to the closest seed within each column, then per row the lower envelope of the parabolas
+  /// (x-i)^2 + colDist(i)^2. columns and rows are independent, so both passes are split into bands.
+  if(red != 0 && multiThreading) {
+    int colStep = ((w1/4+NUM_THREADS-1)/NUM_THREADS)*4;
+    red->reduce(boost::bind(&CoarseDistanceMap::distTransformColsReductor, this, _1, _2, _3, _4), 0, w1, std::max(4,colStep));
+    red->reduce(boost::bind(&CoarseDistanceMap::distTransformRowsReductor, this, _1, _2, _3, _4), 0, h1);
+  }
+  else {
+    distTransformColsReductor(0, w1, 0, 0);
+    distTransformRowsReductor(0, h1, 0, 0);
+  }
 }
 
 void CoarseDistanceMap::makeInlierVotes(std::vector<FrameHessian*> frameHessians)
 {}
 
-void CoarseDistanceMap::growDistBFS(int bfsNum) {
-  assert(w[0] != 0);
-
+/// first pass: distance to the closest seed in the same column, for columns [min,max).
+/// rows are walked down and up again, 4 neighbouring columns at a time.
+void CoarseDistanceMap::distTransformColsReductor(int min, int max, Vec10* stats, int tid) {
   int w1 = w[1], h1 = h[1];
 
-  // original K is 40
-  for(int k=1;k<40;k++) {
-    int bfsNum2 = bfsNum;
-
-    /// every time I look aroound the previous point.
-    std::swap<Eigen::Vector2i*>(bfsList1,bfsList2);  /// swap each iteration.
-
-    bfsNum=0;
-
-    /// k is even number.
-    if(k % 2==0) {
-      for(int i=0;i<bfsNum2;i++) {
-        int x = bfsList2[i][0];
-        int y = bfsList2[i][1];
-        if(x==0 || y== 0 || x==w1-1 || y==h1-1) continue;
-        int idx = x + y * w1;
-
-        /// right
-        /// position w/o assignment.
-        if(fwdWarpedIDDistFinal[idx+1] > k) {
-          /// assign 2,4,6,...
-          fwdWarpedIDDistFinal[idx+1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x+1,y); bfsNum++;
-        }
-
-        /// left
-        if(fwdWarpedIDDistFinal[idx-1] > k) {
-          fwdWarpedIDDistFinal[idx-1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x-1,y); bfsNum++;
-        }
-
-        /// below
-        if(fwdWarpedIDDistFinal[idx+w1] > k) {
-          fwdWarpedIDDistFinal[idx+w1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x,y+1); bfsNum++;
-        }
-
-        /// above
-        if(fwdWarpedIDDistFinal[idx-w1] > k) {
-          fwdWarpedIDDistFinal[idx-w1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x,y-1); bfsNum++;
-        }
-      }
+  int x=min;
+#ifdef __SSE2__
+  const __m128 one = _mm_set1_ps(1.0f);
+  for(; x+3<max; x+=4) {
+    __m128 d = _mm_loadu_ps(colDist+x);
+    for(int y=1;y<h1;y++) {
+      d = _mm_min_ps(_mm_loadu_ps(colDist+x+y*w1), _mm_add_ps(d, one));
+      _mm_storeu_ps(colDist+x+y*w1, d);
     }
-    else {
-      for(int i=0;i<bfsNum2;i++) {
-
-        int x = bfsList2[i][0];
-        int y = bfsList2[i][1];
-
-        if(x==0 || y== 0 || x==w1-1 || y==h1-1) continue;
+    for(int y=h1-2;y>=0;y--) {
+      d = _mm_min_ps(_mm_loadu_ps(colDist+x+y*w1), _mm_add_ps(d, one));
+      _mm_storeu_ps(colDist+x+y*w1, d);
+    }
+  }
+#endif
+  for(; x<max; x++) {
+    for(int y=1;y<h1;y++)
+      colDist[x+y*w1] = std::min(colDist[x+y*w1], colDist[x+(y-1)*w1]+1);
+    for(int y=h1-2;y>=0;y--)
+      colDist[x+y*w1] = std::min(colDist[x+y*w1], colDist[x+(y+1)*w1]+1);
+  }
+}
 
-        int idx = x + y * w1;
+/// second pass: lower envelope of the column parabolas (Felzenszwalb & Huttenlocher), for rows [min,max).
+void CoarseDistanceMap::distTransformRowsReductor(int min, int max, Vec10* stats, int tid) {
+  int w1 = w[1];
 
-        /// up, down, left and right.
-        if(fwdWarpedIDDistFinal[idx+1] > k) {
-          fwdWarpedIDDistFinal[idx+1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x+1,y); bfsNum++;
-        }
+  int* vIdx = envelopeIdx + tid*(w[0]/2+1);
+  float* z = envelopeZ + tid*(w[0]/2+2);
 
-        if(fwdWarpedIDDistFinal[idx-1] > k) {
-          fwdWarpedIDDistFinal[idx-1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x-1,y); bfsNum++;
-        }
+  for(int y=min;y<max;y++) {
+    const float* g = colDist + y*w1;
+    float* out = fwdWarpedIDDistFinal + y*w1;
 
-        if(fwdWarpedIDDistFinal[idx+w1] > k) {
-          fwdWarpedIDDistFinal[idx+w1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x,y+1); bfsNum++;
-        }
+    /// parabolas of columns with a seed, (x-q)^2 + g(q)^2.
+    int k=-1;
+    for(int q=0;q<w1;q++) {
+      if(g[q] >= 1e10) continue;
+      float fq = g[q]*g[q] + q*q;
 
-        if(fwdWarpedIDDistFinal[idx-w1] > k) {
-          fwdWarpedIDDistFinal[idx-w1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x,y-1); bfsNum++;
-        }
+      if(k<0) {
+        k=0; vIdx[0]=q; z[0]=-1e20; z[1]=1e20;
+        continue;
+      }
 
-        /// four corners.
-        if(fwdWarpedIDDistFinal[idx+1+w1] > k) {
-          fwdWarpedIDDistFinal[idx+1+w1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x+1,y+1); bfsNum++;
-        }
+      /// intersection with the last parabola of the envelope, drop the ones that are hidden by q.
+      int p = vIdx[k];
+      float s = (fq - (g[p]*g[p] + p*p)) / (2*(q-p));
+      while(s <= z[k]) {
+        k--;
+        p = vIdx[k];
+        s = (fq - (g[p]*g[p] + p*p)) / (2*(q-p));
+      }
 
-        if(fwdWarpedIDDistFinal[idx-1+w1] > k) {
-          fwdWarpedIDDistFinal[idx-1+w1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x-1,y+1); bfsNum++;
-        }
+      k++;
+      vIdx[k]=q; z[k]=s; z[k+1]=1e20;
+    }
 
-        if(fwdWarpedIDDistFinal[idx-1-w1] > k) {
-          fwdWarpedIDDistFinal[idx-1-w1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x-1,y-1); bfsNum++;
-        }
+    /// no seed in any column: far away, as the BFS used to leave it.
+    if(k<0) {
+      for(int x=0;x<w1;x++) out[x] = 1000;
+      continue;
+    }
 
-        if(fwdWarpedIDDistFinal[idx+1-w1] > k) {
-          fwdWarpedIDDistFinal[idx+1-w1] = k;
-          bfsList1[bfsNum] = Eigen::Vector2i(x+1,y-1); bfsNum++;
-        }
-      }
+    int j=0;
+    for(int x=0;x<w1;x++) {
+      while(z[j+1] < x) j++;
+      int p = vIdx[j];
+      out[x] = sqrtf((x-p)*(x-p) + g[p]*g[p]);
     }
   }
 }
 
-/// generate distance field near point (u,v)
+/// add the point (u,v) to the distance field: distances only shrink, within the radius the old BFS used to propagate.
 void CoarseDistanceMap::addIntoDistFinal(int u, int v)
 {
   if(w[0] == 0) return;
-  bfsList1[0] = Eigen::Vector2i(u,v);
-  fwdWarpedIDDistFinal[u+w[1]*v] = 0;
-  growDistBFS(1);
+
+  int w1 = w[1], h1 = h[1];
+  const int maxDist = 40;
+
+  for(int y=std::max(0,v-maxDist+1); y<std::min(h1,v+maxDist); y++) {
+    int dy = y-v;
+    int rx = (int)sqrtf(maxDist*maxDist - dy*dy);
+    int xMin = std::max(0,u-rx);
+    int xMax = std::min(w1,u+rx+1);
+    float* out = fwdWarpedIDDistFinal + y*w1;
+
+    int x=xMin;
+#ifdef __SSE2__
+    const __m128 dy2 = _mm_set1_ps(dy*dy);
+    const __m128 four = _mm_set1_ps(4.0f);
+    __m128 dx = _mm_setr_ps(xMin-u, xMin-u+1, xMin-u+2, xMin-u+3);
+    for(; x+3<xMax; x+=4) {
+      __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx,dx), dy2));
+      _mm_storeu_ps(out+x, _mm_min_ps(_mm_loadu_ps(out+x), d));
+      dx = _mm_add_ps(dx, four);
+    }
+#endif
+    for(; x<xMax; x++) {
+      float d = sqrtf((x-u)*(x-u) + dy*dy);
+      if(d < out[x]) out[x] = d;
+    }
+  }
 }
 
 void CoarseDistanceMap::makeK(CalibHessian* HCalib) {
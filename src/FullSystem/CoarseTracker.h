@@ -33,6 +33,8 @@
 #include "util/settings.h"
 #include "OptimizationBackend/MatrixAccumulators.h"
 #include "IOWrapper/Output3DWrapper.h"
+#include "util/IndexThreadReduce.h"
+#include <chrono>
 
 #include <g2o/core/solver.h>
 #include <g2o/core/block_solver.h>
@@ -52,6 +54,15 @@ struct CalibHessian;
 struct FrameHessian;
 struct PointFrameResidual;
 
+/// how far trackNewestCoarse got with the pyramid.
+enum CoarseTrackingQuality {
+  TRACKING_FULL=0,       // down to level 0.
+  TRACKING_TRUNCATED,    // down to level 0, but iterations were cut by the deadline.
+  TRACKING_LEVEL1,       // level 0 skipped for the deadline, pose of level 1.
+  TRACKING_LOST          // no hypothesis tracked, predicted pose (set by FullSystem).
+};
+struct PointHessian;
+
 class CoarseTracker {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
@@ -63,6 +74,7 @@ class CoarseTracker {
       FrameHessian* newFrameHessian,
       SE3 &lastToNew_out, AffLight &aff_g2l_out,
       int coarsestLvl, Vec5 minResForAbort,
+      const std::chrono::steady_clock::time_point* deadline=0,
       IOWrap::Output3DWrapper* wrap=0);
 
   void setCTRefForFirstFrame(
@@ -111,9 +123,28 @@ class CoarseTracker {
   /// Optical flow indication, only pan and pan, rotation + pan pixel movement
   Vec3 lastFlowIndicators;
   double firstCoarseRMSE;
+
+  /// CoarseTrackingQuality of the last call.
+  int lastQuality;
+
+  /// Threads used to build the reference depth. 0 = single threaded.
+  IndexThreadReduce<Vec10>* red;
  private:
 
   void makeCoarseDepthL0(std::vector<FrameHessian*> frameHessians, FrameHessian* fh_right, CalibHessian Hcalib);
+  void makeCoarseDepthL0_Reductor(FrameHessian* fh_target, FrameHessian* fh_right, Mat33f K1, CalibHessian* Hcalib,
+                                  int min, int max, Vec10* stats, int tid);
+
+  /// builds levels > 0 from idepth[0] / weightSums[0], dilates them and fills the pc_* buffers.
+  void makeCoarseDepthPyramid();
+  void downsampleDepthReductor(int lvl, int min, int max, Vec10* stats, int tid);
+  void dilateDepthReductor(int lvl, int min, int max, Vec10* stats, int tid);
+  void normalizeDepthReductor(int lvl, int min, int max, Vec10* stats, int tid);
+
+  /// Points with a good residual to lastRef, and their (stereo refined) idepth.
+  std::vector<PointHessian*> refPoints;
+  std::vector<float> refPointIdepth;
+
   float* idepth[PYR_LEVELS];
   float* weightSums[PYR_LEVELS];
   float* weightSums_bak[PYR_LEVELS];
@@ -195,19 +226,23 @@ class CoarseDistanceMap {
 
   void addIntoDistFinal(int u, int v);
 
+  /// Threads used for the distance transform passes. 0 = single threaded.
+  IndexThreadReduce<Vec10>* red;
 
  private:
 
   PointFrameResidual** coarseProjectionGrid;
   int* coarseProjectionGridNum;
 
-  /// The coordinates projected into the frame
-  Eigen::Vector2i* bfsList1;
+  /// Distance to the closest projected point in the same column (first pass)
+  float* colDist;
 
-  /// Use with 1 rotation
-  Eigen::Vector2i* bfsList2;
+  /// Lower envelope of the parabolas of one row, per thread (second pass)
+  int* envelopeIdx;
+  float* envelopeZ;
 
-  void growDistBFS(int bfsNum);
+  void distTransformColsReductor(int min, int max, Vec10* stats, int tid);
+  void distTransformRowsReductor(int min, int max, Vec10* stats, int tid);
 };
 
 }
@@ -53,20 +53,37 @@
 #include "IOWrapper/Output3DWrapper.h"
 
 #include "util/ImageAndExposure.h"
+#include "util/TrajectoryWriter.h"
 
 #include <cmath>
+#include <chrono>
 #include <opencv/cv.h>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 namespace dso {
 
+/// wall time since t0 in ms.
+static inline float msSince(const std::chrono::steady_clock::time_point &t0) {
+  return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
 int FrameHessian::instanceCounter=0;
 int PointHessian::instanceCounter=0;
 int CalibHessian::instanceCounter=0;
 
 FullSystem::FullSystem() {
 
+  /// the pattern is compiled in (DSO_PATTERN_SIZE), but its offsets come from the tables in settings.cpp:
+  /// every pixel must lie within patternPadding, otherwise the residuals read outside the image.
+  for(int i=0; i<patternNum; i++) {
+    if(abs(patternP[i][0]) > patternPadding || abs(patternP[i][1]) > patternPadding) {
+      printf("pattern offset %d (%d, %d) is outside the padding %d of the %d pixel pattern!\n",
+             i, patternP[i][0], patternP[i][1], patternPadding, patternNum);
+      exit(1);
+    }
+  }
+
   int retstat =0;
   if(setting_logStuff) {
 
@@ -88,6 +105,10 @@ FullSystem::FullSystem() {
     coarseTrackingLog->open("logs/coarseTrackingLog.txt", std::ios::trunc | std::ios::out);
     coarseTrackingLog->precision(10);
 
+    budgetLog = new std::ofstream();
+    budgetLog->open("logs/budgetLog.txt", std::ios::trunc | std::ios::out);
+    budgetLog->precision(10);
+
     eigenAllLog = new std::ofstream();
     eigenAllLog->open("logs/eigenAllLog.txt", std::ios::trunc | std::ios::out);
     eigenAllLog->precision(10);
@@ -123,6 +144,8 @@ FullSystem::FullSystem() {
     eigenAllLog=0;
     numsLog=0;
     calibLog=0;
+    coarseTrackingLog=0;
+    budgetLog=0;
   }
 
   assert(retstat!=293847);
@@ -132,10 +155,17 @@ FullSystem::FullSystem() {
   selectionMap = new float[wG[0]*hG[0]];
 
   coarseDistanceMap = new CoarseDistanceMap(wG[0], hG[0]);
+  coarseDistanceMap->red = &this->treadReduce;
   coarseTracker = new CoarseTracker(wG[0], hG[0]);
   coarseTracker_forNewKF = new CoarseTracker(wG[0], hG[0]);
+  coarseTracker_building = new CoarseTracker(wG[0], hG[0]);
+  /// the three trackers rotate through the building role, all of them get the thread pool.
+  coarseTracker->red = &this->treadReduce;
+  coarseTracker_forNewKF->red = &this->treadReduce;
+  coarseTracker_building->red = &this->treadReduce;
   coarseInitializer = new CoarseInitializer(wG[0], hG[0]);
   pixelSelector = new PixelSelector(wG[0], hG[0]);
+  pixelSelector->red = &this->treadReduce;
 
   statistics_lastNumOptIts=0;
   statistics_numDroppedPoints=0;
@@ -145,11 +175,22 @@ FullSystem::FullSystem() {
   statistics_numForceDroppedResFwd = 0;
   statistics_numMargResFwd = 0;
   statistics_numMargResBwd = 0;
+  statistics_numEvictedImmaturePoints = 0;
 
   lastCoarseRMSE.setConstant(100);
+  lastCoarseFlow.setConstant(100);
 
   currentMinActDist=2;
   initialized=false;
+  nonKeyTraceMs=0;
+  lastFinishMs=0;
+
+  numFramesTotal=0;
+  numKeyFramesTotal=0;
+  lastKeyFrameShell=0;
+  numShellsWritten=0;
+  trajectoryWriter=0;
+  windowSnapshotVersion=0;
 
 
   ef = new EnergyFunctional();
@@ -179,6 +220,7 @@ FullSystem::~FullSystem() {
     calibLog->close(); delete calibLog;
     numsLog->close(); delete numsLog;
     coarseTrackingLog->close(); delete coarseTrackingLog;
+    budgetLog->close(); delete budgetLog;
     //errorsLog->close(); delete errorsLog;
     eigenAllLog->close(); delete eigenAllLog;
     eigenPLog->close(); delete eigenPLog;
@@ -190,6 +232,12 @@ FullSystem::~FullSystem() {
 
   delete[] selectionMap;
 
+  if(trajectoryWriter != 0)
+  {
+    writeFinishedPoses(true);
+    delete trajectoryWriter;
+  }
+
   for(FrameShell* s : allFrameHistory)
     delete s;
   for(FrameHessian* fh : unmappedTrackedFrames)
@@ -198,9 +246,19 @@ FullSystem::~FullSystem() {
   delete coarseDistanceMap;
   delete coarseTracker;
   delete coarseTracker_forNewKF;
+  delete coarseTracker_building;
   delete coarseInitializer;
   delete pixelSelector;
   delete ef;
+
+  if(!setting_debugout_runquiet)
+  {
+    ObjectPool<PointHessian>::instance().printStats("PointHessian");
+    ObjectPool<ImmaturePoint>::instance().printStats("ImmaturePoint");
+    ObjectPool<PointFrameResidual>::instance().printStats("PointFrameResidual");
+    ObjectPool<EFResidual>::instance().printStats("EFResidual");
+    ObjectPool<RawResidualJacobian>::instance().printStats("RawResidualJacobian");
+  }
 }
 
 void FullSystem::setOriginalCalib(VecXf originalCalib, int originalW, int originalH)
@@ -237,6 +295,12 @@ void FullSystem::printResult(std::string file) {
   boost::unique_lock<boost::mutex> lock(trackMutex);
   boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
 
+  if(trajectoryWriter != 0) {
+    printf("printResult: poses are streamed by the trajectory writer, not writing %s!\n", file.c_str());
+    return;
+  }
+  if(allFrameHistory.empty()) return;
+
   std::ofstream myfile;
   myfile.open (file.c_str());
   myfile << std::setprecision(15);
@@ -284,10 +348,54 @@ void FullSystem::printResult(std::string file) {
   myfile.close();
 }
 
+void FullSystem::streamTrajectory(std::string file, int format) {
+  boost::unique_lock<boost::mutex> lock(trackMutex);
+  assert(numFramesTotal == 0);
+
+  delete trajectoryWriter;
+  trajectoryWriter = new TrajectoryWriter(file, format);
+  numShellsWritten = 0;
+}
+
+void FullSystem::writeFinishedPoses(bool flushAll) {
+  if(trajectoryWriter == 0) return;
+
+  boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+
+  // strictly in frame order: a keyframe still in the window holds back all frames after it.
+  const int firstId = allFrameHistory.empty() ? numFramesTotal : allFrameHistory.front()->id;
+  while(numShellsWritten < numFramesTotal) {
+    FrameShell* s = allFrameHistory[numShellsWritten - firstId];
+    if(!s->poseFinal && !flushAll) break;
+
+    // same rules as printResult: invalid poses, and non-keyframes with onlyLogKFPoses, repeat the last pose.
+    bool valid = s->poseValid && !(setting_onlyLogKFPoses && s->marginalizedAt == s->id);
+    trajectoryWriter->push(s->timestamp, s->camToWorld, valid);
+    numShellsWritten++;
+  }
+
+  // drop written shells, but keep the last few for the motion model, and every tracking reference
+  // of a frame that is not written yet (its pose is still computed from it).
+  int keepFrom = std::min(numShellsWritten, numFramesTotal - std::max(3, setting_shellHistory));
+  for(int i = numShellsWritten - firstId; i < (int)allFrameHistory.size(); i++)
+    if(allFrameHistory[i]->trackingRef != 0)
+      keepFrom = std::min(keepFrom, allFrameHistory[i]->trackingRef->id);
+
+  while(!allFrameHistory.empty() && allFrameHistory.front()->id < keepFrom) {
+    delete allFrameHistory.front();
+    allFrameHistory.pop_front();
+  }
+}
+
 // use the determined motion model to track the new frame, an get the pose and photometric parameters.
 Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
   assert(allFrameHistory.size() > 0);
 
+  /// per-frame deadline of the coarse tracking, counted from here.
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float, std::milli>(setting_trackingDeadlineMs));
+  const std::chrono::steady_clock::time_point* trackingDeadline = setting_trackingDeadlineMs > 0 ? &deadline : 0;
+
   // set pose initialization.
   // printf("the size of allFrameHistory is %d \n", (int)allFrameHistory.size());
 
@@ -299,13 +407,16 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
   //// lastF = last TrackingRef.
   FrameHessian* lastF = coarseTracker->lastRef;
 
+  /// keyframe poses are taken from the published window, so the optimization is never waited for.
+  WindowSnapshotPtr window = getWindowSnapshot();
+
   AffLight aff_last_2_l = AffLight(0,0);
 
   // STEP1: set different cases.
   std::vector<SE3,Eigen::aligned_allocator<SE3>> lastF_2_fh_tries;
 
   // for first two frames process differently
-  if(allFrameHistory.size() == 2) {
+  if(numFramesTotal == 2) {
     initializeFromInitializer(fh);
 
     lastF_2_fh_tries.push_back(SE3(Eigen::Matrix<double, 3, 3>::Identity(), Eigen::Matrix<double,3,1>::Zero() ));
@@ -346,12 +457,14 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
     coarseTracker->setCTRefForFirstFrame(frameHessians);
 
     lastF = coarseTracker->lastRef;
+    window = getWindowSnapshot();
   }
   else {
     FrameShell* slast = allFrameHistory[allFrameHistory.size()-2];
     FrameShell* sprelast = allFrameHistory[allFrameHistory.size()-3];
     SE3 slast_2_sprelast;
     SE3 lastF_2_slast;
+    const WindowSnapshot::Frame* wLastF = window ? window->find(lastF->shell->id) : 0;
 
     // lock on global pose consistency!
     {
@@ -361,7 +474,7 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
       slast_2_sprelast = sprelast->camToWorld.inverse() * slast->camToWorld;
 
       //// T_c-1_k
-      lastF_2_slast = slast->camToWorld.inverse() * lastF->shell->camToWorld;
+      lastF_2_slast = slast->camToWorld.inverse() * (wLastF ? wLastF->camToWorld : lastF->shell->camToWorld);
 
       aff_last_2_l = slast->aff_g2l;
     }
@@ -436,17 +549,29 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
   Vec5 achievedRes = Vec5::Constant(NAN);
   bool haveOneGood = false;
   int tryIterations=0;
+  int trackingQuality = TRACKING_LOST;
+
+  /// a confident motion prior (little flow and a good residual on the last frame) skips the coarsest levels
+  /// for the first try; the other tries always start at the top.
+  int confidentLvl = pyrLevelsUsed-1;
+  if(setting_trackingConfidentFlow > 0 &&
+     coarseTracker->firstCoarseRMSE > 0 &&
+     sqrtf((float)lastCoarseFlow[2]) < setting_trackingConfidentFlow &&
+     lastCoarseRMSE[0] < coarseTracker->firstCoarseRMSE*setting_reTrackThreshold)
+    confidentLvl = std::min(pyrLevelsUsed-1, std::max(0, setting_trackingConfidentLvl));
 
   // STEP2: try different cases to get a good tracking result.
   for(unsigned int i=0; i<lastF_2_fh_tries.size(); i++) {
     AffLight aff_g2l_this = aff_last_2_l;      /// assignment of the previous frame to the current frame.
     SE3 lastF_2_fh_this = lastF_2_fh_tries[i];
+    int startLvl = i == 0 ? confidentLvl : pyrLevelsUsed-1;
 
     bool trackingIsGood = coarseTracker->trackNewestCoarse(fh,
                                                            lastF_2_fh_this,
                                                            aff_g2l_this,
-                                                           pyrLevelsUsed-1,
-                                                           achievedRes);	// in each level has to be at least as good as the last try.
+                                                           startLvl,
+                                                           achievedRes,	// in each level has to be at least as good as the last try.
+                                                           trackingDeadline);
 
     tryIterations++;
 
@@ -455,7 +580,7 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
       printf("RE-TRACK ATTEMPT %d with initOption %d and start-lvl %d (ab %f %f): %f %f %f %f %f -> %f %f %f %f %f \n",
              i,
              i,
-             pyrLevelsUsed-1,
+             startLvl,
              aff_g2l_this.a,
              aff_g2l_this.b,
              achievedRes[0],
@@ -480,6 +605,7 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
       flowVecs = coarseTracker->lastFlowIndicators;
       aff_g2l = aff_g2l_this;
       lastF_2_fh = lastF_2_fh_this;
+      trackingQuality = coarseTracker->lastQuality;
       haveOneGood = true;
     }
 
@@ -498,6 +624,10 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
     /// STEP4: pause if energy is less than the threshold, and set the threshold for the next time.
     if(haveOneGood &&  achievedRes[0] < lastCoarseRMSE[0]*setting_reTrackThreshold)
       break;
+
+    /// out of time: take the best so far. Without any good try we keep going, losing track is worse than being late.
+    if(haveOneGood && trackingDeadline != 0 && std::chrono::steady_clock::now() > deadline)
+      break;
   }
 
   if(!haveOneGood) {
@@ -509,6 +639,7 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
 
   /// give the best value obtained this time as the threshold value next time.
   lastCoarseRMSE = achievedRes;
+  lastCoarseFlow = haveOneGood ? flowVecs : Vec3(100,100,100);
 
   /// STEP5: At this time the shell is in the tracking phase, no one uses it, set the value.
   // no lock required, as fh is not used anywhere yet.
@@ -516,8 +647,10 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
   fh->shell->camToTrackingRef = lastF_2_fh.inverse();
   fh->shell->trackingRef = lastF->shell;
   fh->shell->aff_g2l = aff_g2l;
+  fh->shell->trackingQuality = trackingQuality;
   //// Twc = Twr * Trc
-  fh->shell->camToWorld = fh->shell->trackingRef->camToWorld * fh->shell->camToTrackingRef;
+  const WindowSnapshot::Frame* wRef = window ? window->find(lastF->shell->id) : 0;
+  fh->shell->camToWorld = (wRef ? wRef->camToWorld : fh->shell->trackingRef->camToWorld) * fh->shell->camToTrackingRef;
 
   // std::cout << "AFTER fh->shell->trackingRef(lastF)->camToWorld\n" << lastF->shell->camToWorld.matrix() << "\nAFTER fh->shell->camToTrackingRef\n" << fh->shell->camToTrackingRef.matrix() << "\nAFTER fh->shell->camToWorld\n" << fh->shell->camToWorld.matrix() << std::endl;
 
@@ -529,7 +662,7 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
     coarseTracker->firstCoarseRMSE = achievedRes[0];
 
   if(!setting_debugout_runquiet)
-    printf("Coarse Tracker tracked ab = %f %f (exp %f). Res %f!\n", aff_g2l.a, aff_g2l.b, fh->ab_exposure, achievedRes[0]);
+    printf("Coarse Tracker tracked ab = %f %f (exp %f). Res %f (quality %d)!\n", aff_g2l.a, aff_g2l.b, fh->ab_exposure, achievedRes[0], trackingQuality);
 
   if(setting_logStuff) {
     (*coarseTrackingLog) << std::setprecision(16)
@@ -540,7 +673,8 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian* fh, FrameHessian* fh_right) {
                          << aff_g2l.a << " "
                          << aff_g2l.b << " "
                          << achievedRes[0] << " "
-                         << tryIterations << "\n";
+                         << tryIterations << " "
+                         << trackingQuality << "\n";
   }
 
   return Vec4(achievedRes[0], flowVecs[0], flowVecs[1], flowVecs[2]);
@@ -554,7 +688,7 @@ void FullSystem::stereoMatch( ImageAndExposure* image, ImageAndExposure* image_r
 
   shell->camToWorld = SE3(); 		// no lock required, as fh is not used anywhere yet.
   shell->aff_g2l = AffLight(0,0);
-  shell->marginalizedAt = shell->id = allFrameHistory.size();
+  shell->marginalizedAt = shell->id = numFramesTotal;
   shell->timestamp = image->timestamp;
   shell->incoming_id = id; // id passed into DSO
   fh->shell = shell;
@@ -632,6 +766,8 @@ void FullSystem::stereoMatch( ImageAndExposure* image, ImageAndExposure* image_r
 void FullSystem::traceNewCoarseNonKey(FrameHessian* fh, FrameHessian* fh_right) {
   boost::unique_lock<boost::mutex> lock(mapMutex);
 
+  evictImmaturePoints();
+
   // new idepth after refinement
   float idepth_min_update = 0;
   float idepth_max_update = 0;
@@ -745,6 +881,8 @@ void FullSystem::traceNewCoarseNonKey(FrameHessian* fh, FrameHessian* fh_right)
 void FullSystem::traceNewCoarseKey(FrameHessian* fh, FrameHessian* fh_right) {
   boost::unique_lock<boost::mutex> lock(mapMutex);
 
+  evictImmaturePoints();
+
   //// deprecated.
   // int trace_total=0, trace_good=0, trace_oob=0, trace_out=0, trace_skip=0, trace_badcondition=0, trace_uninitialized=0;
 
@@ -780,6 +918,61 @@ void FullSystem::traceNewCoarseKey(FrameHessian* fh, FrameHessian* fh_right) {
   }
 }
 
+/// keep the number of immature points in the window below setting_maxImmaturePoints.
+/// the points with the lowest priority are deleted, this bounds the cost of each trace pass.
+void FullSystem::evictImmaturePoints() {
+  if(setting_maxImmaturePoints <= 0) return;
+
+  int numImmature = 0;
+  for(FrameHessian* host : frameHessians)
+    numImmature += host->immaturePoints.size();
+
+  if(numImmature <= setting_maxImmaturePoints) return;
+
+  /// priorities in traversal order.
+  std::vector<float> priorities;
+  priorities.reserve(numImmature);
+  for(FrameHessian* host : frameHessians)
+    for(ImmaturePoint* ph : host->immaturePoints)
+      priorities.push_back(ph->getBudgetPriority());
+
+  /// threshold: the numEvict-th smallest priority.
+  int numEvict = numImmature - setting_maxImmaturePoints;
+  std::vector<float> sorted = priorities;
+  std::nth_element(sorted.begin(), sorted.begin()+numEvict-1, sorted.end());
+  float priorityTH = sorted[numEvict-1];
+
+  /// points with exactly the threshold priority are only evicted until numEvict is reached.
+  int numBelow = 0;
+  for(float p : priorities)
+    if(p < priorityTH) numBelow++;
+  int numAtTHToEvict = numEvict - numBelow;
+
+  int k = 0, numEvicted = 0;
+  for(FrameHessian* host : frameHessians) {
+    int numKept = 0;
+    for(unsigned int i=0;i<host->immaturePoints.size();i++) {
+      float p = priorities[k++];
+      bool evict = p < priorityTH || (p == priorityTH && numAtTHToEvict-- > 0);
+
+      if(evict) {
+        delete host->immaturePoints[i];
+        numEvicted++;
+      }
+      else {
+        host->immaturePoints[numKept++] = host->immaturePoints[i];
+      }
+    }
+    host->immaturePoints.resize(numKept);
+  }
+
+  statistics_numEvictedImmaturePoints += numEvicted;
+
+  if(!setting_debugout_runquiet)
+    printf("IMMATURE BUDGET: evicted %d of %d immature points (budget %d, priority th %f)!\n",
+           numEvicted, numImmature, setting_maxImmaturePoints, priorityTH);
+}
+
 /// handle picking out points to be activated.
 void FullSystem::activatePointsMT_Reductor(std::vector<PointHessian*>* optimized,
                                            std::vector<ImmaturePoint*>* toOptimize,
@@ -795,30 +988,37 @@ void FullSystem::activatePointsMT_Reductor(std::vector<PointHessian*>* optimized
 /// activate immature points, join optimization.
 void FullSystem::activatePointsMT() {
   /// STEP1: threshold calculation, control the number by distance map. currentMinActDist initial value is 2.
-  if(ef->nPoints < setting_desiredPointDensity*0.66)   //setting_desiredPointDensity 是2000
+  /// the target follows the mapping time budget (setting_desiredPointDensity if there is none).
+  const float desiredPointDensity = mappingBudget.pointDensity();
+
+  if(ef->nPoints < desiredPointDensity*0.66)   //setting_desiredPointDensity 是2000
     currentMinActDist -= 0.8;  //original 0.8
-  if(ef->nPoints < setting_desiredPointDensity*0.8)
+  if(ef->nPoints < desiredPointDensity*0.8)
     currentMinActDist -= 0.5;  //original 0.5
-  else if(ef->nPoints < setting_desiredPointDensity*0.9)
+  else if(ef->nPoints < desiredPointDensity*0.9)
     currentMinActDist -= 0.2;  //original 0.2
-  else if(ef->nPoints < setting_desiredPointDensity)
+  else if(ef->nPoints < desiredPointDensity)
     currentMinActDist -= 0.1;  //original 0.1
 
-  if(ef->nPoints > setting_desiredPointDensity*1.5)
+  if(ef->nPoints > desiredPointDensity*1.5)
     currentMinActDist += 0.8;
-  if(ef->nPoints > setting_desiredPointDensity*1.3)
+  if(ef->nPoints > desiredPointDensity*1.3)
     currentMinActDist += 0.5;
-  if(ef->nPoints > setting_desiredPointDensity*1.15)
+  if(ef->nPoints > desiredPointDensity*1.15)
     currentMinActDist += 0.2;
-  if(ef->nPoints > setting_desiredPointDensity)
+  if(ef->nPoints > desiredPointDensity)
     currentMinActDist += 0.1;
 
+  /// over budget: activate sparser right away, not only once the window has filled up.
+  if(mappingBudget.decision < 0)
+    currentMinActDist += 0.5;
+
   if(currentMinActDist < 0) currentMinActDist = 0;
   if(currentMinActDist > 4) currentMinActDist = 4;
 
   if(!setting_debugout_runquiet)
     printf("SPARSITY:  MinActDist %f (need %d points, have %d points)!\n",
-           currentMinActDist, (int)(setting_desiredPointDensity), ef->nPoints);
+           currentMinActDist, (int)(desiredPointDensity), ef->nPoints);
 
   FrameHessian* newestHs = frameHessians.back();
 
@@ -1061,6 +1261,7 @@ void FullSystem::addActiveFrame( ImageAndExposure* image, ImageAndExposure* imag
 
   /// STEP1: lock the tacking thread.
   boost::unique_lock<boost::mutex> lock(trackMutex);
+  writeFinishedPoses(false);
 
   /// STEP2: create framehessian and frameshell, initialize them accordingly, and store all frames.
   // =========================== add into allFrameHistory =========================
@@ -1070,7 +1271,7 @@ void FullSystem::addActiveFrame( ImageAndExposure* image, ImageAndExposure* imag
 
   shell->camToWorld = SE3(); 		// no lock required, as fh is not used anywhere yet.
   shell->aff_g2l = AffLight(0,0);
-  shell->marginalizedAt = shell->id = allFrameHistory.size();
+  shell->marginalizedAt = shell->id = numFramesTotal++;
   shell->timestamp = image->timestamp;
   shell->incoming_id = id; // id passed into DSO
   fh->shell = shell;
@@ -1078,11 +1279,15 @@ void FullSystem::addActiveFrame( ImageAndExposure* image, ImageAndExposure* imag
   allFrameHistory.push_back(shell); /// save only a brief shell.
 
   /// STEP3: get the exposure time, generate a pyramid, and calculate the entire image gradient.
+  /// Only the first frame needs the gradient maps right away, tracked frames get them if they become a keyframe.
   // =========================== make Images / derivatives etc. =========================
   fh->ab_exposure = image->exposure_time;
-  fh->makeImages(image->image, &Hcalib);
+  if(!initialized)
+    fh->makeImages(image->image, &Hcalib);
+  else
+    fh->makeTrackingImages(image->image);
   fh_right->ab_exposure = image_right->exposure_time;
-  fh_right->makeImages(image_right->image,&Hcalib);
+  fh_right->makeStereoImages(image_right->image);
 
   /// STEP4: initialization.
   if(!initialized) {
@@ -1099,13 +1304,15 @@ void FullSystem::addActiveFrame( ImageAndExposure* image, ImageAndExposure* imag
   else {
     /// STEP5: tracking the new frame, get the pose photometric, and determine the tracking status.
     // =========================== SWAP tracking reference?. =========================
-    if(coarseTracker_forNewKF->refFrameID > coarseTracker->refFrameID) {
+    {
       boost::unique_lock<boost::mutex> crlock(coarseTrackerSwapMutex);
 
       /// exchange the reference frame and the current tracker's coarseTracker.
-      CoarseTracker* tmp = coarseTracker;
-      coarseTracker=coarseTracker_forNewKF;
-      coarseTracker_forNewKF=tmp;
+      if(coarseTracker_forNewKF->refFrameID > coarseTracker->refFrameID) {
+        CoarseTracker* tmp = coarseTracker;
+        coarseTracker=coarseTracker_forNewKF;
+        coarseTracker_forNewKF=tmp;
+      }
     }
 
     //// tres[0]: achievedRes[0] = sqrtf((float)(resOld[0] / resOld[1])) at LEVEL 0
@@ -1128,8 +1335,8 @@ void FullSystem::addActiveFrame( ImageAndExposure* image, ImageAndExposure* imag
 
     /// how ofen are keyframes inserted.
     if(setting_keyframesPerSecond > 0) {
-      needToMakeKF = allFrameHistory.size()== 1 ||
-                     (fh->shell->timestamp - allKeyFramesHistory.back()->timestamp) > 0.95f/setting_keyframesPerSecond;
+      needToMakeKF = numFramesTotal == 1 ||
+                     (fh->shell->timestamp - lastKeyFrameShell->timestamp) > 0.95f/setting_keyframesPerSecond;
     }
     else {
       Vec2 refToFh = AffLight::fromToVecExposure(coarseTracker->lastRef->ab_exposure,
@@ -1146,7 +1353,7 @@ void FullSystem::addActiveFrame( ImageAndExposure* image, ImageAndExposure* imag
       // std::cout << "\tdelta: " << delta << std::endl;
 
       // BRIGHTNESS CHECK
-      needToMakeKF = allFrameHistory.size()== 1 ||
+      needToMakeKF = numFramesTotal == 1 ||
                      delta > 1 ||
                      2*coarseTracker->firstCoarseRMSE < tres[0];  /// the error energy changes too much. (double the initial value.)
     }
@@ -1240,7 +1447,7 @@ void FullSystem::mappingLoop() {
     unmappedTrackedFrames_right.pop_front();
 
     // guaranteed to make a KF for the very first two tracked frames.
-    if(allKeyFramesHistory.size() <= 2) {
+    if(numKeyFramesTotal <= 2) {
       lock.unlock();
       /// run makeKeyFrame will not affect unmappedTrackedFrames, so unlock.
       makeKeyFrame(fh, fh_right);
@@ -1268,6 +1475,7 @@ void FullSystem::mappingLoop() {
           boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
           assert(fh->shell->trackingRef != 0);
           fh->shell->camToWorld = fh->shell->trackingRef->camToWorld * fh->shell->camToTrackingRef;
+          fh->shell->poseFinal = true;
           fh->setEvalPT_scaled(fh->shell->camToWorld.inverse(),fh->shell->aff_g2l);
         }
         delete fh;
@@ -1276,7 +1484,8 @@ void FullSystem::mappingLoop() {
     }
     else {
       /// layer need keyframes.
-      if(setting_realTimeMaxKF || needNewKFAfter >= frameHessians.back()->shell->id) {
+      /// lastKeyFrameShell is frameHessians.back()->shell, without reading the window finishKeyFrame may be changing.
+      if(setting_realTimeMaxKF || needNewKFAfter >= lastKeyFrameShell->id) {
         //// make new KF.
         lock.unlock();
         makeKeyFrame(fh, fh_right);
@@ -1303,10 +1512,70 @@ void FullSystem::blockUntilMappingIsFinished() {
   lock.unlock();
 
   mappingThread.join();
+
+  waitForKeyFrameFinish();
+}
+
+void FullSystem::waitForKeyFrameFinish() {
+  if(keyframeFinishThread.joinable())
+    keyframeFinishThread.join();
+}
+
+void FullSystem::publishWindowSnapshot() {
+  boost::shared_ptr<WindowSnapshot> snapshot(new WindowSnapshot());
+  snapshot->version = ++windowSnapshotVersion;
+  snapshot->fx = Hcalib.fxl();
+  snapshot->fy = Hcalib.fyl();
+  snapshot->cx = Hcalib.cxl();
+  snapshot->cy = Hcalib.cyl();
+
+  int numPoints = 0;
+  for(FrameHessian* fh : frameHessians)
+    numPoints += fh->pointHessians.size();
+  snapshot->points.reserve(numPoints);
+  snapshot->frames.resize(frameHessians.size());
+
+  {
+    /// the shells hold the optimized poses (set in the optimization under this lock).
+    boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+    for(unsigned int i=0;i<frameHessians.size();i++) {
+      FrameHessian* fh = frameHessians[i];
+      WindowSnapshot::Frame &f = snapshot->frames[i];
+      f.shellId = fh->shell->id;
+      f.incomingId = fh->shell->incoming_id;
+      f.frameID = fh->frameID;
+      f.timestamp = fh->shell->timestamp;
+      f.camToWorld = fh->shell->camToWorld;
+      f.aff_g2l = fh->shell->aff_g2l;
+    }
+  }
+
+  for(unsigned int i=0;i<frameHessians.size();i++) {
+    WindowSnapshot::Frame &f = snapshot->frames[i];
+    f.pointBegin = snapshot->points.size();
+    for(PointHessian* ph : frameHessians[i]->pointHessians) {
+      WindowSnapshot::Point p;
+      p.u = ph->u;
+      p.v = ph->v;
+      p.idepth = ph->idepth_scaled;
+      p.idepthHessian = ph->idepth_hessian;
+      p.numGoodResiduals = ph->numGoodResiduals;
+      snapshot->points.push_back(p);
+    }
+    f.pointEnd = snapshot->points.size();
+  }
+
+  WindowSnapshotPtr published = snapshot;
+  boost::atomic_store(&windowSnapshot, published);
+
+  for(IOWrap::Output3DWrapper* ow : outputWrapper)
+    ow->publishWindowSnapshot(published);
 }
 
 /// set as non-keyframe.
 void FullSystem::makeNonKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
+  waitForKeyFrameFinish();
+
   // needs to be set by mapping thread. no lock required since we are in mapping thread.
   {
     boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
@@ -1315,13 +1584,16 @@ void FullSystem::makeNonKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
     /// take out its current pose during mapping to get camToWorld.
     //// T_w_curr = T_w_ref * T_ref_curr
     fh->shell->camToWorld = fh->shell->trackingRef->camToWorld * fh->shell->camToTrackingRef;
+    fh->shell->poseFinal = true;
 
     /// remove the estimated pose at this time.
     fh->setEvalPT_scaled(fh->shell->camToWorld.inverse(), fh->shell->aff_g2l);
   }
 
   /// update the immature point (the point where the depth has no converged).
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
   traceNewCoarseNonKey(fh, fh_right);
+  nonKeyTraceMs += msSince(t0);
 
   delete fh;
   delete fh_right;
@@ -1329,6 +1601,8 @@ void FullSystem::makeNonKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
 
 /// keyframe generation, optimization, activation points, extraction points, marginalized keyframes.
 void FullSystem::makeKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
+  waitForKeyFrameFinish();
+
   /// STEP1: set the pose and photometric parameters of the currently estimated fh.
   // needs to be set by mapping thread
   {
@@ -1338,9 +1612,15 @@ void FullSystem::makeKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
     fh->setEvalPT_scaled(fh->shell->camToWorld.inverse(), fh->shell->aff_g2l);
   }
 
+  /// promote the tracking frame: pixel selection for the new points needs the gradient maps.
+  fh->makeGradMaps(&Hcalib);
+
   /// STEP2: use this frame to update the immature point of the previous frame.
   /// update the immature points (the points where the depth has not converged)
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
   traceNewCoarseKey(fh, fh_right);
+  float traceMs = msSince(t0) + nonKeyTraceMs;
+  nonKeyTraceMs = 0;
 
   boost::unique_lock<boost::mutex> lock(mapMutex);
 
@@ -1355,8 +1635,8 @@ void FullSystem::makeKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
   //// Activated Keyframes. size is usually 8 fixed.
   frameHessians.push_back(fh);
 
-  fh->frameID = allKeyFramesHistory.size();
-  allKeyFramesHistory.push_back(fh->shell);
+  fh->frameID = numKeyFramesTotal++;
+  lastKeyFrameShell = fh->shell;
   ef->insertFrame(fh, &Hcalib);
 
   /// this will be run every time a keyframe is added to set the pose. set the pose linearization point.
@@ -1388,30 +1668,34 @@ void FullSystem::makeKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
 
   /// STEP6: activate some immature points on all keyframes (construct new residuals)
   // =========================== Activate Points (& flag for marginalization). =========================
+  t0 = std::chrono::steady_clock::now();
   activatePointsMT();
   /// ? why do you want to reset the ID? is it because of adding a new frame?
   ef->makeIDX();
+  float activateMs = msSince(t0);
 
   /// optimize the keyframes in the sliding window (easy to say, there are many problems in it)
   // =========================== OPTIMIZE ALL =========================
   /// aren't those two values the same???
   fh->frameEnergyTH = frameHessians.back()->frameEnergyTH;
 
+  t0 = std::chrono::steady_clock::now();
   float rmse = optimize(setting_maxOptIterations);
+  float optimizeMs = msSince(t0);
   //// commented out.
   std::cout << "rmse: " << rmse << std::endl;
 
   // =========================== Figure Out if INITIALIZATION FAILED =========================
-  if(allKeyFramesHistory.size() <= 4) {
-    if(allKeyFramesHistory.size()==2 && rmse > 20*benchmark_initializerSlackFactor) {
+  if(numKeyFramesTotal <= 4) {
+    if(numKeyFramesTotal==2 && rmse > 20*benchmark_initializerSlackFactor) {
       printf("[1] I THINK INITIALIZATINO FAILED! Resetting.\n");
       initFailed=true;
     }
-    if(allKeyFramesHistory.size()==3 && rmse > 13*benchmark_initializerSlackFactor) {
+    if(numKeyFramesTotal==3 && rmse > 13*benchmark_initializerSlackFactor) {
       printf("[2] I THINK INITIALIZATINO FAILED! Resetting.\n");
       initFailed=true;
     }
-    if(allKeyFramesHistory.size()==4 && rmse > 9*benchmark_initializerSlackFactor) {
+    if(numKeyFramesTotal==4 && rmse > 9*benchmark_initializerSlackFactor) {
       printf("[3] I THINK INITIALIZATINO FAILED! Resetting.\n");
       initFailed=true;
     }
@@ -1422,38 +1706,62 @@ void FullSystem::makeKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
     return;
   }
 
+  publishWindowSnapshot();
+
+  /// densities for the next keyframe.
+  mappingBudget.update(traceMs, activateMs, optimizeMs, lastFinishMs);
+  printBudgetLine();
+
   /// STEP8: remove the outlier points and set the latest frame as the latest frame.
   // =========================== REMOVE OUTLIER =========================
   removeOutliers();
 
   {
-    boost::unique_lock<boost::mutex> crlock(coarseTrackerSwapMutex);
+    /// the new reference is built in coarseTracker_building, which the tracking thread never sees,
+    /// so tracking continues on the old reference meanwhile.
     /// update intrinsic parameteres.
-    coarseTracker_forNewKF->makeK(&Hcalib);
+    coarseTracker_building->makeK(&Hcalib);
 
-    //// set last Reference Keyframe into 'coarseTracker_forNewKF->lastRef'
-    coarseTracker_forNewKF->setCoarseTrackingRef(frameHessians, fh_right, Hcalib);
+    //// set last Reference Keyframe into 'coarseTracker_building->lastRef'
+    coarseTracker_building->setCoarseTrackingRef(frameHessians, fh_right, Hcalib);
 
     if(Twc_prior_.translation().norm() > 1.1) {
       std::cout << "[+] Got Twc_prior from OpenVSLAM!" << std::endl;
       fh->shell->camToWorld = Twc_prior_;
-      coarseTracker_forNewKF->lastRef = fh;
+      coarseTracker_building->lastRef = fh;
     }
 
     //// plot color coded depth image.
-    coarseTracker_forNewKF->debugPlotIDepthMap(&minIdJetVisTracker, &maxIdJetVisTracker, outputWrapper);
-    coarseTracker_forNewKF->debugPlotIDepthMapFloat(outputWrapper);
+    coarseTracker_building->debugPlotIDepthMap(&minIdJetVisTracker, &maxIdJetVisTracker, outputWrapper);
+    coarseTracker_building->debugPlotIDepthMapFloat(outputWrapper);
+
+    /// publish: only the pointer exchange is done under the lock.
+    boost::unique_lock<boost::mutex> crlock(coarseTrackerSwapMutex);
+    CoarseTracker* tmp = coarseTracker_forNewKF;
+    coarseTracker_forNewKF = coarseTracker_building;
+    coarseTracker_building = tmp;
   }
 
+  lock.unlock();
+
+  /// the tracker has its new reference now, nothing below changes it. Tracking the next frames only needs
+  /// coarseTracker and the shell poses, so the rest runs alongside; the next makeKeyFrame / makeNonKeyFrame waits for it.
+  if(setting_pipelineKeyFrames)
+    keyframeFinishThread = boost::thread(&FullSystem::finishKeyFrame, this, fh, fh_right);
+  else
+    finishKeyFrame(fh, fh_right);
+}
+
+void FullSystem::finishKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  boost::unique_lock<boost::mutex> lock(mapMutex);
+
   /// STEP9: mark delete and marginalized points, and delete & marginalize.
   // =========================== (Activate-)Marginalize Points =========================
   flagPointsForRemoval();
   ef->dropPointsF();
 
-  getNullspaces(ef->lastNullspaces_pose,
-                ef->lastNullspaces_scale,
-                ef->lastNullspaces_affA,
-                ef->lastNullspaces_affB);
+  updateNullspaces();
 
   ef->marginalizePointsF();
 
@@ -1463,7 +1771,7 @@ void FullSystem::makeKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
   makeNewTraces(fh, fh_right, 0);
 
   for(IOWrap::Output3DWrapper* ow : outputWrapper) {
-    ow->publishGraph(ef->connectivityMap);
+    ow->publishGraph(ef->getConnectivityMap());
     ow->publishKeyframes(frameHessians, false, &Hcalib);
   }
 
@@ -1477,7 +1785,11 @@ void FullSystem::makeKeyFrame( FrameHessian* fh, FrameHessian* fh_right) {
     }
   }
 
+  /// frames left the window.
+  publishWindowSnapshot();
+
   delete fh_right;
+  lastFinishMs = msSince(t0);
   // printLogLine();
   // printEigenValLine();
 }
@@ -1498,8 +1810,8 @@ void FullSystem::initializeFromInitializer(FrameHessian* newFrame) {
   FrameHessian* firstFrame = coarseInitializer->firstFrame;   /// the first frame is added to the map.
   firstFrame->idx = frameHessians.size();                     /// assign it an id (starting at 0)
   frameHessians.push_back(firstFrame);                        /// keyframe container in the map.
-  firstFrame->frameID = allKeyFramesHistory.size();           /// all historical keyframe ids.
-  allKeyFramesHistory.push_back(firstFrame->shell);           /// all historical keyframes.
+  firstFrame->frameID = numKeyFramesTotal++;                  /// all historical keyframe ids.
+  lastKeyFrameShell = firstFrame->shell;                      /// newest keyframe.
   ef->insertFrame(firstFrame, &Hcalib);
   setPrecalcValues();                                         /// set relative pose pre-calculated values.
 
@@ -1592,6 +1904,8 @@ void FullSystem::initializeFromInitializer(FrameHessian* newFrame) {
 
   }
 
+  publishWindowSnapshot();
+
   initialized=true;
   printf("INITIALIZE FROM INITIALIZER (%d pts)!\n", (int)firstFrame->pointHessians.size());
 }
@@ -1601,7 +1915,7 @@ void FullSystem::makeNewTraces(FrameHessian* newFrame, FrameHessian* newFrameRig
   /// bug is uesless
   pixelSelector->allowFast = true;
   //int numPointsTotal = makePixelStatus(newFrame->dI, selectionMap, wG[0], hG[0], setting_desiredDensity);
-  int numPointsTotal = pixelSelector->makeMaps(newFrame, selectionMap,setting_desiredImmatureDensity);
+  int numPointsTotal = pixelSelector->makeMaps(newFrame, selectionMap, mappingBudget.immatureDensity());
 
   newFrame->pointHessians.reserve(numPointsTotal*1.2f);
   //fh->pointHessiansInactive.reserve(numPointsTotal*1.2f);
@@ -1648,15 +1962,15 @@ void FullSystem::printLogLine() {
 
   if(!setting_debugout_runquiet)
     printf("LOG %d: %.3f fine. Res: %d A, %d L, %d M; (%'d / %'d) forceDrop. a=%f, b=%f. Window %d (%d)\n",
-           allKeyFramesHistory.back()->id,
+           lastKeyFrameShell->id,
            statistics_lastFineTrackRMSE,
            ef->resInA,
            ef->resInL,
            ef->resInM,
            (int)statistics_numForceDroppedResFwd,
            (int)statistics_numForceDroppedResBwd,
-           allKeyFramesHistory.back()->aff_g2l.a,
-           allKeyFramesHistory.back()->aff_g2l.b,
+           lastKeyFrameShell->aff_g2l.a,
+           lastKeyFrameShell->aff_g2l.b,
            frameHessians.back()->shell->id - frameHessians.front()->shell->id,
            (int)frameHessians.size());
 
@@ -1665,7 +1979,7 @@ void FullSystem::printLogLine() {
 
   if(numsLog != 0)
   {
-    (*numsLog) << allKeyFramesHistory.back()->id << " "  <<
+    (*numsLog) << lastKeyFrameShell->id << " "  <<
         statistics_lastFineTrackRMSE << " "  <<
         (int)statistics_numCreatedPoints << " "  <<
         (int)statistics_numActivatedPoints << " "  <<
@@ -1681,11 +1995,40 @@ void FullSystem::printLogLine() {
         frameHessians.back()->aff_g2l().a << " "  <<
         frameHessians.back()->aff_g2l().b << " "  <<
         frameHessians.back()->shell->id - frameHessians.front()->shell->id << " "  <<
-        (int)frameHessians.size() << " "  << "\n";
+        (int)frameHessians.size() << " "  <<
+        statistics_numEvictedImmaturePoints << " "  << "\n";
     numsLog->flush();
   }
 }
 
+void FullSystem::printBudgetLine() {
+  if(!setting_debugout_runquiet)
+    printf("BUDGET %d: %.1fms (smoothed %.1fms, budget %.1fms): trace %.1f, activate %.1f, optimize %.1f, finish %.1f. "
+           "Density x%.2f (%s), MinActDist %.2f\n",
+           lastKeyFrameShell->id,
+           mappingBudget.traceMs + mappingBudget.activateMs + mappingBudget.optimizeMs + mappingBudget.finishMs,
+           mappingBudget.smoothedMs, setting_mappingBudgetMs,
+           mappingBudget.traceMs, mappingBudget.activateMs, mappingBudget.optimizeMs, mappingBudget.finishMs,
+           mappingBudget.densityScale,
+           mappingBudget.decision < 0 ? "down" : (mappingBudget.decision > 0 ? "up" : "hold"),
+           currentMinActDist);
+
+  if(!setting_logStuff || budgetLog == 0) return;
+
+  (*budgetLog) << lastKeyFrameShell->id << " " <<
+      mappingBudget.traceMs << " " <<
+      mappingBudget.activateMs << " " <<
+      mappingBudget.optimizeMs << " " <<
+      mappingBudget.finishMs << " " <<
+      mappingBudget.smoothedMs << " " <<
+      setting_mappingBudgetMs << " " <<
+      mappingBudget.decision << " " <<
+      mappingBudget.densityScale << " " <<
+      currentMinActDist << " " <<
+      ef->nPoints << "\n";
+  budgetLog->flush();
+}
+
 void FullSystem::printEigenValLine() {
   if(!setting_logStuff) return;
   if(ef->lastHS.rows() < 12) return;
@@ -1728,38 +2071,38 @@ void FullSystem::printEigenValLine() {
   if(eigenAllLog != 0)
   {
     VecX ea = VecX::Zero(nz); ea.head(eigenvaluesAll.size()) = eigenvaluesAll;
-    (*eigenAllLog) << allKeyFramesHistory.back()->id << " " <<  ea.transpose() << "\n";
+    (*eigenAllLog) << lastKeyFrameShell->id << " " <<  ea.transpose() << "\n";
     eigenAllLog->flush();
   }
   if(eigenALog != 0)
   {
     VecX ea = VecX::Zero(nz); ea.head(eigenA.size()) = eigenA;
-    (*eigenALog) << allKeyFramesHistory.back()->id << " " <<  ea.transpose() << "\n";
+    (*eigenALog) << lastKeyFrameShell->id << " " <<  ea.transpose() << "\n";
     eigenALog->flush();
   }
   if(eigenPLog != 0)
   {
     VecX ea = VecX::Zero(nz); ea.head(eigenP.size()) = eigenP;
-    (*eigenPLog) << allKeyFramesHistory.back()->id << " " <<  ea.transpose() << "\n";
+    (*eigenPLog) << lastKeyFrameShell->id << " " <<  ea.transpose() << "\n";
     eigenPLog->flush();
   }
 
   if(DiagonalLog != 0)
   {
     VecX ea = VecX::Zero(nz); ea.head(diagonal.size()) = diagonal;
-    (*DiagonalLog) << allKeyFramesHistory.back()->id << " " <<  ea.transpose() << "\n";
+    (*DiagonalLog) << lastKeyFrameShell->id << " " <<  ea.transpose() << "\n";
     DiagonalLog->flush();
   }
 
   if(variancesLog != 0)
   {
     VecX ea = VecX::Zero(nz); ea.head(diagonal.size()) = ef->lastHS.inverse().diagonal();
-    (*variancesLog) << allKeyFramesHistory.back()->id << " " <<  ea.transpose() << "\n";
+    (*variancesLog) << lastKeyFrameShell->id << " " <<  ea.transpose() << "\n";
     variancesLog->flush();
   }
 
   std::vector<VecX> &nsp = ef->lastNullspaces_forLogging;
-  (*nullspacesLog) << allKeyFramesHistory.back()->id << " ";
+  (*nullspacesLog) << lastKeyFrameShell->id << " ";
   for(unsigned int i=0;i<nsp.size();i++)
     (*nullspacesLog) << nsp[i].dot(ef->lastHS * nsp[i]) << " " << nsp[i].dot(ef->lastbS) << " " ;
   (*nullspacesLog) << "\n";
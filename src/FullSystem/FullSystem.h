@@ -34,12 +34,16 @@
 #include "util/NumType.h"
 #include "FullSystem/Residuals.h"
 #include "FullSystem/HessianBlocks.h"
+#include "FullSystem/ResidualTable.h"
+#include "FullSystem/MappingBudget.h"
 #include "util/FrameShell.h"
+#include "util/WindowSnapshot.h"
 #include "util/IndexThreadReduce.h"
 #include "OptimizationBackend/EnergyFunctional.h"
 #include "FullSystem/PixelSelector2.h"
 
 #include <math.h>
+#include <deque>
 
 namespace dso {
 
@@ -57,6 +61,7 @@ struct ImmaturePointTemporaryResidual;
 class ImageAndExposure;
 class CoarseDistanceMap;
 class EnergyFunctional;
+class TrajectoryWriter;
 
 /// Delete the i-th element
 template<typename T> inline void deleteOut(std::vector<T*> &v, const int i) {
@@ -129,6 +134,14 @@ inline bool eigenTestNan(MatXX m, std::string msg) {
   return foundNan;
 }
 
+/// Result of one window optimization, as reported by the backends.
+struct WindowOptStats {
+  int iterations;
+  double energy;
+  double rmse;
+  double wallTimeMs;
+};
+
 class FullSystem {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
@@ -143,12 +156,21 @@ class FullSystem {
   void blockUntilMappingIsFinished();
 
   float optimize(int mnumOptIts);
+  float optimizeAB(int mnumOptIts);
 
   //compute stereo idepth
   void stereoMatch(ImageAndExposure* image, ImageAndExposure* image_right, int id, cv::Mat &idepthMap);
 
   void printResult(std::string file);
 
+  /// stream poses to file while running, in frame order, as soon as they are final. Keeps the frame history bounded.
+  /// format: TRAJECTORY_KITTI or TRAJECTORY_TUM. Call before the first frame.
+  void streamTrajectory(std::string file, int format);
+
+  /// latest published window (poses, affine parameters, active points), 0 before initialization.
+  /// Never blocks on the mapper; the snapshot stays valid as long as the pointer is held.
+  inline WindowSnapshotPtr getWindowSnapshot() const { return boost::atomic_load(&windowSnapshot); }
+
   void debugPlot(std::string name);
 
   void printFrameLifetimes();
@@ -183,6 +205,7 @@ class FullSystem {
   void activatePointsMT();
   void activatePointsOldFirst();
   void flagPointsForRemoval();
+  void evictImmaturePoints();
   void makeNewTraces(FrameHessian* newFrame, FrameHessian* newFrameRight, float* gtDepth);
   void initializeFromInitializer(FrameHessian* newFrame);
   void initializeFromInitializer(FrameHessian* newFrame, FrameHessian* newFrame_right);
@@ -190,9 +213,18 @@ class FullSystem {
 
   void removeOutliers();
 
+  /// removes r from its point and from the energy function, O(1).
+  void removeResidual(PointHessian* ph, PointFrameResidual* r);
+
   // set precalc values.
   void setPrecalcValues();
 
+  // window optimization backends: solve, then fix the linearization point and remove bad residuals.
+  void solveWindowG2O(int mnumOptIts, WindowOptStats* stats);
+  float finishWindowG2O(const WindowOptStats &stats);
+  void solveWindowDSO(int mnumOptIts, WindowOptStats* stats);
+  float finishWindowDSO();
+
   // solce. eventually migrate to ef.
   void solveSystem(int iteration, double lambda);
   Vec3 linearizeAll(bool fixLinearization);
@@ -215,9 +247,14 @@ class FullSystem {
       std::vector<VecX> &nullspaces_affA,
       std::vector<VecX> &nullspaces_affB);
 
+  /// refreshes ef->lastNullspaces_* only if a frame was added / marginalized or got a new linearization point.
+  void updateNullspaces();
+  std::vector<std::pair<int,int>> nullspaceKey;   /// (frameID, nullspaceVersion) of the window the nullspaces were built for.
+
   void setNewFrameEnergyTH();
 
   void printLogLine();
+  void printBudgetLine();
   void printEvalLine();
   void printEigenValLine();
   std::ofstream* calibLog;
@@ -231,6 +268,7 @@ class FullSystem {
   std::ofstream* nullspacesLog;
 
   std::ofstream* coarseTrackingLog;
+  std::ofstream* budgetLog;
 
   // statistics
   long int statistics_lastNumOptIts;
@@ -241,6 +279,7 @@ class FullSystem {
   long int statistics_numForceDroppedResFwd;
   long int statistics_numMargResFwd;
   long int statistics_numMargResBwd;
+  long int statistics_numEvictedImmaturePoints;
   float statistics_lastFineTrackRMSE;
 
 
@@ -248,17 +287,31 @@ class FullSystem {
   /// tracking thread lock
   boost::mutex trackMutex;
 
-  /// All historical frames
-  std::vector<FrameShell*> allFrameHistory;
+  /// Recent frames. Without a trajectory writer this is the whole history (printResult needs it),
+  /// with one, written shells are dropped so only about setting_shellHistory are kept.
+  std::deque<FrameShell*> allFrameHistory;
+  /// number of frames ever added, the id of the next shell.
+  int numFramesTotal;
+  /// frames whose pose was already given to trajectoryWriter.
+  int numShellsWritten;
+  TrajectoryWriter* trajectoryWriter;
   CoarseInitializer* coarseInitializer;
 
   /// The average chi2 last tracked
   Vec5 lastCoarseRMSE;
+  /// flow indicators of the last tracked frame, for the adaptive start level.
+  Vec3 lastCoarseFlow;
 
   // ================== changed by mapper-thread. protected by mapMutex ===============
   /// mapping thread lock
   boost::mutex mapMutex;
-  std::vector<FrameShell*> allKeyFramesHistory;
+  /// written by publishWindowSnapshot only, read via getWindowSnapshot.
+  WindowSnapshotPtr windowSnapshot;
+  long windowSnapshotVersion;
+
+  /// number of keyframes ever made, and the newest one.
+  int numKeyFramesTotal;
+  FrameShell* lastKeyFrameShell;
 
   /// Energy equation
   EnergyFunctional* ef;
@@ -273,12 +326,17 @@ class FullSystem {
   /// Keyframe
   std::vector<FrameHessian*> frameHessians;	         // ONLY changed in marginalizeFrame and addFrame.
 
-  /// Residuals of newly added activation points
-  std::vector<PointFrameResidual*> activeResiduals;
+  /// Residuals of newly added activation points, grouped by (host,target) pair
+  ResidualTable activeResiduals;
 
   /// Threshold of activation point
   float currentMinActDist;
 
+  /// scales the point densities to the mapping time budget. Mapping thread only.
+  MappingBudget mappingBudget;
+  float nonKeyTraceMs;    /// tracing of non-keyframes since the last keyframe.
+  float lastFinishMs;     /// duration of the last finishKeyFrame.
+
   std::vector<FrameHessian*> frameHessiansRight;
 
   /// All residual values on the current nearest frame
@@ -288,6 +346,7 @@ class FullSystem {
   boost::mutex coarseTrackerSwapMutex;			// if tracker sees that there is a new reference, tracker locks [coarseTrackerSwapMutex] and swaps the two.
   CoarseTracker* coarseTracker_forNewKF;		// set as as reference. protected by [coarseTrackerSwapMutex].
   CoarseTracker* coarseTracker;				// always used to track new frames. protected by [trackMutex].
+  CoarseTracker* coarseTracker_building;		// the next reference is built here by the mapper, then swapped into [coarseTracker_forNewKF].
   float minIdJetVisTracker, maxIdJetVisTracker;
   float minIdJetVisDebug, maxIdJetVisDebug;
 
@@ -298,10 +357,21 @@ class FullSystem {
    * tracking always uses the newest KF as reference.
    */
   void makeKeyFrame( FrameHessian* fh, FrameHessian* fh_right);
+  /// second half of makeKeyFrame, after the new tracking reference is published: point removal & marginalization,
+  /// new immature points, output, frame marginalization. Runs on keyframeFinishThread with setting_pipelineKeyFrames.
+  void finishKeyFrame( FrameHessian* fh, FrameHessian* fh_right);
+  /// blocks until the last finishKeyFrame is done. Called before anything reads or changes the window again.
+  void waitForKeyFrameFinish();
+  /// copy the window into a new WindowSnapshot, swap it in and hand it to the output wrappers. Needs [mapMutex].
+  void publishWindowSnapshot();
   void makeNonKeyFrame( FrameHessian* fh, FrameHessian* fh_right);
   void deliverTrackedFrame(FrameHessian* fh, FrameHessian* fh_right, bool needKF);
   void mappingLoop();
 
+  /// hand the poses that became final to trajectoryWriter, in id order, and drop written shells
+  /// nobody references anymore. flushAll: write the rest too (shutdown). Needs [trackMutex].
+  void writeFinishedPoses(bool flushAll);
+
   // tracking / mapping synchronization. All protected by [trackMapSyncMutex].
   boost::mutex trackMapSyncMutex;
   boost::condition_variable trackedFrameSignal;
@@ -312,6 +382,7 @@ class FullSystem {
   int needNewKFAfter;	// Otherwise, a new KF is *needed that has ID bigger than [needNewKFAfter]*.
 
   boost::thread mappingThread;
+  boost::thread keyframeFinishThread;
   bool runMapping;
   bool needToKetchupMapping;
 
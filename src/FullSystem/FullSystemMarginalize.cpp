@@ -147,9 +147,8 @@ void FullSystem::marginalizeFrame(FrameHessian* frame) {
   // marginalize or remove all this frames points.
   assert((int)frame->pointHessians.size()==0);
 
-  ef->marginalizeFrame(frame->efFrame);
-
   // drop all observations of existing points in that frame.
+  /// done before ef->marginalizeFrame, which deletes the EFFrame the dropped residuals still point to.
   /// delete the residuals of other frames on the marginalized frames
   for(FrameHessian* fh : frameHessians) {
     if(fh==frame) continue;
@@ -169,14 +168,15 @@ void FullSystem::marginalizeFrame(FrameHessian* frame) {
           else
             statistics_numForceDroppedResBwd++;
 
-          ef->dropResidual(r->efResidual);
-          deleteOut<PointFrameResidual>(ph->residuals,i);
+          removeResidual(ph, r);
           break;
         }
       }
     }
   }
 
+  ef->marginalizeFrame(frame->efFrame);
+
   {
     std::vector<FrameHessian*> v;
     v.push_back(frame);
@@ -186,6 +186,11 @@ void FullSystem::marginalizeFrame(FrameHessian* frame) {
 
   frame->shell->marginalizedAt = frameHessians.back()->shell->id;
   frame->shell->movedByOpt = frame->w2c_leftEps().norm();
+  {
+    // leaves the window, its pose is not optimized anymore.
+    boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+    frame->shell->poseFinal = true;
+  }
 
   //// Delete marginalized keyframe.
   deleteOutOrder<FrameHessian>(frameHessians, frame);
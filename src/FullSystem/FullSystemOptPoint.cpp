@@ -31,6 +31,7 @@
 
 #include "dso_g2o_vertex.h"
 #include "dso_g2o_edge.h"
+#include "dso_g2o_solver.hpp"
 
 #include "FullSystem/FullSystem.h"
  
@@ -52,8 +53,7 @@ namespace dso {
 PointHessian* FullSystem::optimizeImmaturePoint(ImmaturePoint* point, int minObs,
                                                 ImmaturePointTemporaryResidual* residuals)
 {
-  auto linear_solver = g2o::make_unique<g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>>();
-  auto block_solver = g2o::make_unique<g2o::BlockSolverX>(std::move(linear_solver));
+  auto block_solver = util::MakeBlockSolverX(1);
 
   // auto algorithm = new g2o::OptimizationAlgorithmGaussNewton(std::move(block_solver));
   auto algorithm = new g2o::OptimizationAlgorithmLevenberg(std::move(block_solver));
@@ -27,6 +27,7 @@
 #include "dso_g2o_vertex.h"
 #include "dso_g2o_edge.h"
 #include "dso_util.hpp"
+#include "dso_g2o_solver.hpp"
  
 #include "stdio.h"
 #include "util/globalFuncs.h"
@@ -42,45 +43,45 @@
 #include "OptimizationBackend/EnergyFunctionalStructs.h"
 
 #include <cmath>
+#include <chrono>
 
 #include <algorithm>
 
 namespace dso {
 
+/// how many residuals ahead the linearization loops prefetch.
+#define RES_PREFETCH_DIST 8
+
 /// linearize the residuals
 /// Parameter: [true is applyRes, and remove bad residuals] [false does not perform fixed linearization]
 void FullSystem::linearizeAll_Reductor(bool fixLinearization,
                                        std::vector<PointFrameResidual*>* toRemove,
                                        int min, int max,
                                        Vec10* stats, int tid) {
+  const std::vector<PointFrameResidual*> &res = activeResiduals.res;
   for(int k=min; k<max; k++) {
-    PointFrameResidual* r = activeResiduals[k];
+    /// the table is walked linearly, fetch the residuals (and their point / jacobian) a few entries ahead.
+    if(k+RES_PREFETCH_DIST < max) __builtin_prefetch(res[k+RES_PREFETCH_DIST]);
+    if(k+RES_PREFETCH_DIST/2 < max) {
+      __builtin_prefetch(res[k+RES_PREFETCH_DIST/2]->point);
+      __builtin_prefetch(res[k+RES_PREFETCH_DIST/2]->J);
+    }
+
+    PointFrameResidual* r = res[k];
     (*stats)[0] += r->linearize(&Hcalib); /// linearize to get energy
+    if(r->linReused) (*stats)[1]++;
 
     /// fixed linearization (executed after optimization)
     if(fixLinearization) {
       /// give the value to efResidual.
       r->applyRes(true);
 
-      /// ths residual is in.
-      if(r->efResidual->isActive()) {
-        if(r->isNew) {
-          PointHessian* p = r->point;
-          Vec3f ptp_inf = r->host->targetPrecalc[r->target->idx].PRE_KRKiTll*Vec3f(p->u,p->v, 1);	// projected point assuming infinite depth.
-          Vec3f ptp = ptp_inf + r->host->targetPrecalc[r->target->idx].PRE_KtTll*p->idepth_scaled;	// projected point with real depth.
-          float relBS = 0.01*((ptp_inf.head<2>()/ptp_inf[2]) - (ptp.head<2>()/ptp[2])).norm();	        // 0.01 = one pixel.
-
-          if(relBS > p->maxRelBaseline) {
-            p->maxRelBaseline = relBS;   /// proportional to the baseline length of the point
-          }
-
-          p->numGoodResiduals++;
-        }
-      }
-      else {
+      /// the per-point statistics of active residuals are updated serially in linearizeAll:
+      /// the table is sorted by pair, the residuals of one point end up in different chunks.
+      if(!r->efResidual->isActive()) {
         /// delete OOB, outlier
         /// remove residulas too large to remove.
-        toRemove[tid].push_back(activeResiduals[k]);
+        toRemove[tid].push_back(r);
       }
     }
   }
@@ -89,8 +90,10 @@ void FullSystem::linearizeAll_Reductor(bool fixLinearization,
 /// pass the linearization result to the energy function EFResidual
 /// copyJacobians [true: update jacobian] [false: not update]
 void FullSystem::applyRes_Reductor(bool copyJacobians, int min, int max, Vec10* stats, int tid) {
+  const std::vector<PointFrameResidual*> &res = activeResiduals.res;
   for(int k=min; k < max; k++) {
-    activeResiduals[k]->applyRes(true);
+    if(k+RES_PREFETCH_DIST < max) __builtin_prefetch(res[k+RES_PREFETCH_DIST]);
+    res[k]->applyRes(true);
   }
 }
 
@@ -98,14 +101,17 @@ void FullSystem::applyRes_Reductor(bool copyJacobians, int min, int max, Vec10*
 void FullSystem::setNewFrameEnergyTH() {
   // collect all residuals and make decision on TH.
   allResVec.clear();
-  allResVec.reserve(activeResiduals.size()*2);
   FrameHessian* newFrame = frameHessians.back();
 
-  for(PointFrameResidual* r : activeResiduals)
-    /// residual on new frame.
-    if(r->state_NewEnergyWithOutlier >= 0 && r->target == newFrame) {
-      allResVec.push_back(r->state_NewEnergyWithOutlier);
-    }
+  /// residual on new frame: only the (host, newFrame) pairs of the table.
+  if(activeResiduals.nFrames == (int)frameHessians.size()) {
+    for(int h=0;h<activeResiduals.nFrames;h++)
+      for(int k=activeResiduals.pairStart(h, newFrame->idx); k<activeResiduals.pairEnd(h, newFrame->idx); k++) {
+        PointFrameResidual* r = activeResiduals[k];
+        if(r->state_NewEnergyWithOutlier >= 0)
+          allResVec.push_back(r->state_NewEnergyWithOutlier);
+      }
+  }
 
   if(allResVec.size()==0) {
     newFrame->frameEnergyTH = 12*12*patternNum;
@@ -143,6 +149,7 @@ Vec3 FullSystem::linearizeAll(bool fixLinearization) {
   double lastEnergyP = 0;
   double lastEnergyR = 0;
   double num = 0;
+  double numReused = 0;
 
   std::vector<PointFrameResidual*> toRemove[NUM_THREADS];
   for(int i=0;i<NUM_THREADS;i++) {
@@ -153,19 +160,41 @@ Vec3 FullSystem::linearizeAll(bool fixLinearization) {
     /// TODO see the multi-threaded IndexThreadReduce
     treadReduce.reduce(boost::bind(&FullSystem::linearizeAll_Reductor, this, fixLinearization, toRemove, _1, _2, _3, _4), 0, activeResiduals.size(), 0);
     lastEnergyP = treadReduce.stats[0];
+    numReused = treadReduce.stats[1];
   }
   else {
-    Vec10 stats;
+    Vec10 stats = Vec10::Zero();
     linearizeAll_Reductor(fixLinearization, toRemove, 0, activeResiduals.size(), &stats, 0);
     lastEnergyP = stats[0];
+    numReused = stats[1];
   }
 
+  if(!setting_debugout_runquiet)
+    printf("LINEARIZE: reused %d / %d residuals (%.1f%%)\n", (int)numReused, (int)activeResiduals.size(),
+           activeResiduals.size() > 0 ? 100.0*numReused/activeResiduals.size() : 0.0);
+
   setNewFrameEnergyTH();
 
   if(fixLinearization) {
     /// linearized before, state_state is update after apply, if there is the same, the state is updated.
-    for(PointFrameResidual* r : activeResiduals) {
+    for(int k=0; k<activeResiduals.size(); k++) {
+      PointFrameResidual* r = activeResiduals[k];
       PointHessian* ph = r->point;
+
+      /// ths residual is in.
+      if(r->efResidual->isActive() && r->isNew) {
+        const FrameFramePrecalc &precalc = frameHessians[activeResiduals.hostIdx[k]]->targetPrecalc[activeResiduals.targetIdx[k]];
+        Vec3f ptp_inf = precalc.PRE_KRKiTll*Vec3f(ph->u,ph->v, 1);	// projected point assuming infinite depth.
+        Vec3f ptp = ptp_inf + precalc.PRE_KtTll*ph->idepth_scaled;	// projected point with real depth.
+        float relBS = 0.01*((ptp_inf.head<2>()/ptp_inf[2]) - (ptp.head<2>()/ptp[2])).norm();	        // 0.01 = one pixel.
+
+        if(relBS > ph->maxRelBaseline) {
+          ph->maxRelBaseline = relBS;   /// proportional to the baseline length of the point
+        }
+
+        ph->numGoodResiduals++;
+      }
+
       if(ph->lastResiduals[0].first == r)
         ph->lastResiduals[0].second = r->state_state;
       else if(ph->lastResiduals[1].first == r)
@@ -186,13 +215,8 @@ Vec3 FullSystem::linearizeAll(bool fixLinearization) {
         else if(ph->lastResiduals[1].first == r)
           ph->lastResiduals[1].first=0;
 
-        for(unsigned int k=0; k<ph->residuals.size();k++)
-          if(ph->residuals[k] == r) {
-            ef->dropResidual(r->efResidual);
-            deleteOut<PointFrameResidual>(ph->residuals,k);
-            nResRemoved++;
-            break;
-          }
+        removeResidual(ph, r);
+        nResRemoved++;
       }
     }
     //printf("FINAL LINEARIZATION: removed %d / %d residuals!\n", nResRemoved, (int)activeResiduals.size());
@@ -399,14 +423,151 @@ void FullSystem::printOptRes(Vec3 res,
          );
 }
 
-#if 1
 /// perfrom GN optimization on the current keyframe.
+/// setting_windowBackend chooses g2o (0) or the DSO Gauss-Newton (1).
 float FullSystem::optimize(int mnumOptIts) {
-  //// customizing
   if(frameHessians.size() < 2) {
     return 0;
   }
-  else if(frameHessians.size() < 3) {
+
+  if(setting_windowBackendAB) {
+    return optimizeAB(mnumOptIts);
+  }
+
+  WindowOptStats stats;
+  if(setting_windowBackend == 1) {
+    solveWindowDSO(mnumOptIts, &stats);
+    return finishWindowDSO();
+  }
+
+  solveWindowG2O(mnumOptIts, &stats);
+  return finishWindowG2O(stats);
+}
+
+/// residual state a window optimization changes, see optimizeAB.
+struct ResidualABBackup {
+  RawResidualJacobian J;    /// content of efResidual->J
+  Vec8f JpJdF;
+  Vec3f centerProjectedTo;
+  double energy, newEnergy, newEnergyWithOutlier;
+  ResState state, newState;
+  bool isActiveAndIsGoodNEW;
+};
+
+/// A/B harness: run the same window through both backends from the same state, print wall time, iterations,
+/// final energy and the pose difference of every frame, then continue with the result of setting_windowBackend.
+/// Restored for the second run: calib, frame states, idepths (and their hessians), the residual states / energies,
+/// the jacobians held by the EFResiduals and the points' lastResiduals. The lazy relinearization cache is dropped
+/// before both runs, so both start with a full linearization. Not isolated: run 2 finds warm CPU caches and allocator
+/// pools, and only the selected backend's finish step (outlier removal, fixing the linearization) runs, after run 2.
+float FullSystem::optimizeAB(int mnumOptIts) {
+  bool dsoFirst = setting_windowBackend != 1;
+
+  /// snapshot of the window.
+  VecC calibBackup = Hcalib.value;
+  std::vector<Vec10> stateBackup;
+  std::vector<float> idepthBackup, idepthZeroBackup, hdiBackup;
+  std::vector<std::pair<PointFrameResidual*, ResState>> lastResidualsBackup;
+  std::vector<ResidualABBackup, Eigen::aligned_allocator<ResidualABBackup>> residualBackup;
+  for(FrameHessian* fh : frameHessians) {
+    stateBackup.push_back(fh->get_state());
+    for(PointHessian* ph : fh->pointHessians) {
+      idepthBackup.push_back(ph->idepth);
+      idepthZeroBackup.push_back(ph->idepth_zero);
+      hdiBackup.push_back(ph->efPoint->HdiF);
+      lastResidualsBackup.push_back(ph->lastResiduals[0]);
+      lastResidualsBackup.push_back(ph->lastResiduals[1]);
+      for(PointFrameResidual* r : ph->residuals) {
+        residualBackup.push_back(ResidualABBackup());
+        ResidualABBackup &b = residualBackup.back();
+        b.J = *(r->efResidual->J);
+        b.JpJdF = r->efResidual->JpJdF;
+        b.centerProjectedTo = r->centerProjectedTo;
+        b.energy = r->state_energy;
+        b.newEnergy = r->state_NewEnergy;
+        b.newEnergyWithOutlier = r->state_NewEnergyWithOutlier;
+        b.state = r->state_state;
+        b.newState = r->state_NewState;
+        b.isActiveAndIsGoodNEW = r->efResidual->isActiveAndIsGoodNEW;
+        r->invalidateLinearization();
+      }
+    }
+  }
+
+  WindowOptStats stats[2];
+  std::vector<SE3> poses[2];
+
+  for(int run=0; run<2; run++) {
+    bool dso = (run==0) == dsoFirst;
+
+    if(run==1) {
+      /// restore the snapshot.
+      Hcalib.setValue(calibBackup);
+      int k=0, kr=0;
+      for(unsigned int i=0; i<frameHessians.size(); i++) {
+        frameHessians[i]->setState(stateBackup[i]);
+        for(PointHessian* ph : frameHessians[i]->pointHessians) {
+          ph->setIdepth(idepthBackup[k]);
+          ph->setIdepthZero(idepthZeroBackup[k]);
+          ph->efPoint->HdiF = hdiBackup[k];
+          ph->lastResiduals[0] = lastResidualsBackup[2*k];
+          ph->lastResiduals[1] = lastResidualsBackup[2*k+1];
+          k++;
+          for(PointFrameResidual* r : ph->residuals) {
+            const ResidualABBackup &b = residualBackup[kr++];
+            *(r->efResidual->J) = b.J;
+            r->efResidual->JpJdF = b.JpJdF;
+            r->efResidual->isActiveAndIsGoodNEW = b.isActiveAndIsGoodNEW;
+            r->centerProjectedTo = b.centerProjectedTo;
+            r->state_energy = b.energy;
+            r->state_NewEnergy = b.newEnergy;
+            r->state_NewEnergyWithOutlier = b.newEnergyWithOutlier;
+            r->state_state = b.state;
+            r->state_NewState = b.newState;
+            r->invalidateLinearization();
+          }
+        }
+      }
+      EFDeltaValid=false;
+      setPrecalcValues();
+    }
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    if(dso) {
+      solveWindowDSO(mnumOptIts, &stats[run]);
+    }
+    else {
+      solveWindowG2O(mnumOptIts, &stats[run]);
+    }
+    stats[run].wallTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    for(FrameHessian* fh : frameHessians) {
+      poses[run].push_back(fh->PRE_camToWorld);
+    }
+  }
+
+  const char* names[2] = {dsoFirst ? "DSO" : "G2O", dsoFirst ? "G2O" : "DSO"};
+  for(int run=0; run<2; run++) {
+    printf("WINDOW A/B %s: %.2fms, %d its, energy %f, rmse %f\n",
+           names[run], stats[run].wallTimeMs, stats[run].iterations, stats[run].energy, stats[run].rmse);
+  }
+  for(unsigned int i=0; i<frameHessians.size(); i++) {
+    SE3 delta = poses[0][i].inverse() * poses[1][i];
+    printf("WINDOW A/B frame %d: dT %f, dR %f deg\n",
+           frameHessians[i]->shell->id, delta.translation().norm(), util::R2D(delta.so3().log().norm()));
+  }
+
+  /// the second run is the selected backend.
+  if(setting_windowBackend == 1) {
+    return finishWindowDSO();
+  }
+  return finishWindowG2O(stats[1]);
+}
+
+/// window optimization with g2o: poses, photometric parameters, camera and (schur-eliminated) idepths.
+void FullSystem::solveWindowG2O(int mnumOptIts, WindowOptStats* stats) {
+  //// customizing
+  if(frameHessians.size() < 3) {
     /// number of iterations.
     mnumOptIts = 10;
   }
@@ -417,8 +578,8 @@ float FullSystem::optimize(int mnumOptIts) {
     mnumOptIts = 3;
   }
 
-  auto linear_solver = g2o::make_unique<g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>>();
-  auto block_solver = g2o::make_unique<g2o::BlockSolverX>(std::move(linear_solver));
+  /// pose + photometric per frame, and the camera. the points are schur-eliminated.
+  auto block_solver = util::MakeBlockSolverX(4 + 8*frameHessians.size());
   block_solver->setSchur(true);
 
   // auto algorithm = new g2o::OptimizationAlgorithmGaussNewton(std::move(block_solver));
@@ -434,23 +595,8 @@ float FullSystem::optimize(int mnumOptIts) {
 
   // get statistics and active residuals.
   /// STEP1: find the residuals that are not linearized (marginalized), add activeResiduals.
-  activeResiduals.clear();
-  int numPoints = 0;
-  int numLRes = 0;
-
-  for(FrameHessian* fh : frameHessians) {
-    for(PointHessian* ph : fh->pointHessians) {
-      for(PointFrameResidual* r : ph->residuals) {
-        if(!r->efResidual->isLinearized) {  /// if no linear error
-          activeResiduals.push_back(r);  /// newly added residuals
-          r->resetOOB();                 /// residual state reset.
-        }
-        else
-          numLRes++;   /// counted by linearization.
-      }
-      numPoints++;
-    }
-  }
+  /// residual state reset, linearized ones are only counted.
+  int numLRes = activeResiduals.build(frameHessians);
 
   int id=0;
   //// add camera intrinsic vertex.
@@ -468,14 +614,25 @@ float FullSystem::optimize(int mnumOptIts) {
   std::map<PointFrameResidual*, VertexPhotometricDSO*> vphoto;
   std::map<PointFrameResidual*, VertexInverseDepthDSO*> videpth;
 
-  std::vector<VertexSE3PoseDSO*> v_vtx_pose;
-  std::vector<VertexPhotometricDSO*> v_vtx_photo;
-  v_vtx_pose.resize(8);
-  v_vtx_photo.resize(8);
+  //// one pose / photometric vertex per window frame, indexed by FrameHessian::idx.
+  const int nFrames = frameHessians.size();
+  std::vector<VertexSE3PoseDSO*> v_vtx_pose(nFrames, (VertexSE3PoseDSO*)0);
+  std::vector<VertexPhotometricDSO*> v_vtx_photo(nFrames, (VertexPhotometricDSO*)0);
+  std::vector<bool> vtxused(nFrames, false);
 
-  bool vtxused[8] = {false};
+  //// values shared by the residuals of one (host,target) pair, [host->idx*nFrames + target->idx].
+  std::vector<EdgeLBAPrecalc, Eigen::aligned_allocator<EdgeLBAPrecalc>> lbaPrecalc(nFrames*nFrames);
+
+  //// evaluate the BA edges on the thread pool, g2o then only copies errors and jacobians.
+  EdgeLBAParallelAction lbaErrorAction(&treadReduce, false);
+  EdgeLBAParallelAction lbaJacobianAction(&treadReduce, true);
 
   for(PointFrameResidual* r : activeResiduals) {
+    if(r->host->idx < 0 || r->host->idx >= nFrames || r->target->idx < 0 || r->target->idx >= nFrames) {
+      printf("g2o window: residual %d -> %d outside the window of %d frames, skipped!\n",
+             r->host->idx, r->target->idx, nFrames);
+      continue;
+    }
     if(vtxused[r->host->idx] == false) {
       vtxused[r->host->idx] = true;
 
@@ -521,11 +678,10 @@ float FullSystem::optimize(int mnumOptIts) {
     edge->setVertex(2, dynamic_cast<g2o::OptimizableGraph::Vertex*>(vtx_idepth));
     edge->setVertex(3, dynamic_cast<g2o::OptimizableGraph::Vertex*>(vtx_cam));
 
-    Vec8f colors;
-    colors << *(color), *(color+1), *(color+2), *(color+3), *(color+4), *(color+5), *(color+6), *(color+7);
+    VecNRf colors = Eigen::Map<const VecNRf>(color);
 
     edge->setMeasurement(colors);
-    edge->setInformation(Eigen::Matrix<double,8,8>::Identity());
+    edge->setInformation(Eigen::Matrix<double,patternNum,patternNum>::Identity());
     g2o::RobustKernelHuber* huber = new g2o::RobustKernelHuber;
     huber->setDelta(setting_huberTH);
     edge->setRobustKernel(huber);
@@ -535,12 +691,40 @@ float FullSystem::optimize(int mnumOptIts) {
     AffLight a0b0 = v_vtx_photo[r->host->idx]->estimate();
     edge->SetB(a0b0.b);
 
+    EdgeLBAPrecalc &precalc = lbaPrecalc[r->host->idx*nFrames + r->target->idx];
+    if(precalc.host == 0)
+      precalc.set(r->host, r->target, v_vtx_pose[r->host->idx], v_vtx_photo[r->host->idx], vtx_cam);
+    edge->SetPrecalc(&precalc);
+    lbaErrorAction.edges.push_back(edge);
+    lbaJacobianAction.edges.push_back(edge);
+
     //// project point from host frame to target frame.
     edge->computeError();
 
     optimizer->addEdge(edge);
   }
 
+  for(EdgeLBAPrecalc &precalc : lbaPrecalc) {
+    if(precalc.host != 0) {
+      lbaErrorAction.precalc.push_back(&precalc);
+      lbaJacobianAction.precalc.push_back(&precalc);
+    }
+  }
+  optimizer->addComputeErrorAction(&lbaErrorAction);
+  optimizer->addPreIterationAction(&lbaJacobianAction);
+
+  //// marginalization prior (HM, bM) on the camera and the pose / photometric vertices.
+  if(setting_g2oMargPrior && ef->HM().rows() == CPARS + 8*(int)frameHessians.size() && !ef->HM().isZero()) {
+    EdgeMargPriorDSO* prior = new EdgeMargPriorDSO(ef->HM(), ef->bM(), &Hcalib, frameHessians);
+    if(prior->SetVertices(vtx_cam, v_vtx_pose, v_vtx_photo)) {
+      prior->setId(id++);
+      optimizer->addEdge(prior);
+    }
+    else {
+      delete prior;
+    }
+  }
+
   std::cout << "activeResiduals size: " << activeResiduals.size() << std::endl;
   std::cout << "vertex size: " << optimizer->vertices().size() << std::endl;
   std::cout << "edge size: " << optimizer->edges().size() << std::endl;
@@ -587,7 +771,9 @@ float FullSystem::optimize(int mnumOptIts) {
   optimizer->initializeOptimization();
   optimizer->setVerbose(true);
   std::cout << "[*] window optimizing " << mnumOptIts << " times..." << std::endl;
-  optimizer->optimize(mnumOptIts);
+  stats->iterations = optimizer->optimize(mnumOptIts);
+  stats->energy = optimizer->activeRobustChi2();
+  stats->rmse = sqrtf(stats->energy / (patternNum * optimizer->edges().size()));
 
 #if 0
   for(int iteration=0; iteration < mnumOptIts; iteration++) {
@@ -681,42 +867,29 @@ float FullSystem::optimize(int mnumOptIts) {
   //// update estimates after optimization.
   Vec4 update = vtx_cam->estimate();
 
-  // [0-3: Kl, 4-7: Kr, 8-12: l2r]
-  Hcalib.value = update;
-  Hcalib.value_scaled[0] = 1 * Hcalib.value[0];
-  Hcalib.value_scaled[1] = 1 * Hcalib.value[1];
-  Hcalib.value_scaled[2] = 1 * Hcalib.value[2];
-  Hcalib.value_scaled[3] = 1 * Hcalib.value[3];
-
-  Hcalib.value_scaledf = Hcalib.value_scaled.cast<float>();
-  Hcalib.value_scaledi[0] = 1.0f / Hcalib.value_scaledf[0];
-  Hcalib.value_scaledi[1] = 1.0f / Hcalib.value_scaledf[1];
-  Hcalib.value_scaledi[2] = - Hcalib.value_scaledf[2] / Hcalib.value_scaledf[0];
-  Hcalib.value_scaledi[3] = - Hcalib.value_scaledf[3] / Hcalib.value_scaledf[1];
-  Hcalib.value_minus_value_zero = Hcalib.value - Hcalib.value_zero;
+  //// the vertex holds [fxl, fyl, cxl, cyl], value stays in the units of HM (value_zero).
+  Hcalib.setValueScaled(update);
 #endif
 
-  bool vtxused2[8] = {false};
+  std::vector<bool> vtxused2(nFrames, false);
+  /// only frame states and points change here, which the tracker never reads; the shells follow in STEP6.
   for(PointFrameResidual* r : activeResiduals) {
-    boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
-
+    if(videpth.count(r) == 0) continue;  /// skipped above, outside the window.
     if(vtxused2[r->host->idx] == false) {
       vtxused2[r->host->idx] = true;
 
       VertexSE3PoseDSO* vtx_pose = vpose[r];
       VertexPhotometricDSO* vtx_photo = vphoto[r];
 
-      //// Twh
-      r->host->PRE_camToWorld = vtx_pose->estimate();
       std::cout << "after\n" << vtx_pose->estimate().matrix() << std::endl;
-      //// Thw
-      r->host->PRE_worldToCam = r->host->PRE_camToWorld.inverse();
-
-      r->host->state[6] = vtx_photo->estimate().a;
-      r->host->state[7] = vtx_photo->estimate().b;
-      //// custom scaling
-      r->host->state_scaled[6] = 1 * r->host->state[6];
-      r->host->state_scaled[7] = 1 * r->host->state[7];
+
+      //// keep the linearization point, express the estimate as state w.r.t. it.
+      //// Thw = exp(state_scaled[0-5]) * Thw_evalPT
+      Vec10 state_scaled = r->host->get_state_scaled();
+      state_scaled.head<6>() = (vtx_pose->estimate().inverse() * r->host->get_worldToCam_evalPT().inverse()).log();
+      state_scaled[6] = vtx_photo->estimate().a;
+      state_scaled[7] = vtx_photo->estimate().b;
+      r->host->setStateScaled(state_scaled);
     }
 
     VertexInverseDepthDSO* vtx_idepth = videpth[r];
@@ -731,8 +904,10 @@ float FullSystem::optimize(int mnumOptIts) {
     treadReduce.reduce(boost::bind(&FullSystem::applyRes_Reductor, this, true, _1, _2, _3, _4), 0, activeResiduals.size(), 50);
   else
     applyRes_Reductor(true,0,activeResiduals.size(),0,0);
+}
 
-
+/// fix the linearization point after solveWindowG2O and remove bad residuals.
+float FullSystem::finishWindowG2O(const WindowOptStats &stats) {
   /// STEP5: set the pose of the latest frame to the linearization point.
   /// the pose of the latest frame is set to the linearization point (x=0),
   /// 0-5 is the pose increment and therefore 0
@@ -809,13 +984,8 @@ float FullSystem::optimize(int mnumOptIts) {
       else if(ph->lastResiduals[1].first == r)
         ph->lastResiduals[1].first=0;
 
-      for(unsigned int k=0; k<ph->residuals.size();k++)
-        if(ph->residuals[k] == r) {
-          ef->dropResidual(r->efResidual);
-          deleteOut<PointFrameResidual>(ph->residuals,k);
-          nResRemoved++;
-          break;
-        }
+      removeResidual(ph, r);
+      nResRemoved++;
     }
   }
 
@@ -864,37 +1034,18 @@ float FullSystem::optimize(int mnumOptIts) {
 
   /// return average error rmse.
   // return sqrtf((float)(lastEnergy[0] / (patternNum*ef->resInA)));
-  return sqrtf(optimizer->activeRobustChi2() / (patternNum * optimizer->edges().size()));
+  return stats.rmse;
 }
 
-#else
-float FullSystem::optimize(int mnumOptIts)
+/// window optimization with the original DSO Gauss-Newton on the EnergyFunctional (SSE accumulators).
+void FullSystem::solveWindowDSO(int mnumOptIts, WindowOptStats* stats)
 {
-
-  if(frameHessians.size() < 2) return 0;
   if(frameHessians.size() < 3) mnumOptIts = 20;
   if(frameHessians.size() < 4) mnumOptIts = 15;
 
   // get statistics and active residuals.
 
-  activeResiduals.clear();
-  int numPoints = 0;
-  int numLRes = 0;
-  for(FrameHessian* fh : frameHessians)
-    for(PointHessian* ph : fh->pointHessians)
-    {
-      for(PointFrameResidual* r : ph->residuals)
-      {
-        if(!r->efResidual->isLinearized)
-        {
-          activeResiduals.push_back(r);
-          r->resetOOB();
-        }
-        else
-          numLRes++;
-      }
-      numPoints++;
-    }
+  int numLRes = activeResiduals.build(frameHessians);
 
   if(!setting_debugout_runquiet)
     printf("OPTIMIZE %d pts, %d active res, %d lin res!\n",ef->nPoints,(int)activeResiduals.size(), numLRes);
@@ -927,8 +1078,10 @@ float FullSystem::optimize(int mnumOptIts)
   double lambda = 1e-1;
   float stepsize=1;
   VecX previousX = VecX::Constant(CPARS+ 8*frameHessians.size(), NAN);
+  stats->iterations = 0;
   for(int iteration=0;iteration<mnumOptIts;iteration++)
   {
+    stats->iterations = iteration+1;
     // solve!
     backupState(iteration!=0);
     //solveSystemNew(0);
@@ -994,6 +1147,13 @@ float FullSystem::optimize(int mnumOptIts)
     if(canbreak && iteration >= setting_minOptIterations) break;
   }
 
+  stats->energy = lastEnergy[0] + lastEnergy[1] + lastEnergyL + lastEnergyM;
+  stats->rmse = sqrtf((float)(lastEnergy[0] / (patternNum*ef->resInA)));
+}
+
+/// fix the linearization point after solveWindowDSO and remove bad residuals.
+float FullSystem::finishWindowDSO()
+{
   Vec10 newStateZero = Vec10::Zero();
   newStateZero.segment<2>(6) = frameHessians.back()->get_state().segment<2>(6);
 
@@ -1005,7 +1165,7 @@ float FullSystem::optimize(int mnumOptIts)
   setPrecalcValues();
 
   std::cout << "activeResiduals size " << activeResiduals.size() << std::endl;
-  lastEnergy = linearizeAll(true);
+  Vec3 lastEnergy = linearizeAll(true);
 
   if(!std::isfinite((double)lastEnergy[0]) || !std::isfinite((double)lastEnergy[1]) || !std::isfinite((double)lastEnergy[2]))
   {
@@ -1039,16 +1199,29 @@ float FullSystem::optimize(int mnumOptIts)
   return sqrtf((float)(lastEnergy[0] / (patternNum*ef->resInA)));
 
 }
-#endif
+
 
 /// restoring system
 void FullSystem::solveSystem(int iteration, double lambda) {
+  updateNullspaces();
+
+  ef->solveSystemF(iteration, lambda, &Hcalib);
+}
+
+void FullSystem::updateNullspaces() {
+  std::vector<std::pair<int,int>> key;
+  key.reserve(frameHessians.size());
+  for(FrameHessian* fh : frameHessians)
+    key.push_back(std::make_pair(fh->frameID, fh->nullspaceVersion));
+
+  if(key == nullspaceKey && !ef->lastNullspaces_pose.empty()) return;
+
+  nullspaceKey.swap(key);
   ef->lastNullspaces_forLogging = getNullspaces(ef->lastNullspaces_pose,
                                                 ef->lastNullspaces_scale,
                                                 ef->lastNullspaces_affA,
                                                 ef->lastNullspaces_affB);
-
-  ef->solveSystemF(iteration, lambda, &Hcalib);
+  ef->nullspacesChanged();
 }
 
 /// calculate energy E (chi2) which is relative.
@@ -1059,6 +1232,15 @@ double FullSystem::calcLEnergy() {
   return Ef;
 }
 
+/// ph->residuals and ph->efPoint->residualsAll are filled and swap-removed together, so they have the same order
+/// and EFResidual::idxInAll is also the index of r in ph->residuals.
+void FullSystem::removeResidual(PointHessian* ph, PointFrameResidual* r) {
+  const int k = r->efResidual->idxInAll;
+  assert(k >= 0 && k < (int)ph->residuals.size() && ph->residuals[k] == r);
+  ef->dropResidual(r->efResidual);
+  deleteOut<PointFrameResidual>(ph->residuals, k);
+}
+
 /// remove outliers (the number of residuals become 0)
 void FullSystem::removeOutliers() {
   int numPointsDropped=0;
@@ -35,6 +35,8 @@ namespace dso {
 PointHessian::PointHessian(const ImmaturePoint* const rawPoint, CalibHessian* Hcalib) {
   instanceCounter++;
   host = rawPoint->host;  /// main frame.
+  linVersion = 0;
+  idepth_scaled_linRef = NAN;
   hasDepthPrior=false;
 
   idepth_hessian=0;
@@ -120,6 +122,10 @@ void FrameHessian::setStateZero(Vec10 state_zero) {
   nullspaces_affine.topLeftCorner<2,1>()  = Vec2(1,0);
   assert(ab_exposure > 0);
   nullspaces_affine.topRightCorner<2,1>() = Vec2(0, expf(aff_g2l_0().a)*ab_exposure);
+  nullspaceVersion++;
+
+  /// the FEJ jacobians of the residuals depend on the linearization point.
+  touchLinVersion(true);
 };
 
 void FrameHessian::release() {
@@ -139,11 +145,50 @@ void FrameHessian::release() {
 
 /// calculate the pixel value and gradient of the pyramid image of each level.
 void FrameHessian::makeImages(float* color, CalibHessian* HCalib) {
+  makeTrackingImages(color);
+  makeGradMaps(HCalib);
+}
+
+void FrameHessian::makeTrackingImages(float* color) {
+  makePyramid(color, true);
+}
+
+void FrameHessian::makeStereoImages(float* color) {
+  makePyramid(color, false);
+}
+
+/// squared gradient of each level, weighted with the response function if setting_gammaWeightsPixelSelect.
+void FrameHessian::makeGradMaps(CalibHessian* HCalib) {
+  if(hasGradMaps()) return;
+  assert(dIp[0] != 0 && coarseGradients);
+
+  for(int lvl=0; lvl<pyrLevelsUsed; lvl++) {
+    int wl = wG[lvl], hl = hG[lvl];
+    const Eigen::Vector3f* dI_l = dIp[lvl];
+    float* dabs_l = absSquaredGrad[lvl] = new float[wl*hl];
+
+    for(int idx=wl;idx < wl*(hl-1);idx++) {
+      float dx = dI_l[idx][1];
+      float dy = dI_l[idx][2];
 
-  /// create image values for each level, and storage space for image gradients.
+      /// sqaured gradient.
+      dabs_l[idx] = dx*dx + dy*dy;
+
+      if(setting_gammaWeightsPixelSelect==1 && HCalib!=0) {
+        /// multiply by the response function, and change back to normal color, because I = G^-1(I) / V(x) when photometric correction.
+        float gw = HCalib->getBGradOnly((float)(dI_l[idx][0]));
+        dabs_l[idx] *= gw*gw;	// convert to gradient of original color space (before removing response).
+      }
+    }
+  }
+}
+
+void FrameHessian::makePyramid(float* color, bool withCoarseGradients) {
+  coarseGradients = withCoarseGradients;
+
+  /// create image values for each level.
   for(int i=0;i<pyrLevelsUsed;i++) {
     dIp[i] = new Eigen::Vector3f[wG[i]*hG[i]];
-    absSquaredGrad[i] = new float[wG[i]*hG[i]];
   }
 
   /// turns out they point to the same place.
@@ -161,7 +206,6 @@ void FrameHessian::makeImages(float* color, CalibHessian* HCalib) {
     int wl = wG[lvl], hl = hG[lvl];
 
     Eigen::Vector3f* dI_l = dIp[lvl];
-    float* dabs_l = absSquaredGrad[lvl];
 
     if(lvl>0) {
       int lvlm1 = lvl-1;
@@ -178,6 +222,8 @@ void FrameHessian::makeImages(float* color, CalibHessian* HCalib) {
         }
     }
 
+    if(lvl>0 && !withCoarseGradients) continue;
+
     /// the second line starts
     for(int idx=wl;idx < wl*(hl-1);idx++) {
       float dx = 0.5f*(dI_l[idx+1][0] - dI_l[idx-1][0]);
@@ -189,15 +235,6 @@ void FrameHessian::makeImages(float* color, CalibHessian* HCalib) {
       /// gradient.
       dI_l[idx][1] = dx;
       dI_l[idx][2] = dy;
-
-      /// sqaured gradient.
-      dabs_l[idx] = dx*dx + dy*dy;
-
-      if(setting_gammaWeightsPixelSelect==1 && HCalib!=0) {
-        /// multiply by the response function, and change back to normal color, because I = G^-1(I) / V(x) when photometric correction.
-        float gw = HCalib->getBGradOnly((float)(dI_l[idx][0]));
-        dabs_l[idx] *= gw*gw;	// convert to gradient of original color space (before removing response).
-      }
     }
   }
 }
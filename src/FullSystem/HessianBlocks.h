@@ -106,10 +106,13 @@ struct FrameHessian {
 
   Eigen::Vector3f* dI;	// trace, fine tracking. Used for direction select (not for gradient histograms etc.)
   Eigen::Vector3f* dIp[PYR_LEVELS];  // coarse tracking / coarse initializer. NAN in [0] only.
-  float* absSquaredGrad[PYR_LEVELS]; // only used for pixel select (histograms etc.). no NAN.
+  float* absSquaredGrad[PYR_LEVELS]; // only used for pixel select (histograms etc.). no NAN. 0 until makeGradMaps().
 
   int frameID;	// incremental ID for keyframes only!
   static int instanceCounter;
+
+  /// whether dIp[lvl>0] has gradients (not the case for makeStereoImages).
+  bool coarseGradients;
   int idx;
 
   // Photometric Calibration Stuff
@@ -127,6 +130,7 @@ struct FrameHessian {
   Mat66 nullspaces_pose;
   Mat42 nullspaces_affine;
   Vec6 nullspaces_scale;
+  int nullspaceVersion;   /// bumped whenever setStateZero recomputes the nullspaces.
 
   // variable info.
   SE3 worldToCam_evalPT;
@@ -158,6 +162,17 @@ struct FrameHessian {
 
   void setStateZero(Vec10 state_zero);
 
+  /// version of the state as seen by the residuals (lazy relinearization): bumped when the scaled state
+  /// moved more than setting_lazyRelinTH since the last bump, or when the linearization point changed.
+  int linVersion;
+  Vec10 state_scaled_linRef;
+  inline void touchLinVersion(bool force) {
+    if(force || !((state_scaled - state_scaled_linRef).lpNorm<Eigen::Infinity>() <= setting_lazyRelinTH)) {
+      state_scaled_linRef = state_scaled;
+      linVersion++;
+    }
+  }
+
   inline void setState(Vec10 state) {
     this->state = state;
     state_scaled.segment<3>(0) = SCALE_XI_TRANS * state.segment<3>(0);
@@ -177,6 +192,7 @@ struct FrameHessian {
     PRE_worldToCam = SE3::exp(w2c_leftEps()) * get_worldToCam_evalPT();
     //// Twh = Thw^-1
     PRE_camToWorld = PRE_worldToCam.inverse();
+    touchLinVersion(false);
     //setCurrentNullspace();
   };
 
@@ -192,6 +208,7 @@ struct FrameHessian {
 
     PRE_worldToCam = SE3::exp(w2c_leftEps()) * get_worldToCam_evalPT();
     PRE_camToWorld = PRE_worldToCam.inverse();
+    touchLinVersion(false);
     //setCurrentNullspace();
   };
 
@@ -218,8 +235,8 @@ struct FrameHessian {
     release(); instanceCounter--;
 
     for(int i=0;i<pyrLevelsUsed;i++) {
-      delete[] dIp[i];
-      delete[]  absSquaredGrad[i];
+      if(dIp[i] != 0) delete[] dIp[i];
+      if(absSquaredGrad[i] != 0) delete[]  absSquaredGrad[i];
     }
 
     if(debugImage != 0) delete debugImage;
@@ -232,9 +249,28 @@ struct FrameHessian {
     efFrame = 0;
     frameEnergyTH = 8*8*patternNum;
     debugImage=0;
+    linVersion = 0;
+    nullspaceVersion = 0;
+    state_scaled_linRef.setConstant(NAN);
+    dI = 0;
+    for(int i=0;i<PYR_LEVELS;i++) {
+      dIp[i] = 0;
+      absSquaredGrad[i] = 0;
+    }
+    coarseGradients = false;
   };
 
+  /// everything: tracking images + gradient maps (keyframes, first frame).
   void makeImages(float* color, CalibHessian* HCalib);
+  /// tracking frame: the pyramid with gradients on all levels, what trackNewestCoarse and traceOn read.
+  /// Non-keyframes stay like this, makeGradMaps() promotes a frame once it becomes a keyframe.
+  void makeTrackingImages(float* color);
+  /// right stereo frame, only traced into: gradients on level 0 only, the coarse levels hold intensities for the coarse-to-fine search.
+  void makeStereoImages(float* color);
+  /// absSquaredGrad for pixel selection. Needs makeTrackingImages(), does nothing if already there.
+  void makeGradMaps(CalibHessian* HCalib);
+  inline bool hasGradMaps() const { return absSquaredGrad[0] != 0; }
+  void makePyramid(float* color, bool withCoarseGradients);
 
   inline Vec10 getPrior() {
     Vec10 p =  Vec10::Zero();
@@ -283,9 +319,21 @@ struct CalibHessian {
   VecC value_backup;
   VecC value_minus_value_zero;
 
+  /// version of value as seen by the residuals (lazy relinearization), see FrameHessian::linVersion.
+  int linVersion;
+  VecC value_scaled_linRef;
+  inline void touchLinVersion(bool force) {
+    if(force || !((value_scaled - value_scaled_linRef).lpNorm<Eigen::Infinity>() <= setting_lazyRelinTH)) {
+      value_scaled_linRef = value_scaled;
+      linVersion++;
+    }
+  }
+
   inline ~CalibHessian() {instanceCounter--;}
   inline CalibHessian()
   {
+    linVersion = 0;
+    value_scaled_linRef.setConstant(NAN);
 
     VecC initial_value = VecC::Zero();
     initial_value[0] = fxG[0];
@@ -330,6 +378,7 @@ struct CalibHessian {
     this->value_scaledi[2] = - this->value_scaledf[2] / this->value_scaledf[0];
     this->value_scaledi[3] = - this->value_scaledf[3] / this->value_scaledf[1];
     this->value_minus_value_zero = this->value - this->value_zero;
+    touchLinVersion(false);
   };
 
   inline void setValueScaled(VecC value_scaled)
@@ -346,6 +395,7 @@ struct CalibHessian {
     this->value_scaledi[1] = 1.0f / this->value_scaledf[1];
     this->value_scaledi[2] = - this->value_scaledf[2] / this->value_scaledf[0];
     this->value_scaledi[3] = - this->value_scaledf[3] / this->value_scaledf[1];
+    touchLinVersion(false);
   };
 
 
@@ -372,7 +422,7 @@ struct CalibHessian {
 
 // hessian component associated with one point.
 struct PointHessian {
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+  DSO_POOL_OPERATOR_NEW(PointHessian);
   static int instanceCounter;
   EFPoint* efPoint;
 
@@ -408,19 +458,31 @@ struct PointHessian {
 
   inline void setPointStatus(PtStatus s) {status=s;}
 
+  /// version of idepth as seen by the residuals (lazy relinearization), see FrameHessian::linVersion.
+  int linVersion;
+  float idepth_scaled_linRef;
+  inline void touchLinVersion(bool force) {
+    if(force || !(fabsf(idepth_scaled - idepth_scaled_linRef) <= setting_lazyRelinTH)) {
+      idepth_scaled_linRef = idepth_scaled;
+      linVersion++;
+    }
+  }
 
   inline void setIdepth(float idepth) {
     this->idepth = idepth;
     this->idepth_scaled = SCALE_IDEPTH * idepth;
+    touchLinVersion(false);
   }
   inline void setIdepthScaled(float idepth_scaled) {
     this->idepth = SCALE_IDEPTH_INVERSE * idepth_scaled;
     this->idepth_scaled = idepth_scaled;
+    touchLinVersion(false);
   }
   inline void setIdepthZero(float idepth) {
     idepth_zero = idepth;
     idepth_zero_scaled = SCALE_IDEPTH * idepth;
     nullspaces_scale = -(idepth*1.001 - idepth/1.001)*500;
+    touchLinVersion(true);
   }
 
   // only contains good residuals (not OOB and not OUTLIER). Arbitrary order.
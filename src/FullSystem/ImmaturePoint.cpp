@@ -26,6 +26,7 @@
 #include "FullSystem/ImmaturePoint.h"
 #include "util/FrameShell.h"
 #include "FullSystem/ResidualProjections.h"
+#include "FullSystem/dso_g2o_solver.hpp"
 
 namespace dso {
 
@@ -59,6 +60,8 @@ ImmaturePoint::ImmaturePoint(int u_, int v_, FrameHessian* host_, float type, Ca
   energyTH *= setting_overallEnergyTHWeight * setting_overallEnergyTHWeight;
 
   quality=10000;
+  traceCount=0;
+  idepth_interval_first=NAN;
 }
 
 ImmaturePoint::ImmaturePoint(float u_, float v_, FrameHessian* host_, CalibHessian* HCalib)
@@ -85,11 +88,153 @@ ImmaturePoint::ImmaturePoint(float u_, float v_, FrameHessian* host_, CalibHessi
   energyTH *= setting_overallEnergyTHWeight*setting_overallEnergyTHWeight;
 
   quality=10000;
+  traceCount=0;
+  idepth_interval_first=NAN;
 }
 
 ImmaturePoint::~ImmaturePoint()
 {}
 
+/// huber energy of the (rotated) pattern placed at level-0 position (x, y), sampled on a pyramid level.
+/// scale is 1/2^lvl, level-0 pixel centers map to (x+0.5)*scale-0.5 on that level.
+EIGEN_ALWAYS_INLINE float tracePatternEnergy(const Eigen::Vector3f* const dI_l, const int wl, const float scale,
+                                             const float x, const float y,
+                                             const Vec2f* const pattern_l,
+                                             const float* const color, const Vec2f &aff) {
+  const float offset = 0.5f*scale-0.5f;
+  float energy=0;
+  for(int idx=0;idx<patternNum;idx++) {
+    float hitColor = getInterpolatedElement31(dI_l,
+                                              (float)(x*scale+offset+pattern_l[idx][0]),
+                                              (float)(y*scale+offset+pattern_l[idx][1]),
+                                              wl);
+
+    if(!std::isfinite(hitColor)) {energy+=1e5; continue;}
+    float residual = hitColor - (float)(aff[0] * color[idx] + aff[1]);
+    float hw = fabs(residual) < setting_huberTH ? 1 : setting_huberTH / fabs(residual);
+    energy += hw *residual*residual*(2-hw);
+  }
+  return energy;
+}
+
+int ImmaturePoint::searchEpipolarSegment(FrameHessian* frame, float uMin, float vMin,
+                                         float dx, float dy, float dist,
+                                         const Vec2f* rotatetPattern, const Vec2f &aff,
+                                         float &bestU, float &bestV, float &bestEnergy, float &newQuality) const {
+  /// number of steps.
+  int numSteps = 1.9999f + dist / setting_trace_stepsize;
+
+  /// take a random number after the decimal point ??
+  float randShift = uMin*1000-floorf(uMin*1000);
+  float ptx = uMin-randShift*dx;
+  float pty = vMin-randShift*dy;
+
+  float errors[100];
+  int bestIdx=-1;
+  bestEnergy=1e10;
+
+  int lvl = setting_trace_coarseToFine ? std::min(setting_trace_coarseToFineLevel, pyrLevelsUsed-1) : 0;
+
+  if(lvl > 0 && numSteps > setting_trace_coarseToFineMinSteps) {
+    /// STEP1: search the whole segment on the coarse level. one coarse step covers 2^lvl level-0 steps.
+    int lvlScale = 1<<lvl;
+    float scale = 1.0f / lvlScale;
+    float dxc = dx*lvlScale, dyc = dy*lvlScale;
+
+    int numStepsCoarse = 1.9999f + dist / (setting_trace_stepsize*lvlScale);
+    if(numStepsCoarse >= 100) numStepsCoarse = 99;
+
+    Vec2f rotatetPatternCoarse[MAX_RES_PER_POINT];
+    for(int idx=0;idx<patternNum;idx++)
+      rotatetPatternCoarse[idx] = rotatetPattern[idx]*scale;
+
+    for(int i=0;i<numStepsCoarse;i++) {
+      errors[i] = 1e10;
+      /// the last coarse step may overshoot uMax / vMax by up to one coarse step, check the border on this level.
+      if(ptx*scale > patternPadding+1 && pty*scale > patternPadding+1 &&
+         ptx*scale < wG[lvl]-patternPadding-2 && pty*scale < hG[lvl]-patternPadding-2) {
+        float energy = tracePatternEnergy(frame->dIp[lvl], wG[lvl], scale, ptx, pty, rotatetPatternCoarse, color, aff);
+        errors[i] = energy;
+        if(energy < bestEnergy) {
+          bestU = ptx;
+          bestV = pty;
+          bestEnergy = energy;
+          bestIdx = i;
+        }
+      }
+      ptx+=dxc;
+      pty+=dyc;
+    }
+
+    if(bestIdx >= 0) {
+      /// uniqueness is taken from the coarse profile only, so best and second best are on the same level.
+      /// the +-radius is converted to coarse steps.
+      int radius = std::max(1, (int)ceilf(setting_minTraceTestRadius*scale));
+      float secondBest=1e10;
+      for(int i=0;i<numStepsCoarse;i++)
+        if((i < bestIdx-radius || i > bestIdx+radius) && errors[i] < secondBest)
+          secondBest = errors[i];
+      newQuality = secondBest / bestEnergy;
+
+      /// STEP2: refine within a small window around the coarse minimum on level 0.
+      float window = std::max(setting_trace_coarseToFineWindow, setting_trace_stepsize*lvlScale);
+      int halfSteps = ceilf(window / setting_trace_stepsize);
+      ptx = bestU - halfSteps*dx;
+      pty = bestV - halfSteps*dy;
+      bestEnergy=1e10;
+
+      for(int i=0;i<=2*halfSteps;i++) {
+        /// the window may reach slightly beyond the checked segment ends.
+        if(ptx > patternPadding+1 && pty > patternPadding+1 && ptx < wG[0]-patternPadding-2 && pty < hG[0]-patternPadding-2) {
+          float energy = tracePatternEnergy(frame->dI, wG[0], 1.0f, ptx, pty, rotatetPattern, color, aff);
+          if(energy < bestEnergy) {
+            bestU = ptx;
+            bestV = pty;
+            bestEnergy = energy;
+          }
+        }
+        ptx+=dx;
+        pty+=dy;
+      }
+
+      return numSteps;
+    }
+
+    /// every coarse sample was on the border: fall back to the full search on level 0.
+    ptx = uMin-randShift*dx;
+    pty = vMin-randShift*dy;
+  }
+
+  if(numSteps >= 100) numSteps = 99;
+
+  for(int i=0;i<numSteps;i++) {
+    float energy = tracePatternEnergy(frame->dI, wG[0], 1.0f, ptx, pty, rotatetPattern, color, aff);
+
+    errors[i] = energy;
+    if(energy < bestEnergy) {
+      bestU = ptx;
+      bestV = pty;
+      bestEnergy = energy;
+      bestIdx = i;
+    }
+
+    /// each dist corresponding size.
+    ptx+=dx;
+    pty+=dy;
+  }
+
+  /// find the second samllest error within a certain radius, and the difference is large enough to be better (this is commonly used).
+  // find best score outside a +-2px radius.
+  float secondBest=1e10;
+  for(int i=0;i<numSteps;i++) {
+    if((i < bestIdx-setting_minTraceTestRadius || i > bestIdx+setting_minTraceTestRadius) && errors[i] < secondBest)
+      secondBest = errors[i];
+  }
+  newQuality = secondBest / bestEnergy;
+
+  return numSteps;
+}
+
 // do static stereo match. if mode_right = true, it matches from left to right. otherwise do it from right to left.
 ImmaturePointStatus ImmaturePoint::traceStereo(FrameHessian* frame,
                                                Mat33f K,
@@ -235,14 +380,8 @@ ImmaturePointStatus ImmaturePoint::traceStereo(FrameHessian* frame,
     dist = maxPixSearch;
   }
 
-  int numSteps = 1.9999f + dist / setting_trace_stepsize;
   Mat22f Rplane = KRKi.topLeftCorner<2,2>();
 
-  float randShift = uMin*1000-floorf(uMin*1000);
-  float ptx = uMin-randShift*dx;
-  float pty = vMin-randShift*dy;
-
-
   Vec2f rotatetPattern[MAX_RES_PER_POINT];
   for(int idx=0;idx<patternNum;idx++)
     rotatetPattern[idx] = Rplane * Vec2f(patternP[idx][0], patternP[idx][1]);
@@ -254,60 +393,17 @@ ImmaturePointStatus ImmaturePoint::traceStereo(FrameHessian* frame,
     return lastTraceStatus = ImmaturePointStatus::IPS_OOB;
   }
 
-  float errors[100];
-  float bestU=0, bestV=0, bestEnergy=1e10;
-  int bestIdx=-1;
-  if(numSteps >= 100) numSteps = 99;
+  float bestU=0, bestV=0, bestEnergy=1e10, newQuality=0;
+  int numSteps = searchEpipolarSegment(frame, uMin, vMin, dx, dy, dist, rotatetPattern, aff,
+                                       bestU, bestV, bestEnergy, newQuality);
 
-  for(int i=0;i<numSteps;i++) {
-    float energy=0;
-    for(int idx=0;idx<patternNum;idx++) {
-
-      float hitColor = getInterpolatedElement31(frame->dI,
-                                                (float)(ptx+rotatetPattern[idx][0]),
-                                                (float)(pty+rotatetPattern[idx][1]),
-                                                wG[0]);
-
-      if(!std::isfinite(hitColor)) {
-        energy+=1e5;
-        continue;
-      }
-
-      float residual = hitColor - (float)(aff[0] * color[idx] + aff[1]);
-      float hw = fabs(residual) < setting_huberTH ? 1 : setting_huberTH / fabs(residual);
-      energy += hw *residual*residual*(2-hw);
-    }
-
-    errors[i] = energy;
-    if(energy < bestEnergy)
-    {
-      bestU = ptx;
-      bestV = pty;
-      bestEnergy = energy;
-      bestIdx = i;
-    }
-
-    ptx+=dx;
-    pty+=dy;
-  }
-
-  // find best score outside a +-2px radius.
-  float secondBest=1e10;
-  for(int i=0;i<numSteps;i++) {
-    if((i < bestIdx-setting_minTraceTestRadius || i > bestIdx+setting_minTraceTestRadius) && errors[i] < secondBest) {
-      secondBest = errors[i];
-    }
-  }
-
-  float newQuality = secondBest / bestEnergy;
   if(newQuality < quality || numSteps > 10) {
     quality = newQuality;
   }
 
 
   // ============== do GN optimization ===================
-  auto linear_solver = g2o::make_unique<g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>>();
-  auto block_solver = g2o::make_unique<g2o::BlockSolverX>(std::move(linear_solver));
+  auto block_solver = util::MakeBlockSolverX(2);
   auto algorithm = new g2o::OptimizationAlgorithmGaussNewton(std::move(block_solver));
   g2o::SparseOptimizer* optimizer = new g2o::SparseOptimizer();
   optimizer->setAlgorithm(algorithm);
@@ -467,6 +563,8 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
     return lastTraceStatus;
   }
 
+  traceCount++;
+
   debugPrint = false;//rand()%100==0;
   float maxPixSearch = (wG[0]+hG[0])*setting_maxPixSearch;
 
@@ -627,15 +725,8 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
     dist = maxPixSearch;
   }
 
-  /// number of steps.
-  int numSteps = 1.9999f + dist / setting_trace_stepsize;
   Mat22f Rplane = hostToFrame_KRKi.topLeftCorner<2,2>();
 
-  /// take a random number after the decimal point ??
-  float randShift = uMin*1000-floorf(uMin*1000);
-  float ptx = uMin-randShift*dx;
-  float pty = vMin-randShift*dy;
-
   /// pattern offset on new frame.
   Vec2f rotatetPattern[MAX_RES_PER_POINT];
   for(int idx=0;idx<patternNum;idx++)
@@ -651,54 +742,15 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
   }
 
   /// search for the position with the smallest error along the level line.
-  float errors[100];
-  float bestU=0, bestV=0, bestEnergy=1e10;
-  int bestIdx=-1;
-  if(numSteps >= 100) numSteps = 99;
-
-  for(int i=0;i<numSteps;i++) {
-    float energy=0;
-    for(int idx=0;idx<patternNum;idx++)
-    {
-      float hitColor = getInterpolatedElement31(frame->dI,
-                                                (float)(ptx+rotatetPattern[idx][0]),
-                                                (float)(pty+rotatetPattern[idx][1]),
-                                                wG[0]);
-
-      if(!std::isfinite(hitColor)) {energy+=1e5; continue;}
-      float residual = hitColor - (float)(hostToFrame_affine[0] * color[idx] + hostToFrame_affine[1]);
-      float hw = fabs(residual) < setting_huberTH ? 1 : setting_huberTH / fabs(residual);
-      energy += hw *residual*residual*(2-hw);
-    }
-
-    if(debugPrint)
-      printf("step %.1f %.1f (id %f): energy = %f!\n",
-             ptx, pty, 0.0f, energy);
-
-
-    errors[i] = energy;
-    if(energy < bestEnergy)
-    {
-      bestU = ptx;
-      bestV = pty;
-      bestEnergy = energy;
-      bestIdx = i;
-    }
+  /// the quality is the ratio of the second smallest error outside a certain radius to the smallest one.
+  float bestU=0, bestV=0, bestEnergy=1e10, newQuality=0;
+  int numSteps = searchEpipolarSegment(frame, uMin, vMin, dx, dy, dist, rotatetPattern, hostToFrame_affine,
+                                       bestU, bestV, bestEnergy, newQuality);
 
-    /// each dist corresponding size.
-    ptx+=dx;
-    pty+=dy;
-  }
+  if(debugPrint)
+    printf("discrete search over %d steps: best %.1f %.1f, energy = %f, quality = %f!\n",
+           numSteps, bestU, bestV, bestEnergy, newQuality);
 
-  /// find the second samllest error within a certain radius, and the difference is large enough to be better (this is commonly used).
-  // find best score outside a +-2px radius.
-  float secondBest=1e10;
-  for(int i=0;i<numSteps;i++)
-  {
-    if((i < bestIdx-setting_minTraceTestRadius || i > bestIdx+setting_minTraceTestRadius) && errors[i] < secondBest)
-      secondBest = errors[i];
-  }
-  float newQuality = secondBest / bestEnergy;
   if(newQuality < quality || numSteps > 10) quality = newQuality;
 
 
@@ -817,6 +869,9 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
     return lastTraceStatus = ImmaturePointStatus::IPS_OUTLIER;
   }
 
+  if(!std::isfinite(idepth_interval_first))
+    idepth_interval_first = idepth_max - idepth_min;
+
   /// search range.
   lastTracePixelInterval=2*errorInPixel;
 
@@ -827,6 +882,30 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
   return lastTraceStatus = ImmaturePointStatus::IPS_GOOD;
 }
 
+/// score = trace quality * interval shrink / age penalty.
+/// points which have not been traced yet get the full quality score, so new keyframes are kept.
+float ImmaturePoint::getBudgetPriority() const {
+  if(host->flaggedForMarginalization
+     || lastTraceStatus == ImmaturePointStatus::IPS_OOB
+     || lastTraceStatus == ImmaturePointStatus::IPS_OUTLIER)
+    return 0;
+
+  /// traced, but never successfully. will be deleted on activation anyway.
+  if(traceCount > 0 && !std::isfinite(idepth_max))
+    return 0;
+
+  /// quality is 10000 until the first trace, clamp to [0,2] relative to the activation threshold.
+  float qualityScore = std::min(quality, 2*setting_minTraceQuality) / setting_minTraceQuality;
+
+  /// how much the idepth interval shrank since the first good trace.
+  float shrinkScore = 1;
+  float interval = idepth_max - idepth_min;
+  if(std::isfinite(idepth_interval_first) && interval > 0)
+    shrinkScore = std::max(1.0f, std::min(idepth_interval_first / interval, setting_immatureMaxShrinkScore));
+
+  return qualityScore * shrinkScore / (1 + setting_immatureAgeWeight*traceCount);
+}
+
 //// never used function.
 float ImmaturePoint::getdPixdd(CalibHessian *  HCalib,
                                ImmaturePointTemporaryResidual* tmpRes,
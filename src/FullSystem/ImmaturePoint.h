@@ -59,7 +59,7 @@ enum ImmaturePointStatus {
 class ImmaturePoint
 {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+  DSO_POOL_OPERATOR_NEW(ImmaturePoint);
   // static values
   float color[MAX_RES_PER_POINT];
   float weights[MAX_RES_PER_POINT];
@@ -82,6 +82,11 @@ class ImmaturePoint
   float idepth_min_stereo;  // idepth_min used to do static matching
   float idepth_max_stereo;  // idepth_max used to do static matching
   float idepth_stereo;
+
+  /// number of temporal trace passes, and the idepth interval after the first good one (budget priority).
+  int traceCount;
+  float idepth_interval_first;
+
   ImmaturePoint(int u_, int v_, FrameHessian* host_, float type, CalibHessian* HCalib);
   ImmaturePoint(float u_, float v_, FrameHessian* host_, CalibHessian* HCalib);
   ~ImmaturePoint();
@@ -105,12 +110,22 @@ class ImmaturePoint
       ImmaturePointTemporaryResidual* tmpRes,
       float idepth);
 
+  /// priority used to evict points when the immature point budget is exceeded. higher is better, 0 = useless.
+  float getBudgetPriority() const;
+
   float calcResidual(
       CalibHessian *  HCalib, const float outlierTHSlack,
       ImmaturePointTemporaryResidual* tmpRes,
       float idepth);
 
  private:
+  /// discrete search along the epipolar segment [uMin,vMin] + t*[dx,dy], t in [0,dist].
+  /// searches coarse-to-fine if enabled, returns the number of (level-0) steps the segment spans.
+  int searchEpipolarSegment(
+      FrameHessian* frame, float uMin, float vMin,
+      float dx, float dy, float dist,
+      const Vec2f* rotatetPattern, const Vec2f &aff,
+      float &bestU, float &bestV, float &bestEnergy, float &newQuality) const;
 };
 
 }
@@ -0,0 +1,63 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "FullSystem/MappingBudget.h"
+#include <algorithm>
+
+namespace dso
+{
+
+void MappingBudget::update(float trace, float activate, float optimize, float finish)
+{
+  traceMs = trace;
+  activateMs = activate;
+  optimizeMs = optimize;
+  finishMs = finish;
+
+  const float totalMs = trace + activate + optimize + finish;
+  smoothedMs = smoothedMs < 0 ? totalMs : 0.7f*smoothedMs + 0.3f*totalMs;
+
+  if(setting_mappingBudgetMs <= 0)
+  {
+    densityScale = 1;
+    decision = 0;
+    return;
+  }
+
+  // the mapping cost is roughly linear in the number of points, so step proportionally.
+  const float ratio = setting_mappingBudgetMs / std::max(smoothedMs, 1e-3f);
+  const float oldScale = densityScale;
+
+  if(smoothedMs > setting_mappingBudgetMs * (1 + setting_mappingBudgetHysteresis))
+    densityScale *= std::max(0.8f, ratio);
+  else if(smoothedMs < setting_mappingBudgetMs * (1 - setting_mappingBudgetHysteresis))
+    densityScale *= std::min(1.1f, ratio);
+
+  densityScale = std::min(setting_mappingBudgetMaxScale, std::max(setting_mappingBudgetMinScale, densityScale));
+
+  decision = densityScale < oldScale ? -1 : (densityScale > oldScale ? 1 : 0);
+}
+
+}
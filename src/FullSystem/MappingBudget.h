@@ -0,0 +1,65 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#pragma once
+#include "util/settings.h"
+
+namespace dso
+{
+
+/// Keeps the mapping time per keyframe near setting_mappingBudgetMs by scaling the point densities.
+/// Fed with the measured durations of every keyframe (tracing, activation, optimization, finishing);
+/// the smoothed total is compared against the budget, and only outside the hysteresis band the density scale
+/// is stepped (at most 20% down / 10% up per keyframe) within [setting_mappingBudgetMinScale, setting_mappingBudgetMaxScale].
+/// With a budget of 0 the scale stays 1, i.e. the configured densities are used as they are.
+class MappingBudget
+{
+ public:
+  MappingBudget() { reset(); }
+
+  void reset()
+  {
+    densityScale = 1;
+    smoothedMs = -1;
+    decision = 0;
+    traceMs = activateMs = optimizeMs = finishMs = 0;
+  }
+
+  /// durations of the last keyframe in ms. finish is the previous keyframe's finishKeyFrame, it runs late.
+  void update(float trace, float activate, float optimize, float finish);
+
+  inline float pointDensity() const { return setting_desiredPointDensity * densityScale; }
+  inline float immatureDensity() const { return setting_desiredImmatureDensity * densityScale; }
+
+  float densityScale;
+  /// exponentially smoothed total per keyframe, ms.
+  float smoothedMs;
+  /// last decision: -1 reduce density, 0 hold, +1 increase.
+  int decision;
+
+  float traceMs, activateMs, optimizeMs, finishMs;
+};
+
+}
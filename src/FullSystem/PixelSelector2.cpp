@@ -51,8 +51,11 @@ PixelSelector::PixelSelector(int w, int h)
   ths = new float[(w/32)*(h/32)+100];
   thsSmoothed = new float[(w/32)*(h/32)+100];
 
+  candidateMask = new unsigned char[w*h];
+
   allowFast=false;
   gradHistFrame=0;
+  red=0;
 }
 
 PixelSelector::~PixelSelector()
@@ -61,6 +64,7 @@ PixelSelector::~PixelSelector()
   delete[] gradHist;
   delete[] ths;
   delete[] thsSmoothed;
+  delete[] candidateMask;
 }
 
 /// gradient value taking below% as threshold.
@@ -80,10 +84,8 @@ int computeHistQuantil(int* hist, float below) {
   return 90;
 }
 
-/// generate graident histogram, calculate threshold for each block.
-void PixelSelector::makeHists(const FrameHessian* const fh) {
-  gradHistFrame = fh;
-
+/// gradient histograms and thresholds of the 32x32 blocks in block rows [min,max).
+void PixelSelector::makeHistsReductor(const FrameHessian* const fh, int min, int max, Vec10* stats, int tid) {
   /// summation of squared gradients at level 0.
   float * mapmax0 = fh->absSquaredGrad[0];
 
@@ -91,46 +93,89 @@ void PixelSelector::makeHists(const FrameHessian* const fh) {
   int w = wG[0];
   int h = hG[0];
 
-  /// still each block size is 32x32, not 32x32 grids in the paper.
   int w32 = w/32;
   int h32 = h/32;
-  thsStep = w32;
 
-  for(int y=0;y<h32;y++)
+  for(int y=min;y<max;y++)
     for(int x=0;x<w32;x++) {
       /// grid of y rows and x columns.
       float* map0 = mapmax0 + 32*x + 32*y*w;
-      int* hist0 = gradHist; // + 50*(x+y*w32);
+
+      /// every block has its own histogram, so block rows can be done in parallel.
+      int* hist0 = gradHist + 50*(x+y*w32);
 
       // divide into 50 cells.
       memset(hist0,0,sizeof(int)*50);
 
-      for(int j=0;j<32;j++)
-        for(int i=0;i<32;i++) {
-          /// the entire image coordinates of the grid's (j,i) pixels.
-          int it = i+32*x;
-          int jt = j+32*y;
-
-          /// inside.
-          if(it>w-2 || jt>h-2 || it<1 || jt<1) continue;
+      /// blocks touching the image border have to check every pixel.
+      bool interior = x>0 && y>0 && x<w32-1 && y<h32-1;
+
+      if(interior) {
+        /// all 32x32 pixels are inside, bins are computed 4 at a time.
+        int g[32];
+        for(int j=0;j<32;j++) {
+          const float* row = map0+j*w;
+#ifdef __SSE2__
+          const __m128 maxBin = _mm_set1_ps(48.0f);
+          for(int i=0;i<32;i+=4) {
+            /// min(sqrt(g2), 48), truncated. same as clamping the int, since sqrt is not negative.
+            __m128 sq = _mm_min_ps(_mm_sqrt_ps(_mm_loadu_ps(row+i)), maxBin);
+            _mm_storeu_si128((__m128i*)(g+i), _mm_cvttps_epi32(sq));
+          }
+#else
+          for(int i=0;i<32;i++) {
+            g[i] = sqrtf(row[i]);
+            if(g[i]>48) g[i]=48;
+          }
+#endif
+          for(int i=0;i<32;i++) hist0[g[i]+1]++;
+        }
+        hist0[0] = 32*32;
+      }
+      else {
+        for(int j=0;j<32;j++)
+          for(int i=0;i<32;i++) {
+            /// the entire image coordinates of the grid's (j,i) pixels.
+            int it = i+32*x;
+            int jt = j+32*y;
+
+            /// inside.
+            if(it>w-2 || jt>h-2 || it<1 || jt<1) continue;
+
+            /// squared square root.
+            int g = sqrtf(map0[i+j*w]);
+
+            /// ? why is the number 48 because it is divied into 50 cells?
+            if(g>48) {
+              g=48;
+            }
 
-          /// squared square root.
-          int g = sqrtf(map0[i+j*w]);
+            /// 1-49 stores the number of cooresponding gradients.
+            hist0[g+1]++;
 
-          /// ? why is the number 48 because it is divied into 50 cells?
-          if(g>48) {
-            g=48;
+            /// number of all pixels.
+            hist0[0]++;
           }
+      }
 
-          /// 1-49 stores the number of cooresponding gradients.
-          hist0[g+1]++;
-
-          /// number of all pixels.
-          hist0[0]++;
-        }
       /// get the threshold of each block.
       ths[x+y*w32] = computeHistQuantil(hist0,setting_minGradHistCut) + setting_minGradHistAdd;
     }
+}
+
+/// generate graident histogram, calculate threshold for each block.
+void PixelSelector::makeHists(const FrameHessian* const fh) {
+  gradHistFrame = fh;
+
+  /// still each block size is 32x32, not 32x32 grids in the paper.
+  int w32 = wG[0]/32;
+  int h32 = hG[0]/32;
+  thsStep = w32;
+
+  if(red != 0 && multiThreading)
+    red->reduce(boost::bind(&PixelSelector::makeHistsReductor, this, fh, _1, _2, _3, _4), 0, h32, 1);
+  else
+    makeHistsReductor(fh, 0, h32, 0, 0);
 
   /// use 3x3 window to average to smooth.
   for(int y=0; y<h32 ;y++)
@@ -177,17 +222,120 @@ void PixelSelector::makeHists(const FrameHessian* const fh) {
     }
 }
 
+/// mark every pixel of rows [min,max) that passes the level 0/1/2 gradient threshold of select().
+void PixelSelector::makeCandidateMaskReductor(const FrameHessian* const fh, float thFactor,
+                                              int min, int max, Vec10* stats, int tid) {
+  float * mapmax0 = fh->absSquaredGrad[0];
+  float * mapmax1 = fh->absSquaredGrad[1];
+  float * mapmax2 = fh->absSquaredGrad[2];
+
+  int w = wG[0];
+  int w1 = wG[1];
+  int w2 = wG[2];
+  int h = hG[0];
+
+  float dw1 = setting_gradDownweightPerLevel;
+  float dw2 = dw1*dw1;
+
+  for(int y=min;y<max;y++) {
+    unsigned char* mask = candidateMask + y*w;
+    memset(mask, 0, w);
+
+    /// same border as in select().
+    if(y<4 || y>h-4) continue;
+
+    const float* ag0 = mapmax0 + y*w;
+    const float* ag1 = mapmax1 + (y>>1)*w1;
+    const float* ag2 = mapmax2 + (y>>2)*w2;
+
+    int x=4;
+#ifdef __SSE2__
+    /// 4 pixels never cross a 32 block (x is a multiple of 4), and share one level 2 pixel.
+    for(; x+3<w-5; x+=4) {
+      float pixelTH0 = thsSmoothed[(x>>5) + (y>>5) * thsStep] * thFactor;
+
+      int m0 = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(ag0+x), _mm_set1_ps(pixelTH0)));
+      __m128 ag1x = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(ag1+(x>>1)));
+      int m1 = _mm_movemask_ps(_mm_cmpgt_ps(_mm_unpacklo_ps(ag1x, ag1x), _mm_set1_ps(pixelTH0*dw1)));
+      int m2 = ag2[x>>2] > pixelTH0*dw1*dw2 ? 0xF : 0;
+
+      for(int k=0;k<4;k++)
+        mask[x+k] = ((m0>>k)&1) | (((m1>>k)&1)<<1) | (((m2>>k)&1)<<2);
+    }
+#endif
+    for(; x<w-5; x++) {
+      float pixelTH0 = thsSmoothed[(x>>5) + (y>>5) * thsStep] * thFactor;
+      mask[x] = (ag0[x] > pixelTH0)
+          | ((ag1[x>>1] > pixelTH0*dw1) << 1)
+          | ((ag2[x>>2] > pixelTH0*dw1*dw2) << 2);
+    }
+  }
+}
+
+/// number of points select() returns for potential pot, up to the random direction weighting:
+/// one per pot-cell with a level 0 candidate, else one per 2pot-cell with a level 1 candidate, else one per 4pot-cell with a level 2 candidate.
+int PixelSelector::countCandidates(int pot) {
+  int w = wG[0];
+  int h = hG[0];
+  int n=0;
+
+  for(int y4=0; y4<h; y4+=(4*pot))
+    for(int x4=0; x4<w; x4+=(4*pot)) {
+      int my3 = std::min((4*pot), h-y4);
+      int mx3 = std::min((4*pot), w-x4);
+      unsigned char any4 = 0;
+
+      for(int y3=0; y3<my3; y3+=(2*pot))
+        for(int x3=0; x3<mx3; x3+=(2*pot)) {
+          int x34 = x3+x4;
+          int y34 = y3+y4;
+          int my2 = std::min((2*pot), h-y34);
+          int mx2 = std::min((2*pot), w-x34);
+          unsigned char any3 = 0;
+
+          for(int y2=0; y2<my2; y2+=pot)
+            for(int x2=0; x2<mx2; x2+=pot) {
+              int x234 = x2+x34;
+              int y234 = y2+y34;
+              int my1 = std::min(pot, h-y234);
+              int mx1 = std::min(pot, w-x234);
+              unsigned char any2 = 0;
+
+              for(int y1=0;y1<my1;y1++) {
+                const unsigned char* mask = candidateMask + x234 + (y1+y234)*w;
+                for(int x1=0;x1<mx1;x1++) any2 |= mask[x1];
+              }
+
+              if(any2 & 1) n++;
+              any3 |= any2;
+            }
+
+          if(!(any3 & 1) && (any3 & 2)) n++;
+          any4 |= any3;
+        }
+
+      if(!(any4 & 3) && (any4 & 4)) n++;
+    }
+
+  return n;
+}
+
+void PixelSelector::countCandidatesReductor(int potFirst, int min, int max, Vec10* stats, int tid) {
+  for(int k=min;k<max;k++)
+    (*stats)[k] = countCandidates(potFirst+k);
+}
+
 /* *******************************
  * @ function:
  *
  * @param: fh frame Hessian data structure
  * @ map_out selected map points
  * @ density The number of points (density) required for each pyramid layer
- * @recursionsLeft maximum recursion
+ * @recursionsLeft if 0, select with currentPotential, otherwise search the best potential first
  * @ plot
  * @thFactor threshold factor, settingImaturePointDensity
  * @
- * @note: use recursion
+ * @note: the potential is chosen from candidate counts of 10 potentials, so the image is only selected once.
 ****************************** */
 int PixelSelector::makeMaps(const FrameHessian* const fh,
                             float* map_out,
@@ -199,12 +347,14 @@ int PixelSelector::makeMaps(const FrameHessian* const fh,
   float numHave=0;
   float numWant=density;
   float quotia;
-  int idealPotential = currentPotential;
+  int pot = currentPotential;
+
+  int h = hG[0];
+  bool useThreads = red != 0 && multiThreading;
 
   {
     // the number of selected pixels behaves approximately as
     // K / (pot+1)^2, where K is a scene-dependent constant.
-    // we will allow sub-selecting pixels by up to a quotia of 0.25, otherwise we will re-select.
 
     /// STEP1: without calculating the histogram and the threshld of the selected point, cell the function to generate the block threshold.
     if(fh != gradHistFrame) {
@@ -212,52 +362,40 @@ int PixelSelector::makeMaps(const FrameHessian* const fh,
       makeHists(fh);
     }
 
-    /// STEP2: select eligible pixels on the current frame.
+    /// STEP2: count the points select() would give for potentials [potFirst, potFirst+10), instead of re-selecting.
+    if(recursionsLeft>0) {
+      if(useThreads)
+        red->reduce(boost::bind(&PixelSelector::makeCandidateMaskReductor, this, fh, thFactor, _1, _2, _3, _4), 0, h);
+      else
+        makeCandidateMaskReductor(fh, thFactor, 0, h, 0, 0);
+
+      int potFirst = std::max(1, currentPotential-4);
+      Vec10 numCandidates;
+      if(useThreads) {
+        red->reduce(boost::bind(&PixelSelector::countCandidatesReductor, this, potFirst, _1, _2, _3, _4), 0, 10, 1);
+        numCandidates = red->stats;
+      }
+      else {
+        numCandidates.setZero();
+        countCandidatesReductor(potFirst, 0, 10, &numCandidates, 0);
+      }
+
+      /// the number of points decreases with the potential: take the largest one that still gives enough points,
+      /// the surplus is removed by random sub-sampling below.
+      pot = potFirst;
+      for(int k=0;k<10;k++)
+        if(numCandidates[k] >= numWant) pot = potFirst+k;
+    }
+
+    /// STEP3: select eligible pixels on the current frame.
     // select!
-    Eigen::Vector3i n = this->select(fh, map_out,currentPotential, thFactor);
+    Eigen::Vector3i n = this->select(fh, map_out, pot, thFactor);
 
     // sub-select!
     /// select the obtained points.
     numHave = n[0]+n[1]+n[2];
     /// the ratio of obtained points.
     quotia = numWant / numHave;
-
-    /// STEP3: calculate the number of pixels to be collected, the size of the range is equivalent to the dynamic grid, the smaller the pot, the more points will be obtained.
-    // by default we want to over-sample by 40% just to be sure.
-    float K = numHave * (currentPotential+1) * (currentPotential+1); /// equivalent to the area covered, each pixel correspoinds to a pot*pot;
-    idealPotential = sqrtf(K/numWant)-1;	// round down.
-    if(idealPotential<1) idealPotential=1;
-
-    /// STEP4: the number you want and the number you have obtained will be resampled if it is greater than or less than 0.25
-    if(recursionsLeft>0 && quotia>1.25 && currentPotential>1) {
-      // re-sample to get more points!
-      // potential needs to be smaller
-      if(idealPotential>=currentPotential)    /// idealPotential should be small.
-        idealPotential = currentPotential-1;  /// decrease, multiply points.
-
-      //printf("PixelSelector: have %.2f%%, need %.2f%%. RESAMPLE with pot %d -> %d.\n",
-      //100*numHave/(float)(wG[0]*hG[0]),
-      //100*numWant/(float)(wG[0]*hG[0]),
-      //currentPotential,
-      //idealPotential);
-
-      currentPotential = idealPotential;
-      return makeMaps(fh,map_out, density, recursionsLeft-1, plot,thFactor); /// recursion.
-    }
-    else if(recursionsLeft>0 && quotia < 0.25) {
-      // re-sample to get less points!
-      if(idealPotential<=currentPotential)   /// idealPotential should be large.
-        idealPotential = currentPotential+1; /// increase, take less points.
-
-      //printf("PixelSelector: have %.2f%%, need %.2f%%. RESAMPLE with pot %d -> %d.\n",
-      //100*numHave/(float)(wG[0]*hG[0]),
-      //100*numWant/(float)(wG[0]*hG[0]),
-      //currentPotential,
-      //idealPotential);
-
-      currentPotential = idealPotential;
-      return makeMaps(fh,map_out, density, recursionsLeft-1, plot,thFactor);
-    }
   }
 
   /// STEP5: there are still many extractions, and some points are randomly deleted.
@@ -288,7 +426,7 @@ int PixelSelector::makeMaps(const FrameHessian* const fh,
   //idealPotential,
   //100*numHaveSub/(float)(wG[0]*hG[0]));
 
-  currentPotential = idealPotential;
+  currentPotential = pot;
 
   /// draw the selection result.
   if(plot) {
@@ -341,6 +479,35 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
                                       float* map_out,
                                       int pot,
                                       float thFactor)
+{
+  int w = wG[0];
+  int h = hG[0];
+
+  /// ? where do I change the status of PixelSelectorStatus?
+  memset(map_out,0,w*h*sizeof(PixelSelectorStatus));
+
+  /// bands of 4*pot rows are independent, every band only writes its own rows of map_out.
+  int numRows4 = (h+4*pot-1)/(4*pot);
+
+  Vec10 stats;
+  if(red != 0 && multiThreading) {
+    red->reduce(boost::bind(&PixelSelector::selectReductor, this, fh, map_out, pot, thFactor, _1, _2, _3, _4), 0, numRows4, 1);
+    stats = red->stats;
+  } else {
+    stats.setZero();
+    selectReductor(fh, map_out, pot, thFactor, 0, numRows4, &stats, 0);
+  }
+
+  /// number of points selected at levels 0,1,2.
+  return Eigen::Vector3i((int)stats[0], (int)stats[1], (int)stats[2]);
+}
+
+/// select() for the 4*pot row bands [min, max).
+void PixelSelector::selectReductor(const FrameHessian* const fh,
+                                   float* map_out,
+                                   int pot,
+                                   float thFactor,
+                                   int min, int max, Vec10* stats, int tid)
 {
   /// const on *left: pointer content cannot be changed, on *right pointer cannot be changed.
   /// equiv const Eigen::Vector3f* const
@@ -379,9 +546,6 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
     Vec2f(1.0000,    0.0000),
     Vec2f(0.1951,   -0.9808)};
 
-  /// ? where do I change the status of PixelSelectorStatus?
-  memset(map_out,0,w*h*sizeof(PixelSelectorStatus));
-
   /// reduce the multiple of the pyramid layer threshold.
   /// dw: Down Weights.
   float dw1 = setting_gradDownweightPerLevel;   // 0.75, second level.
@@ -390,7 +554,7 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
   //x4, y4; x3, y3; x2, y2; x1, y1, what's the difference?
   int n3=0, n2=0, n4=0;
   /// in the second level, select a point to traverse every pot.
-  for(int y4=0; y4<h; y4+=(4*pot))
+  for(int y4=min*4*pot; y4<h && y4<max*4*pot; y4+=(4*pot))
     for(int x4=0; x4<w; x4+=(4*pot)) {
       /// the size of the neighborhood of the point (take up 4pot or the remainder at the end).
       int my3 = std::min((4*pot), h-y4);
@@ -398,9 +562,9 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
 
       int bestIdx4=-1; float bestVal4=0;
 
-      /// random coefficient.
-      /// take the lower 4 bits, 0-15, corresponding to directions.
-      Vec2f dir4 = directions[randomPattern[n2] & 0xF];
+      /// random coefficient, drawn per cell from the fixed random pattern so that bands do not depend on each other.
+      /// 4 bits, 0-15, corresponding to directions.
+      Vec2f dir4 = directions[(randomPattern[x4+y4*w] >> 4) & 0xF];
 
       /// within the range of the above, iterate on the first layer, every other point.
       for(int y3=0; y3<my3; y3+=(2*pot))
@@ -415,7 +579,7 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
 
           int bestIdx3=-1; float bestVal3=0;
 
-          Vec2f dir3 = directions[randomPattern[n2] & 0xF];
+          Vec2f dir3 = directions[(randomPattern[x34+y34*w] >> 2) & 0xF];
 
           /// in the neighborhood above, transform to level 0, traverse every pot.
           /// ! the largest pixel in each pot size grid that is greater than the threshold.
@@ -430,7 +594,7 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
 
               int bestIdx2=-1; float bestVal2=0;
 
-              Vec2f dir2 = directions[randomPattern[n2] & 0xF];
+              Vec2f dir2 = directions[randomPattern[x234+y234*w] & 0xF];
 
               /// in level 0, traversal within the pot size neighborhood.
               for(int y1=0;y1<my1;y1+=1)
@@ -532,7 +696,9 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
     }
 
   /// number of points selected at levels 0,1,2.
-  return Eigen::Vector3i(n2, n3, n4);
+  (*stats)[0] += n2;
+  (*stats)[1] += n3;
+  (*stats)[2] += n4;
 }
 
 
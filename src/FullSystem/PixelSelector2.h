@@ -25,6 +25,7 @@
 #pragma once
  
 #include "util/NumType.h"
+#include "util/IndexThreadReduce.h"
 
 namespace dso
 {
@@ -50,11 +51,23 @@ class PixelSelector
 
   bool allowFast;
   void makeHists(const FrameHessian* const fh);
+
+  /// Threads used for histograms / selection in row bands. 0 = single threaded.
+  IndexThreadReduce<Vec10>* red;
  private:
 
   Eigen::Vector3i select(const FrameHessian* const fh,
                          float* map_out, int pot, float thFactor=1);
 
+  void makeHistsReductor(const FrameHessian* const fh, int min, int max, Vec10* stats, int tid);
+  void selectReductor(const FrameHessian* const fh, float* map_out, int pot, float thFactor,
+                      int min, int max, Vec10* stats, int tid);
+  void makeCandidateMaskReductor(const FrameHessian* const fh, float thFactor, int min, int max, Vec10* stats, int tid);
+  void countCandidatesReductor(int potFirst, int min, int max, Vec10* stats, int tid);
+  int countCandidates(int pot);
+
+  /// Per pixel: bit 0/1/2 set if the pixel passes the level 0/1/2 gradient threshold.
+  unsigned char* candidateMask;
 
   unsigned char* randomPattern;
 
@@ -0,0 +1,85 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "FullSystem/ResidualTable.h"
+#include "FullSystem/HessianBlocks.h"
+#include "FullSystem/Residuals.h"
+#include "OptimizationBackend/EnergyFunctionalStructs.h"
+
+namespace dso
+{
+
+/// host and target index must be valid for the window, they index the pair offsets directly.
+static inline bool inWindow(const PointFrameResidual* r, int nFrames)
+{
+  return r->host->idx >= 0 && r->host->idx < nFrames && r->target->idx >= 0 && r->target->idx < nFrames;
+}
+
+int ResidualTable::build(const std::vector<FrameHessian*> &frames)
+{
+  nFrames = frames.size();
+  const int nPairs = nFrames*nFrames;
+
+  // pass 1: count the active residuals per (host,target) pair.
+  pairBegin.assign(nPairs+1, 0);
+  int numLinearized = 0;
+  for(FrameHessian* fh : frames)
+    for(PointHessian* ph : fh->pointHessians)
+      for(PointFrameResidual* r : ph->residuals)
+      {
+        if(r->efResidual->isLinearized) { numLinearized++; continue; }
+        if(!inWindow(r, nFrames)) {
+          printf("ResidualTable: residual %d -> %d outside the window of %d frames, skipped!\n",
+                 r->host->idx, r->target->idx, nFrames);
+          continue;
+        }
+        pairBegin[r->host->idx*nFrames + r->target->idx + 1]++;
+      }
+
+  for(int p=0;p<nPairs;p++)
+    pairBegin[p+1] += pairBegin[p];
+
+  const int n = pairBegin[nPairs];
+  res.resize(n);
+  hostIdx.resize(n);
+  targetIdx.resize(n);
+
+  // pass 2: scatter, keeping the point order within a pair.
+  pairFill.assign(pairBegin.begin(), pairBegin.end()-1);
+  for(FrameHessian* fh : frames)
+    for(PointHessian* ph : fh->pointHessians)
+      for(PointFrameResidual* r : ph->residuals)
+      {
+        if(r->efResidual->isLinearized || !inWindow(r, nFrames)) continue;
+        int k = pairFill[r->host->idx*nFrames + r->target->idx]++;
+        res[k] = r;
+        hostIdx[k] = r->host->idx;
+        targetIdx[k] = r->target->idx;
+        r->resetOOB();
+      }
+
+  return numLinearized;
+}
+
+}
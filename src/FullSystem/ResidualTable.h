@@ -0,0 +1,80 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include "util/NumType.h"
+#include "vector"
+
+namespace dso
+{
+
+struct FrameHessian;
+class PointFrameResidual;
+
+/// Flat table of the active (not yet linearized) residuals of the window.
+/// Rebuilt at the start of every window optimization; residuals are grouped by (host,target) pair,
+/// so consecutive entries share the same FrameFramePrecalc and all residuals on one target frame
+/// can be found without a scan; host / target indices are kept in flat arrays next to the pointers.
+/// Storage is reused between rebuilds, nothing is reallocated once the window reached its peak size.
+class ResidualTable
+{
+ public:
+  ResidualTable() : nFrames(0) {}
+
+  /// collects the residuals of all points of frames that are not linearized yet, sorted by pair,
+  /// and resets their state (resetOOB). Returns the number of skipped (linearized) residuals.
+  int build(const std::vector<FrameHessian*> &frames);
+
+  void clear()
+  {
+    res.clear();
+    hostIdx.clear();
+    targetIdx.clear();
+    pairBegin.assign(1, 0);
+    nFrames = 0;
+  }
+
+  inline int size() const { return res.size(); }
+  inline PointFrameResidual* operator[](int k) const { return res[k]; }
+  inline std::vector<PointFrameResidual*>::const_iterator begin() const { return res.begin(); }
+  inline std::vector<PointFrameResidual*>::const_iterator end() const { return res.end(); }
+
+  /// residuals of pair (h,t) are [pairBegin[h*nFrames+t], pairBegin[h*nFrames+t+1]).
+  inline int pairStart(int h, int t) const { return pairBegin[h*nFrames+t]; }
+  inline int pairEnd(int h, int t) const { return pairBegin[h*nFrames+t+1]; }
+
+  int nFrames;
+
+  std::vector<PointFrameResidual*> res;
+  /// FrameHessian::idx of host / target of res[k].
+  std::vector<int> hostIdx;
+  std::vector<int> targetIdx;
+  /// offsets per (host,target) pair, nFrames*nFrames+1 entries.
+  std::vector<int> pairBegin;
+
+ private:
+  std::vector<int> pairFill;
+};
+
+}
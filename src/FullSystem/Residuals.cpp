@@ -77,10 +77,55 @@ PointFrameResidual::PointFrameResidual(PointHessian* point_, FrameHessian* host_
   assert(((long)J)%16==0);  /// 16-bit alignment.
 
   isNew=true;
+  linReused=false;
+  lin_valid=false;
+  lin_JInEF=false;
 }
 
-/// find the derivative of each parameter, and the energy value.
+/// lazy relinearization: the result only depends on the host / target / point / calib state
+/// (through the FrameFramePrecalc), and the energy threshold.
 double PointFrameResidual::linearize(CalibHessian* HCalib) {
+  float energyTH = std::max<float>(host->frameEnergyTH, target->frameEnergyTH);
+
+  linReused = state_state != ResState::OOB && lin_valid &&
+      lin_hostVersion == host->linVersion &&
+      lin_targetVersion == target->linVersion &&
+      lin_pointVersion == point->linVersion &&
+      lin_calibVersion == HCalib->linVersion &&
+      lin_energyTH == energyTH;
+
+  if(linReused) {
+    state_NewState = lin_state;
+    state_NewEnergyWithOutlier = lin_energyWithOutlier;
+    if(lin_state == ResState::OOB)
+      return state_energy;
+
+    /// the jacobians were swapped into efResidual, get them back.
+    if(lin_JInEF) {
+      *J = *(efResidual->J);
+      lin_JInEF = false;
+    }
+    state_NewEnergy = lin_energy;
+    return lin_energy;
+  }
+
+  double energy = linearizeFull(HCalib);
+
+  lin_valid = state_state != ResState::OOB;
+  lin_hostVersion = host->linVersion;
+  lin_targetVersion = target->linVersion;
+  lin_pointVersion = point->linVersion;
+  lin_calibVersion = HCalib->linVersion;
+  lin_energyTH = energyTH;
+  lin_state = state_NewState;
+  lin_energy = state_NewEnergy;
+  lin_energyWithOutlier = state_NewEnergyWithOutlier;
+  lin_JInEF = false;
+  return energy;
+}
+
+/// find the derivative of each parameter, and the energy value.
+double PointFrameResidual::linearizeFull(CalibHessian* HCalib) {
   state_NewEnergyWithOutlier=-1;
 
   if(state_state == ResState::OOB) {
@@ -374,6 +419,7 @@ void PointFrameResidual::applyRes(bool copyJacobians) {
     if(state_NewState == ResState::IN) {
       efResidual->isActiveAndIsGoodNEW=true;
       efResidual->takeDataF(); /// take jacobian data from the current.
+      lin_JInEF = !lin_JInEF;   /// swapped, not copied.
     }
     else {
       efResidual->isActiveAndIsGoodNEW=false;
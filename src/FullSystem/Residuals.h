@@ -29,6 +29,7 @@
 #include "vector"
  
 #include "util/NumType.h"
+#include "util/ObjectPool.h"
 #include <iostream>
 #include <fstream>
 #include "util/globalFuncs.h"
@@ -56,7 +57,7 @@ struct FullJacRowT
 class PointFrameResidual
 {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  DSO_POOL_OPERATOR_NEW(PointFrameResidual)
 
   EFResidual* efResidual;
 
@@ -100,8 +101,18 @@ class PointFrameResidual
   ~PointFrameResidual();
   PointFrameResidual();
   PointFrameResidual(PointHessian* point_, FrameHessian* host_, FrameHessian* target_);
+
+  /// linearizes, or reuses the last linearization if none of its inputs changed (lazy relinearization).
   double linearize(CalibHessian* HCalib);
 
+  /// whether the last linearize() reused the previous result.
+  bool linReused;
+  /// forget the cached linearization, the next linearize() is a full one.
+  inline void invalidateLinearization() {
+    lin_valid = false;
+    lin_JInEF = false;
+  }
+
 
   void resetOOB()
   {
@@ -115,6 +126,19 @@ class PointFrameResidual
   void debugPlot();
 
   void printRows(std::vector<VecX> &v, VecX &r, int nFrames, int nPoints, int M, int res);
+
+ private:
+  double linearizeFull(CalibHessian* HCalib);
+
+  /// input versions (host, target, point, calib) and energy threshold of the cached linearization.
+  bool lin_valid;
+  int lin_hostVersion, lin_targetVersion, lin_pointVersion, lin_calibVersion;
+  float lin_energyTH;
+  /// cached result. J itself is kept here, or currently swapped into efResidual by applyRes() (lin_JInEF).
+  ResState lin_state;
+  double lin_energy;
+  double lin_energyWithOutlier;
+  bool lin_JInEF;
 };
 }
 
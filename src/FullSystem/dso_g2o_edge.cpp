@@ -2,214 +2,236 @@
 
 namespace dso {
 
-void EdgeLBASE3PosePhotoIdepthCamDSO::computeError() {
-  const VertexSE3PoseDSO* vertex_pose = static_cast<const VertexSE3PoseDSO*>(_vertices[0]);
-  const VertexPhotometricDSO* vertex_photo = static_cast<const VertexPhotometricDSO*>(_vertices[1]);
-  VertexInverseDepthDSO* vertex_idepth = static_cast<VertexInverseDepthDSO*>(_vertices[2]);
-  const VertexCamDSO* vertex_cam = static_cast<const VertexCamDSO*>(_vertices[3]);
+EdgeLBAPrecalc::EdgeLBAPrecalc()
+    : host(0), target(0), stamp(0),
+      vtx_pose_(0), vtx_photo_(0), vtx_cam_(0),
+      pose_version_(-1), photo_version_(-1), cam_version_(-1)
+{}
+
+void EdgeLBAPrecalc::set(FrameHessian* host, FrameHessian* target,
+                         const VertexSE3PoseDSO* vtx_pose, const VertexPhotometricDSO* vtx_photo, const VertexCamDSO* vtx_cam) {
+  this->host = host;
+  this->target = target;
+  vtx_pose_ = vtx_pose;
+  vtx_photo_ = vtx_photo;
+  vtx_cam_ = vtx_cam;
+  pose_version_ = photo_version_ = cam_version_ = -1;
+  update();
+}
 
-  double idepth = vertex_idepth->estimate();
+void EdgeLBAPrecalc::update() {
+  if(pose_version_ == vtx_pose_->version() &&
+     photo_version_ == vtx_photo_->version() &&
+     cam_version_ == vtx_cam_->version())
+    return;
 
-  Vec4 vecK = vertex_cam->estimate();
-  double fx = vecK(0);
-  double fy = vecK(1);
-  double cx = vecK(2);
-  double cy = vecK(3);
-  Mat33f K;
-  K << fx,0,cx,
-      0,fy,cy,
-      0,0,1;
+  Vec4 vecK = vtx_cam_->estimate();
+  fx = vecK(0);
+  fy = vecK(1);
+  cx = vecK(2);
+  cy = vecK(3);
+  fxi = 1.0f / fx;
+  fyi = 1.0f / fy;
 
-  SE3 Ttw = r_->target->PRE_worldToCam;
-  //// Tth = Ttw * Twh
-  SE3 Tth = Ttw * vertex_pose->estimate();
+  //// Tth = Ttw * Twh. the target is not a vertex of the window, its pose stays fixed during the solve.
+  SE3 Tth = target->PRE_worldToCam * vtx_pose_->estimate();
+  R = (Tth.rotationMatrix()).cast<float>();
+  t = (Tth.translation()).cast<float>();
 
-  Mat33f R = (Tth.rotationMatrix()).cast<float>();
-  Vec3f t = (Tth.translation()).cast<float>();
+  ab = AffLight::fromToVecExposure(host->ab_exposure, target->ab_exposure,
+                                   vtx_photo_->estimate(), target->aff_g2l()).cast<float>();
 
-  //----------------
-  float energyLeft=0;
-  float wJI2_sum=0;
-  //----------------
+  pose_version_ = vtx_pose_->version();
+  photo_version_ = vtx_photo_->version();
+  cam_version_ = vtx_cam_->version();
+  stamp++;
+}
 
-  for(int idx=0; idx<patternNum; idx++) {
-    double u_host = r_->point->u + patternP[idx][0];
-    double v_host = r_->point->v + patternP[idx][1];
+//===============================================================================
 
-    Vec3f Klip = Vec3f((u_host - cx)/fx,
-                       (v_host - cy)/fy,
-                       1);
+void EdgeLBASE3PosePhotoIdepthCamDSO::projectPattern() {
+  const VertexInverseDepthDSO* vertex_idepth = static_cast<const VertexInverseDepthDSO*>(_vertices[2]);
+  double idepth = vertex_idepth->estimate();
+
+  precalc_->update();
+  if(cache_stamp_ == precalc_->stamp &&
+     (cache_idepth_ == idepth || fabs(cache_idepth_ - idepth) <= setting_lazyRelinTH))
+    return;
 
-    Vec3f ptp = R*Klip + t*idepth;
+  cache_stamp_ = precalc_->stamp;
+  cache_idepth_ = idepth;
+  cache_behind_ = false;
+  cache_n_ = patternNum;
+  eval_valid_ = false;
+  jac_valid_ = false;
+
+  const EdgeLBAPrecalc &pc = *precalc_;
+  const Vec3f tId = pc.t*(float)idepth;
+  const Eigen::Vector3f* dIl = r_->target->dI;
+
+  for(int idx=0; idx<patternNum; idx++) {
+    float u_host = r_->point->u + patternP[idx][0];
+    float v_host = r_->point->v + patternP[idx][1];
+
+    Vec2f Klip((u_host - pc.cx)*pc.fxi, (v_host - pc.cy)*pc.fyi);
+    Vec3f ptp = pc.R*Vec3f(Klip[0], Klip[1], 1) + tId;
 
     //// drescale = idepth_new / idepth_old
-    double drescale = 1.0f / ptp[2];
+    float drescale = 1.0f / ptp[2];
 
     if(drescale <= 0) {
-      r_->state_NewState = ResState::OOB;
-      _error.setZero();
+      cache_behind_ = true;
+      cache_n_ = idx;
       return;
     }
-    double new_idepth = idepth*drescale;
 
-    double _u = ptp[0]*drescale;
-    double _v = ptp[1]*drescale;
-    double _Ku = _u*fx + cx;
-    double _Kv = _v*fy + cy;
+    float _u = ptp[0]*drescale;
+    float _v = ptp[1]*drescale;
+    float _Ku = _u*pc.fx + pc.cx;
+    float _Kv = _v*pc.fy + pc.cy;
 
     if(util::CheckBoundary(_Ku, _Kv, wG[0]-3, hG[0]-3)) {
-      r_->state_NewState = ResState::OOB;
-      _error.setZero();
-      this->setLevel(1);
+      cache_n_ = idx;
       return;
     }
-    else if(u_host == r_->point->u && v_host == r_->point->v) {
-      //// set CenterProjectedTo_ variable.
-      vertex_idepth->SetCenterProjectedTo(_Ku, _Kv, new_idepth);
-    }
 
-    const Eigen::Vector3f* dIl = r_->target->dI;
+    cache_Klip_[idx] = Klip;
+    cache_u_[idx] = _u;
+    cache_v_[idx] = _v;
+    cache_Ku_[idx] = _Ku;
+    cache_Kv_[idx] = _Kv;
+    cache_drescale_[idx] = drescale;
 
     // interpolate on new frame.
     // hitcolor ([0]: intensity, [1]: dx, [2]: dy)
-    Vec3f hitcolor = getInterpolatedElement33(dIl, _Ku, _Kv, wG[0]);
+    cache_hitColor_[idx] = getInterpolatedElement33(dIl, _Ku, _Kv, wG[0]);
+  }
+}
+
+bool EdgeLBASE3PosePhotoIdepthCamDSO::Evaluate() {
+  projectPattern();
+  if(eval_valid_) return true;
+  eval_valid_ = true;
+  eval_hasCenter_ = false;
+
+  if(cache_n_ < patternNum) {
+    eval_state_ = ResState::OOB;
+    eval_outOfImage_ = !cache_behind_;
+    eval_error_.setZero();
+    return false;
+  }
+  eval_outOfImage_ = false;
+
+  const Vec2f &ab = precalc_->ab;
+
+  //----------------
+  float energyLeft=0;
+  float wJI2_sum=0;
+  //----------------
+
+  for(int idx=0; idx<patternNum; idx++) {
+    if(patternP[idx][0] == 0 && patternP[idx][1] == 0) {
+      eval_hasCenter_ = true;
+      eval_center_ = Vec3f(cache_Ku_[idx], cache_Kv_[idx], cache_idepth_*cache_drescale_[idx]);
+    }
+
+    const Vec3f &hitcolor = cache_hitColor_[idx];
 
     // check if intensity is invalid.
     if(!std::isfinite((float)hitcolor[0])) {
-      r_->state_NewState = ResState::OOB;
-      _error(idx) = 0;
+      eval_error_(idx) = 0;
       continue;
     }
 
-#if 1
-    // photometric parameter.
-    AffLight a0b0 = vertex_photo->estimate();
-    AffLight a1b1 = r_->target->aff_g2l();
-    double ab_exposure_host = r_->host->ab_exposure;
-    double ab_exposure_target = r_->target->ab_exposure;
-
-    Vec2f ab = AffLight::fromToVecExposure(ab_exposure_host, ab_exposure_target, a0b0, a1b1).cast<float>();
-#else
-    Vec2f ab;
-    ab<<1,0;
-#endif
-
     // calculate photometric error.
-    _error(idx) = hitcolor[0] - (ab[0]*_measurement(idx) + ab[1]);
-
-#if 0
-    std::cout << "_error("<<idx<<"): " << _error(idx) << std::endl;
-    std::cout << "hitcolor[0]: " << hitcolor[0] << ", ab[0]: " << ab[0] << ", _measurement("<<idx<<"): "<<_measurement(idx) << ", ab[1]: " << ab[1] << std::endl;
-#endif
+    eval_error_(idx) = hitcolor[0] - (ab[0]*_measurement(idx) + ab[1]);
 
     /// weight proportional to gradient size
     float w = sqrtf(setting_outlierTHSumComponent / (setting_outlierTHSumComponent + hitcolor.tail<2>().squaredNorm()));
     w = 0.5f*(w + r_->point->weights[idx]);
 
     /// huber function, energy value (chi2)
-    float hw = fabsf((float)_error(idx)) < setting_huberTH ? 1 : setting_huberTH / fabsf((float)_error(idx));
-    energyLeft += w*w*hw*_error(idx)*_error(idx)*(2 - hw);
+    float hw = fabsf((float)eval_error_(idx)) < setting_huberTH ? 1 : setting_huberTH / fabsf((float)eval_error_(idx));
+    energyLeft += w*w*hw*eval_error_(idx)*eval_error_(idx)*(2 - hw);
     /// squared gradient.
     wJI2_sum += hw*hw*(hitcolor[1]*hitcolor[1] + hitcolor[2]*hitcolor[2]);
   }
 
-  r_->state_NewEnergyWithOutlier = energyLeft;
+  eval_energyWithOutlier_ = energyLeft;
 
   /// is greater than the threshold value.
   if(energyLeft > std::max<float>(r_->host->frameEnergyTH, r_->target->frameEnergyTH) || wJI2_sum < 2)
   {
     energyLeft = std::max<float>(r_->host->frameEnergyTH, r_->target->frameEnergyTH);
-    r_->state_NewState = ResState::OUTLIER;
+    eval_state_ = ResState::OUTLIER;
   }
   else {
-    r_->state_NewState = ResState::IN;
+    eval_state_ = ResState::IN;
   }
-  r_->state_NewEnergy = energyLeft;
+  eval_energy_ = energyLeft;
+  return false;
 }
 
-void EdgeLBASE3PosePhotoIdepthCamDSO::linearizeOplus() {
-  if(level() == 1 || r_->state_NewState == ResState::OOB) {
+void EdgeLBASE3PosePhotoIdepthCamDSO::computeError() {
+  Evaluate();
+
+  _error = eval_error_;
+  r_->state_NewState = eval_state_;
+
+  if(eval_state_ == ResState::OOB) {
+    if(eval_outOfImage_) {
+      // set as outlier if out of boundary.
+      this->setLevel(1);
+    }
     return;
   }
 
-  const VertexSE3PoseDSO* vertex_pose = static_cast<const VertexSE3PoseDSO*>(_vertices[0]);
-  const VertexPhotometricDSO* vertex_photo = static_cast<const VertexPhotometricDSO*>(_vertices[1]);
-  VertexInverseDepthDSO* vertex_idepth = static_cast<VertexInverseDepthDSO*>(_vertices[2]);
-  const VertexCamDSO* vertex_cam = static_cast<const VertexCamDSO*>(_vertices[3]);
+  if(eval_hasCenter_) {
+    //// set CenterProjectedTo_ variable.
+    VertexInverseDepthDSO* vertex_idepth = static_cast<VertexInverseDepthDSO*>(_vertices[2]);
+    vertex_idepth->SetCenterProjectedTo(eval_center_[0], eval_center_[1], eval_center_[2]);
+  }
 
-  Eigen::Matrix<double,2,4> J_dp2_dC;
-  Eigen::Matrix<double,1,2> J_dr_dp2;
-  Eigen::Matrix<double,8,4> J_dr_dC;
+  r_->state_NewEnergyWithOutlier = eval_energyWithOutlier_;
+  r_->state_NewEnergy = eval_energy_;
+}
 
-  Eigen::Matrix<double,8,6> J_dr_dxi;
+bool EdgeLBASE3PosePhotoIdepthCamDSO::EvaluateJacobians() {
+  projectPattern();
+  if(jac_valid_) return true;
+  jac_valid_ = true;
+  jac_ok_ = false;
 
-  Eigen::Matrix<double,8,2> J_dr_dphoto;
+  if(cache_n_ < patternNum) {
+    return false;
+  }
 
-  Eigen::Matrix<double,8,1> J_dr_didepth;
+  Eigen::Matrix<double,2,4> J_dp2_dC;
+  Eigen::Matrix<double,1,2> J_dr_dp2;
   float H_idepth_idepth = 0;
 
-  double idepth = vertex_idepth->estimate();
-
-  Vec4 vecK = vertex_cam->estimate();
-  double fx = vecK(0);
-  double fy = vecK(1);
-  double cx = vecK(2);
-  double cy = vecK(3);
-  Mat33f K;
-  K << fx,0,cx,
-      0,fy,cy,
-      0,0,1;
-
-  SE3 Ttw = r_->target->PRE_worldToCam;
-  //// Tth = Ttw * Twh
-  SE3 Tth = Ttw * vertex_pose->estimate();
-
-  Mat33f R = (Tth.rotationMatrix()).cast<float>();
-  Vec3f t = (Tth.translation()).cast<float>();
+  const EdgeLBAPrecalc &pc = *precalc_;
+  const Mat33f &R = pc.R;
+  const Vec3f &t = pc.t;
+  const double fx = pc.fx;
+  const double fy = pc.fy;
+  const double fxi = pc.fxi;
+  const double fyi = pc.fyi;
 
   for(int idx=0; idx<patternNum; idx++) {
-    double u_host = r_->point->u + patternP[idx][0];
-    double v_host = r_->point->v + patternP[idx][1];
-
-    Vec3f Klip = Vec3f((u_host - cx)/fx,
-                       (v_host - cy)/fy,
-                       1);
-
-    Vec3f ptp = R*Klip + t*idepth;
-
-    //// drescale = idepth_new / idepth_old
-    double drescale = 1.0f / ptp[2];
-
-    if(drescale <= 0) {
-      r_->state_NewState = ResState::OOB;
-      return;
-    }
-    double new_idepth = idepth*drescale;
-
-    double _u = ptp[0]*drescale;
-    double _v = ptp[1]*drescale;
-    double _Ku = _u*fx + cx;
-    double _Kv = _v*fy + cy;
-
-    if(util::CheckBoundary(_Ku, _Kv, wG[0]-3, hG[0]-3)) {
-      r_->state_NewState = ResState::OOB;
-      return;
-    }
-
-    const Eigen::Vector3f* dIl = r_->target->dI;
-
-    // hitcolor ([0]: intensity, [1]: dx, [2]: dy)
-    Vec3f hitcolor = getInterpolatedElement33(dIl, _Ku, _Kv, wG[0]);
+    const Vec3f &hitcolor = cache_hitColor_[idx];
     // check if intensity is invalid.
     if(!std::isfinite((float)hitcolor[0])) {
-      r_->state_NewState = ResState::OOB;
-      return;
+      return false;
     }
 
-    // camera intrinsics----------------------------------------
-    double fxi = 1/fx;
-    double fyi = 1/fy;
+    const Vec2f &Klip = cache_Klip_[idx];
+    double drescale = cache_drescale_[idx];
+    double new_idepth = cache_idepth_*drescale;
+    double _u = cache_u_[idx];
+    double _v = cache_v_[idx];
 
+    // camera intrinsics----------------------------------------
     J_dr_dp2(0,0) = hitcolor[1];
     J_dr_dp2(0,1) = hitcolor[2];
 
@@ -225,7 +247,7 @@ void EdgeLBASE3PosePhotoIdepthCamDSO::linearizeOplus() {
     J_dp2_dC(1,1) = Klip[1]*J_dp2_dC(1,3);
 
     //// 8*(1x4) = 8*(1x2 * 2x4)
-    J_dr_dC.block<1,4>(idx,0) = J_dr_dp2 * J_dp2_dC;
+    jac_cam_.block<1,4>(idx,0) = J_dr_dp2 * J_dp2_dC;
     // ---------------------------------------------------------
 
     // pose-----------------------------------------------
@@ -233,162 +255,88 @@ void EdgeLBASE3PosePhotoIdepthCamDSO::linearizeOplus() {
     double dy = hitcolor[2]*fy;
 
     /// translation part.
-    J_dr_dxi(idx,0) = new_idepth * dx;
-    J_dr_dxi(idx,1) = new_idepth * dy;
-    J_dr_dxi(idx,2) = -new_idepth * (_u*dx + _v*dy);
+    jac_xi_(idx,0) = new_idepth * dx;
+    jac_xi_(idx,1) = new_idepth * dy;
+    jac_xi_(idx,2) = -new_idepth * (_u*dx + _v*dy);
     /// rotation part.
-    J_dr_dxi(idx,3) = -(_u*_v*dx + (1 + _v*_v)*dy);
-    J_dr_dxi(idx,4) = _u*_v*dy + (1 + _u*_u)*dx;
-    J_dr_dxi(idx,5) = _u*dy - _v*dx;
+    jac_xi_(idx,3) = -(_u*_v*dx + (1 + _v*_v)*dy);
+    jac_xi_(idx,4) = _u*_v*dy + (1 + _u*_u)*dx;
+    jac_xi_(idx,5) = _u*dy - _v*dx;
     // ---------------------------------------------------------
 
     // photometric parameters a,b-------------------------------
-    // calculate jacobian of affine brightness function.
-    AffLight a0b0 = vertex_photo->estimate();
-    AffLight a1b1 = r_->target->aff_g2l();
-
-    double ab_exposure_host = r_->host->ab_exposure;
-    double ab_exposure_target = r_->target->ab_exposure;
-
-    Vec2f ab = AffLight::fromToVecExposure(ab_exposure_host, ab_exposure_target, a0b0, a1b1).cast<float>();
-
-    J_dr_dphoto(idx,0) = ab[0]*(b0_ - _measurement(idx));
-    J_dr_dphoto(idx,1) = -1;
+    // jacobian of affine brightness function.
+    jac_photo_(idx,0) = pc.ab[0]*(b0_ - _measurement(idx));
+    jac_photo_(idx,1) = -1;
     // ---------------------------------------------------------
 
     // inverse depth------------------------------
     // jacobian for inverse depth. dr/dinvd
-    J_dr_didepth(idx,0) = dx*drescale*(t[0] - t[2]*_u) + dy*drescale*(t[1] - t[2]*_v);
+    jac_idepth_(idx,0) = dx*drescale*(t[0] - t[2]*_u) + dy*drescale*(t[1] - t[2]*_v);
     // ---------------------------------------------------------
 
-    H_idepth_idepth += J_dr_didepth(idx,0) * J_dr_didepth(idx,0);
+    H_idepth_idepth += jac_idepth_(idx,0) * jac_idepth_(idx,0);
   }
 
   if(H_idepth_idepth < 1e-10) {
     H_idepth_idepth = 1e-10;
   }
-  r_->point->idepth_hessian = H_idepth_idepth;
-
-#if 0
-  std::cout << "J_dr_dxi: " << J_dr_dxi << std::endl;
-  std::cout << "J_dr_dphoto: " << J_dr_dphoto << std::endl;
-  std::cout << "J_dr_didepth: " << J_dr_didepth << std::endl << std::endl;
-#endif
-
-  _jacobianOplus[0] = J_dr_dxi;
-  _jacobianOplus[1] = J_dr_dphoto;
-  _jacobianOplus[2] = J_dr_didepth;
-  _jacobianOplus[3] = J_dr_dC;
+  jac_Hdd_ = H_idepth_idepth;
+  jac_ok_ = true;
+  return false;
 }
 
-#if 0
-void EdgeLBASE3PosePhotoIdepthCamDSO::projectPoint() {
-  const VertexSE3PoseDSO* vertex_pose = static_cast<const VertexSE3PoseDSO*>(_vertices[0]);
-  const VertexCamDSO* vertex_cam = static_cast<const VertexCamDSO*>(_vertices[3]);
-  VertexInverseDepthDSO* vertex_idepth = static_cast<VertexInverseDepthDSO*>(_vertices[2]);
-
-  SE3 Ttw = r_->target->get_worldToCam_evalPT();
-  //// Tth = Ttw * Twh
-  SE3 Tth = Ttw * vertex_pose->estimate();
-  R = (Tth.rotationMatrix()).cast<float>();
-  t = (Tth.translation()).cast<float>();
-
-  double idepth = vertex_idepth->estimate();
-  Vec4 vecK = vertex_cam->estimate();
-  double fx = vecK(0);
-  double fy = vecK(1);
-  double cx = vecK(2);
-  double cy = vecK(3);
-
-  Mat33f K;
-  K << fx,0,cx,
-      0,fy,cy,
-      0,0,1;
-
-  Mat33f KRKi = K*R*K.inverse();
-  Vec3f Kt = K*t;
-
-  double u_host = r_->point->u;
-  double v_host = r_->point->v;
-
-  Klip_ = Vec3f((u_host - cx)/fx,
-                (v_host - cy)/fy,
-                1);
-
-  Vec3f ptp = R*Klip_ + t*idepth;
-
-  //// drescale = idepth_new / idepth_old
-  drescale_ = 1.0f / ptp[2];
+void EdgeLBASE3PosePhotoIdepthCamDSO::linearizeOplus() {
+  if(level() == 1 || r_->state_NewState == ResState::OOB) {
+    return;
+  }
 
-  if(drescale_ <= 0) {
+  //// normally a copy: the jacobians of this estimate were evaluated by EdgeLBAParallelAction.
+  EvaluateJacobians();
+  if(!jac_ok_) {
     r_->state_NewState = ResState::OOB;
     return;
   }
-  new_idepth_ = idepth*drescale_;
 
-  double _u = ptp[0] * drescale_;
-  double _v = ptp[1] * drescale_;
-  double _Ku = _u*fx + cx;
-  double _Kv = _v*fy + cy;
+  r_->point->idepth_hessian = jac_Hdd_;
 
-  if(util::CheckBoundary(_Ku, _Kv, wG[0]-3, hG[0]-3)) {
-    r_->state_NewState = ResState::OOB;
-    // set as outlier if out of boundary.
-    this->setLevel(1);
+  _jacobianOplus[0] = jac_xi_;
+  _jacobianOplus[1] = jac_photo_;
+  _jacobianOplus[2] = jac_idepth_;
+  _jacobianOplus[3] = jac_cam_;
+}
 
-    u_.at(0) = -1;
-    v_.at(0) = -1;
-    Ku_.at(0) = -1;
-    Kv_.at(0) = -1;
-    return;
+//===============================================================================
+
+::g2o::HyperGraphAction* EdgeLBAParallelAction::operator()(const ::g2o::HyperGraph* graph,
+                                                           ::g2o::HyperGraphAction::Parameters* parameters) {
+  //// the precalc blocks are shared between edges, bring them up to date before going parallel.
+  for(EdgeLBAPrecalc* pc : precalc)
+    pc->update();
+
+  double numReused = 0;
+  if(red_ != 0 && multiThreading) {
+    red_->reduce(boost::bind(&EdgeLBAParallelAction::evaluateReductor, this, _1, _2, _3, _4), 0, edges.size(), 50);
+    numReused = red_->stats[0];
   }
   else {
-    //// set CenterProjectedTo_ variable.
-    vertex_idepth->SetCenterProjectedTo(_Ku, _Kv, new_idepth_);
+    Vec10 stats = Vec10::Zero();
+    evaluateReductor(0, edges.size(), &stats, 0);
+    numReused = stats[0];
   }
 
-  for(int idx=0; idx<patternNum; idx++) {
-#if 0
-    Klip_ = Vec3f((u_host + patternP[idx][0] - cx)/fx,
-                  (v_host + patternP[idx][1] - cy)/fy,
-                  1);
-    Vec3f ptp = R*Klip_ + t*idepth;
-
-    double _u = ptp[0] / ptp[2];
-    double _v = ptp[1] / ptp[2];
-    double _Ku = _u*fx + cx;
-    double _Kv = _v*fy + cy;
-#else
-    double _u = u_host + patternP[idx][0];
-    double _v = v_host + patternP[idx][1];
-
-    Vec3f ptp = KRKi*Vec3f(_u, _v, 1) + Kt*idepth;
-
-    double _Ku = ptp[0] / ptp[2];
-    double _Kv = ptp[1] / ptp[2];
-#endif
-
-    if(util::CheckBoundary(_Ku, _Kv, wG[0]-3, hG[0]-3)) {
-      r_->state_NewState = ResState::OOB;
-      // set as outlier if out of boundary.
-      this->setLevel(1);
+  if(!setting_debugout_runquiet)
+    printf("G2O LBA %s: reused %d / %d edges\n", jacobians_ ? "jacobians" : "errors", (int)numReused, (int)edges.size());
 
-      u_.at(idx) = -1;
-      v_.at(idx) = -1;
-      Ku_.at(idx) = -1;
-      Kv_.at(idx) = -1;
-    }
-    else {
-      r_->state_NewState = ResState::IN;
+  return this;
+}
 
-      u_.at(idx) = _u;
-      v_.at(idx) = _v;
-      Ku_.at(idx) = _Ku;
-      Kv_.at(idx) = _Kv;
-    }
+void EdgeLBAParallelAction::evaluateReductor(int min, int max, Vec10* stats, int tid) {
+  for(int k=min; k<max; k++) {
+    bool reused = jacobians_ ? edges[k]->EvaluateJacobians() : edges[k]->Evaluate();
+    if(reused) (*stats)[0]++;
   }
 }
-#endif
 
 //===============================================================================
 
@@ -444,34 +392,6 @@ void EdgeSE3PosePhotoDSO::linearizeOplus() {
   // hitcolor ([0]: intensity, [1]: dx, [2]: dy)
   Vec3f hitcolor = getInterpolatedElement33(dINewl_, uv(0), uv(1), wl_);
 
-#if 0
-  // VERSION1 (3D point version)
-  double invz_2 = invz * invz;
-  // jacobian from se3 to u,v
-  // NOTE that in g2o the Lie algebra is (\omega, \epsilon), where \omega is so(3) and \epsilon the translation
-  Eigen::Matrix<double, 2, 6> jacobian_uv_ksai;
-
-  jacobian_uv_ksai(0,0) = invz *fx;
-  jacobian_uv_ksai(0,1) = 0;
-  jacobian_uv_ksai(0,2) = -x*invz_2 *fx;
-  jacobian_uv_ksai(0,3) = -x*y*invz_2 *fx;
-  jacobian_uv_ksai(0,4) = (1+(x*x*invz_2) ) *fx;
-  jacobian_uv_ksai(0,5) = -y*invz *fx;
-
-  jacobian_uv_ksai(1,0) = 0;
-  jacobian_uv_ksai(1,1) = invz *fy;
-  jacobian_uv_ksai(1,2) = -y*invz_2 *fy;
-  jacobian_uv_ksai(1,3) = -(1+y*y*invz_2) *fy;
-  jacobian_uv_ksai(1,4) = x*y*invz_2 *fy;
-  jacobian_uv_ksai(1,5) = x*invz *fy;
-
-  Eigen::Matrix<double, 1, 2> jacobian_pixel_uv;
-
-  jacobian_pixel_uv(0,0) = hitcolor[1];
-  jacobian_pixel_uv(0,1) = hitcolor[2];
-
-  _jacobianOplusXi = jacobian_pixel_uv * jacobian_uv_ksai;
-#else
   // VERSION2 (inverse depth version)
   double u = x*invz;
   double v = y*invz;
@@ -487,7 +407,6 @@ void EdgeSE3PosePhotoDSO::linearizeOplus() {
   _jacobianOplusXi(0,3) = -(u*v*dx + (1 + v*v)*dy);
   _jacobianOplusXi(0,4) = u*v*dy + (1 + u*u)*dx;
   _jacobianOplusXi(0,5) = u*dy - v*dx;
-#endif
 
   // photometric parameters.
   const VertexPhotometricDSO* vertex_photo = static_cast<const VertexPhotometricDSO*>(_vertices[1]);
@@ -617,4 +536,123 @@ void EdgeTracePointUVDSO::linearizeOplus() {
   // jacobian for inverse depth. dI/dp
   _jacobianOplusXi(0,0) = dx_*hitcolor[1] + dy_*hitcolor[2];
 }
+
+//===============================================================================
+
+EdgeMargPriorDSO::EdgeMargPriorDSO(const MatXX &HM, const VecX &bM, CalibHessian* HCalib, const std::vector<FrameHessian*> &frames)
+    : HCalib_(HCalib), frames_(frames)
+{
+  assert(HM.rows() == CPARS + 8*(int)frames.size());
+
+  /// HM is only positive semi-definite (gauge freedom, unobserved parameters), keep the informative directions.
+  Eigen::SelfAdjointEigenSolver<MatXX> eig(0.5*(HM + HM.transpose()));
+  const VecX &l = eig.eigenvalues();
+  const MatXX &V = eig.eigenvectors();
+  double lmin = std::max(1e-12, 1e-9*l.maxCoeff());
+
+  int rank = 0;
+  for(int i=0; i<l.size(); i++)
+    if(l[i] > lmin) rank++;
+
+  J_.resize(rank, HM.cols());
+  r_.resize(rank);
+  for(int i=l.size()-rank, k=0; i<l.size(); i++, k++) {
+    double sl = sqrt(l[i]);
+    J_.row(k) = sl * V.col(i).transpose();
+    r_[k] = V.col(i).dot(bM) / sl;
+  }
+}
+
+bool EdgeMargPriorDSO::SetVertices(VertexCamDSO* vtx_cam,
+                                   const std::vector<VertexSE3PoseDSO*> &vtx_pose,
+                                   const std::vector<VertexPhotometricDSO*> &vtx_photo)
+{
+  if(J_.rows() == 0) return false;
+
+  e0_ = r_;
+  frame_col_.clear();
+  frame_fh_.clear();
+
+  for(unsigned int h=0; h<frames_.size(); h++) {
+    int col = CPARS + 8*h;
+    if(h < vtx_pose.size() && vtx_pose[h] != 0) {
+      frame_col_.push_back(col);
+      frame_fh_.push_back(frames_[h]);
+    }
+    else {
+      //// no vertex in the graph: the frame stays where it is.
+      e0_ += J_.middleCols<8>(col) * frames_[h]->get_state_minus_stateZero().head<8>();
+    }
+  }
+
+  resize(1 + 2*frame_col_.size());
+  setVertex(0, vtx_cam);
+  for(unsigned int k=0, h=0; h<frames_.size(); h++) {
+    if(h < vtx_pose.size() && vtx_pose[h] != 0) {
+      setVertex(1 + 2*k, vtx_pose[h]);
+      setVertex(2 + 2*k, vtx_photo[h]);
+      k++;
+    }
+  }
+
+  setDimension(J_.rows());
+  setInformation(MatXX::Identity(J_.rows(), J_.rows()));
+  return true;
+}
+
+void EdgeMargPriorDSO::computeError() {
+  const VertexCamDSO* vertex_cam = static_cast<const VertexCamDSO*>(_vertices[0]);
+
+  //// [fx,fy,cx,cy] of the vertex are scaled values.
+  VecC deltaC = vertex_cam->estimate();
+  deltaC[0] *= SCALE_F_INVERSE;
+  deltaC[1] *= SCALE_F_INVERSE;
+  deltaC[2] *= SCALE_C_INVERSE;
+  deltaC[3] *= SCALE_C_INVERSE;
+  deltaC -= HCalib_->value_zero;
+
+  VecX e = e0_ + J_.leftCols<CPARS>() * deltaC;
+
+  for(unsigned int k=0; k<frame_col_.size(); k++) {
+    const VertexSE3PoseDSO* vertex_pose = static_cast<const VertexSE3PoseDSO*>(_vertices[1 + 2*k]);
+    const VertexPhotometricDSO* vertex_photo = static_cast<const VertexPhotometricDSO*>(_vertices[2 + 2*k]);
+    const FrameHessian* fh = frame_fh_[k];
+
+    //// Thw = exp(xi) * Thw_evalPT
+    Vec6 xi = (vertex_pose->estimate().inverse() * fh->get_worldToCam_evalPT().inverse()).log();
+
+    Vec8 delta;
+    delta.head<3>() = SCALE_XI_TRANS_INVERSE * xi.head<3>();
+    delta.segment<3>(3) = SCALE_XI_ROT_INVERSE * xi.tail<3>();
+    delta[6] = SCALE_A_INVERSE * vertex_photo->estimate().a;
+    delta[7] = SCALE_B_INVERSE * vertex_photo->estimate().b;
+    delta -= fh->get_state_zero().head<8>();
+
+    e += J_.middleCols<8>(frame_col_[k]) * delta;
+  }
+
+  _error = e;
+}
+
+void EdgeMargPriorDSO::linearizeOplus() {
+  _jacobianOplus[0] = J_.leftCols<CPARS>() *
+      Vec4(SCALE_F_INVERSE, SCALE_F_INVERSE, SCALE_C_INVERSE, SCALE_C_INVERSE).asDiagonal();
+
+  Vec6 scaleXi;
+  scaleXi << SCALE_XI_TRANS_INVERSE, SCALE_XI_TRANS_INVERSE, SCALE_XI_TRANS_INVERSE,
+      SCALE_XI_ROT_INVERSE, SCALE_XI_ROT_INVERSE, SCALE_XI_ROT_INVERSE;
+
+  for(unsigned int k=0; k<frame_col_.size(); k++) {
+    const FrameHessian* fh = frame_fh_[k];
+
+    //// Twh <== exp(u) * Twh  =>  Thw * Thw_evalPT^-1 <== exp(xi) * exp(-Adj(Thw_evalPT)*u).
+    //// first order at the linearization point, as in the FEJ of the EnergyFunctional.
+    Mat66 dxi_du = -(scaleXi.asDiagonal() * fh->get_worldToCam_evalPT().Adj());
+
+    _jacobianOplus[1 + 2*k] = J_.middleCols<6>(frame_col_[k]) * dxi_du;
+    _jacobianOplus[2 + 2*k] = J_.middleCols<2>(frame_col_[k] + 6) *
+        Vec2(SCALE_A_INVERSE, SCALE_B_INVERSE).asDiagonal();
+  }
+}
+
 } // namespace dso
@@ -7,6 +7,8 @@
 #include "util/NumType.h"
 #include "util/globalFuncs.h"
 #include "FullSystem/HessianBlocks.h"
+#include "FullSystem/Residuals.h"
+#include "util/IndexThreadReduce.h"
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -38,17 +40,60 @@
 
 namespace dso {
 
+/// \struct EdgeLBAPrecalc
+/// Values shared by all residuals of one (host,target) pair of the window BA, like FrameFramePrecalc.
+/// recomputed lazily whenever one of the vertices changed its estimate.
+struct EdgeLBAPrecalc {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+  FrameHessian* host;
+  FrameHessian* target;
+
+  /// \brief Tth = Ttw * Twh.
+  Mat33f R;
+  Vec3f t;
+
+  /// \brief Camera intrinsics and their inverse.
+  float fx, fy, cx, cy;
+  float fxi, fyi;
+
+  /// \brief Affine brightness from host to target.
+  Vec2f ab;
+
+  /// \brief Incremented every time the values above are recomputed.
+  int stamp;
+
+  EdgeLBAPrecalc();
+
+  void set(FrameHessian* host, FrameHessian* target,
+           const VertexSE3PoseDSO* vtx_pose, const VertexPhotometricDSO* vtx_photo, const VertexCamDSO* vtx_cam);
+
+  /// \brief Recompute if one of the vertices changed since the last call.
+  void update();
+
+ private:
+  const VertexSE3PoseDSO* vtx_pose_;
+  const VertexPhotometricDSO* vtx_photo_;
+  const VertexCamDSO* vtx_cam_;
+
+  /// \brief Versions of the vertices the values were computed for.
+  int pose_version_, photo_version_, cam_version_;
+};
+
 /// \class EdgeLBASE3PosePhotoIdepthCamDSO class.
-class EdgeLBASE3PosePhotoIdepthCamDSO : public ::g2o::BaseMultiEdge<8, Vec8f> {
+/// One row per pattern pixel, sized at compile time (patternNum).
+class EdgeLBASE3PosePhotoIdepthCamDSO : public ::g2o::BaseMultiEdge<patternNum, VecNRf> {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
   EdgeLBASE3PosePhotoIdepthCamDSO(PointFrameResidual* r)
-      : r_(r)
+      : r_(r), precalc_(0), cache_stamp_(-1), eval_valid_(false), jac_valid_(false)
   {}
 
+  /// \brief Publishes the result of Evaluate() to the residual (state, energy) and the idepth vertex.
   virtual void computeError();
 
+  /// \brief Publishes the result of EvaluateJacobians().
   virtual void linearizeOplus();
 
   // deprecated.
@@ -57,10 +102,124 @@ class EdgeLBASE3PosePhotoIdepthCamDSO : public ::g2o::BaseMultiEdge<8, Vec8f> {
 
   void SetB(double b0) { b0_ = b0; }
 
+  /// \brief Precalc block of (host,target), must be set before the first evaluation.
+  void SetPrecalc(EdgeLBAPrecalc* precalc) { precalc_ = precalc; }
+
+  /// \brief Error and energy at the current estimate. only writes members of this edge, so edges
+  /// can be evaluated in parallel as long as their precalc blocks are up to date.
+  /// returns true if the previous result was reused (lazy relinearization).
+  bool Evaluate();
+
+  /// \brief Jacobians at the current estimate, same rules as Evaluate().
+  bool EvaluateJacobians();
+
  private:
+  /// \brief Project the pattern into the target and sample it, if the precalc block changed or the
+  /// idepth moved more than setting_lazyRelinTH since the last call. invalidates the results of Evaluate() and EvaluateJacobians().
+  void projectPattern();
+
   PointFrameResidual* r_;
 
   double b0_;
+
+  EdgeLBAPrecalc* precalc_;
+
+  /// \brief Cached projection of the pattern (normalized and pixel coordinates, idepth rescale) and target color.
+  int cache_stamp_;
+  double cache_idepth_;
+  int cache_n_;   /// number of pattern points projected in front of the camera and inside the image.
+  bool cache_behind_;
+  float cache_u_[MAX_RES_PER_POINT];
+  float cache_v_[MAX_RES_PER_POINT];
+  float cache_Ku_[MAX_RES_PER_POINT];
+  float cache_Kv_[MAX_RES_PER_POINT];
+  float cache_drescale_[MAX_RES_PER_POINT];
+  Vec2f cache_Klip_[MAX_RES_PER_POINT];
+  Vec3f cache_hitColor_[MAX_RES_PER_POINT];
+
+  /// \brief Result of Evaluate().
+  bool eval_valid_;
+  ErrorVector eval_error_;
+  ResState eval_state_;
+  bool eval_outOfImage_;
+  bool eval_hasCenter_;
+  Vec3f eval_center_;
+  float eval_energy_;
+  float eval_energyWithOutlier_;
+
+  /// \brief Result of EvaluateJacobians(). jac_ok_ is false if the pattern hit an invalid pixel.
+  bool jac_valid_;
+  bool jac_ok_;
+  Eigen::Matrix<double,patternNum,6> jac_xi_;
+  Eigen::Matrix<double,patternNum,2> jac_photo_;
+  Eigen::Matrix<double,patternNum,1> jac_idepth_;
+  Eigen::Matrix<double,patternNum,4> jac_cam_;
+  float jac_Hdd_;
+};
+
+/// \class EdgeLBAParallelAction class.
+/// Evaluates the errors (compute error action) or the jacobians (pre iteration action) of all
+/// window BA edges on the thread pool before g2o walks over them. g2o then only copies the results,
+/// in its own (deterministic) edge order, and accumulates the Hessian blocks.
+class EdgeLBAParallelAction : public ::g2o::HyperGraphAction {
+ public:
+  EdgeLBAParallelAction(IndexThreadReduce<Vec10>* red, bool jacobians)
+      : red_(red), jacobians_(jacobians)
+  {}
+
+  virtual ::g2o::HyperGraphAction* operator()(const ::g2o::HyperGraph* graph,
+                                              ::g2o::HyperGraphAction::Parameters* parameters = 0);
+
+  std::vector<EdgeLBASE3PosePhotoIdepthCamDSO*> edges;
+  std::vector<EdgeLBAPrecalc*> precalc;
+
+ private:
+  void evaluateReductor(int min, int max, Vec10* stats, int tid);
+
+  IndexThreadReduce<Vec10>* red_;
+  bool jacobians_;
+};
+
+/// \class EdgeMargPriorDSO class.
+/// Dense marginalization prior (ef->HM, ef->bM) over the camera and the pose / photometric vertices of the window.
+/// HM = V*diag(l)*V^T is factorised once, the error is e = diag(sqrt(l))*V^T*delta + diag(1/sqrt(l))*V^T*bM,
+/// so that |e|^2 = delta^T*(2*bM + HM*delta) + const, the same energy as EnergyFunctional::calcMEnergyF().
+/// delta is taken w.r.t. the FEJ linearization points (worldToCam_evalPT, state_zero, value_zero).
+class EdgeMargPriorDSO : public ::g2o::BaseMultiEdge<-1, VecX> {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /// \brief The constructor. frames are ordered as in HM (by idx).
+  EdgeMargPriorDSO(const MatXX &HM, const VecX &bM, CalibHessian* HCalib, const std::vector<FrameHessian*> &frames);
+
+  /// \brief Connect the vertices. frames with a null pose vertex are held fixed at their current state.
+  /// returns false if the prior carries no information.
+  bool SetVertices(VertexCamDSO* vtx_cam,
+                   const std::vector<VertexSE3PoseDSO*> &vtx_pose,
+                   const std::vector<VertexPhotometricDSO*> &vtx_photo);
+
+  virtual void computeError();
+
+  virtual void linearizeOplus();
+
+  // deprecated.
+  virtual bool read(std::istream& in) { return false;}
+  virtual bool write(std::ostream& out) const {return false; }
+
+ private:
+  /// \brief Square root factor and residual of the prior. (rank x (CPARS+8*nFrames))
+  MatXX J_;
+  VecX r_;
+
+  /// \brief r_ plus the part of J_*delta of the frames without vertex.
+  VecX e0_;
+
+  CalibHessian* HCalib_;
+  std::vector<FrameHessian*> frames_;
+
+  /// \brief Column of the pose block of each connected vertex pair, and its frame.
+  std::vector<int> frame_col_;
+  std::vector<FrameHessian*> frame_fh_;
 };
 
 /// \class EdgeSE3PosePhotoDSO class.
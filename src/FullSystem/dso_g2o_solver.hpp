@@ -0,0 +1,59 @@
+#ifndef DSO_G2O_SOLVER_H_
+#define DSO_G2O_SOLVER_H_
+
+#include <memory>
+
+#include <g2o/core/block_solver.h>
+#include <g2o/solvers/dense/linear_solver_dense.h>
+#include <g2o/solvers/eigen/linear_solver_eigen.h>
+#include <g2o/solvers/csparse/linear_solver_csparse.h>
+#include <g2o/solvers/cholmod/linear_solver_cholmod.h>
+
+#include "util/settings.h"
+
+namespace dso {
+namespace util {
+
+/// \brief Linear solver for a BlockSolverX whose (schur reduced) system has dimension dim.
+/// setting_g2oLinearSolver: 0 = auto, 1 = dense, 2 = eigen, 3 = csparse, 4 = cholmod.
+/// auto takes the dense solver up to setting_g2oDenseMaxDim, there is no ordering / symbolic step to pay for.
+/// the sparse solvers keep their symbolic factorization while the graph structure is unchanged,
+/// i.e. over all iterations of one optimize(); block ordering keeps the ordering step cheap.
+inline std::unique_ptr<g2o::BlockSolverX::LinearSolverType> MakeLinearSolverX(int dim) {
+  typedef g2o::BlockSolverX::PoseMatrixType PoseMatrixType;
+
+  int type = setting_g2oLinearSolver;
+  if(type == 0) {
+    type = dim <= setting_g2oDenseMaxDim ? 1 : 4;
+  }
+
+  switch(type) {
+    case 1:
+      return g2o::make_unique<g2o::LinearSolverDense<PoseMatrixType>>();
+    case 3: {
+      auto linear_solver = g2o::make_unique<g2o::LinearSolverCSparse<PoseMatrixType>>();
+      linear_solver->setBlockOrdering(true);
+      return std::move(linear_solver);
+    }
+    case 4: {
+      auto linear_solver = g2o::make_unique<g2o::LinearSolverCholmod<PoseMatrixType>>();
+      linear_solver->setBlockOrdering(true);
+      return std::move(linear_solver);
+    }
+    default: {
+      auto linear_solver = g2o::make_unique<g2o::LinearSolverEigen<PoseMatrixType>>();
+      linear_solver->setBlockOrdering(true);
+      return std::move(linear_solver);
+    }
+  }
+}
+
+/// \brief BlockSolverX with the linear solver chosen by MakeLinearSolverX.
+inline std::unique_ptr<g2o::BlockSolverX> MakeBlockSolverX(int dim) {
+  return g2o::make_unique<g2o::BlockSolverX>(MakeLinearSolverX(dim));
+}
+
+} // namespace util
+} // namespace dso
+
+#endif /* DSO_G2O_SOLVER_H_ */
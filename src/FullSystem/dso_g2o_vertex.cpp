@@ -3,6 +3,7 @@
 namespace dso {
 
 VertexSE3PoseDSO::VertexSE3PoseDSO()
+    : version_(0)
 {}
 
 bool VertexSE3PoseDSO::read(std::istream& is) { return false; }
@@ -17,9 +18,17 @@ void VertexSE3PoseDSO::oplusImpl(const number_t* update_) {
   _estimate = SE3::exp(update) * estimate();
 }
 
+void VertexSE3PoseDSO::updateCache() {
+  g2o::OptimizableGraph::Vertex::updateCache();
+  if(version_ == 0 || !((linRef_.inverse() * _estimate).log().lpNorm<Eigen::Infinity>() <= setting_lazyRelinTH)) {
+    linRef_ = _estimate;
+    version_++;
+  }
+}
+
 //===================================================================
 
-VertexPhotometricDSO::VertexPhotometricDSO() {}
+VertexPhotometricDSO::VertexPhotometricDSO() : version_(0) {}
 bool VertexPhotometricDSO::read(std::istream& is) { return false; }
 bool VertexPhotometricDSO::write(std::ostream& os) const { return false; }
 
@@ -39,6 +48,14 @@ void VertexPhotometricDSO::oplusImpl(const number_t* update_) {
 #endif
 }
 
+void VertexPhotometricDSO::updateCache() {
+  g2o::OptimizableGraph::Vertex::updateCache();
+  if(version_ == 0 || !(std::max(fabs(_estimate.a - linRef_.a), fabs(_estimate.b - linRef_.b)) <= setting_lazyRelinTH)) {
+    linRef_ = _estimate;
+    version_++;
+  }
+}
+
 //===================================================================
 
 VertexInverseDepthDSO::VertexInverseDepthDSO() {
@@ -89,7 +106,7 @@ void VertexUVDSO::oplusImpl(const number_t* update_) {
 
 //===================================================================
 
-VertexCamDSO::VertexCamDSO() {}
+VertexCamDSO::VertexCamDSO() : version_(0) {}
 bool VertexCamDSO::read(std::istream& is) { return false; }
 bool VertexCamDSO::write(std::ostream& os) const { return false; }
 
@@ -105,4 +122,12 @@ void VertexCamDSO::oplusImpl(const number_t* update_) {
   _estimate(3) += update(3);  // cy
 }
 
+void VertexCamDSO::updateCache() {
+  g2o::OptimizableGraph::Vertex::updateCache();
+  if(version_ == 0 || !((_estimate - linRef_).lpNorm<Eigen::Infinity>() <= setting_lazyRelinTH)) {
+    linRef_ = _estimate;
+    version_++;
+  }
+}
+
 }  // namespace dso
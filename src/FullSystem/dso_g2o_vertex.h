@@ -2,6 +2,7 @@
 #define DSO_G2O_VERTEX_H
 
 #include "util/NumType.h"
+#include "util/settings.h"
 
 #include <g2o/core/base_vertex.h>
 #include <g2o/core/solver.h>
@@ -34,6 +35,16 @@ class VertexSE3PoseDSO final : public g2o::BaseVertex<6, SE3> {
   void setToOriginImpl() override;
 
   void oplusImpl(const number_t* update_) override;
+
+  //// counts the changes of the estimate (setEstimate, oplus, pop) by more than setting_lazyRelinTH,
+  //// used to invalidate precalc values.
+  void updateCache() override;
+
+  int version() const { return version_; }
+
+ private:
+  int version_;
+  EstimateType linRef_;
 };
 
 class VertexPhotometricDSO final : public g2o::BaseVertex<2, AffLight> {
@@ -49,6 +60,16 @@ class VertexPhotometricDSO final : public g2o::BaseVertex<2, AffLight> {
   void setToOriginImpl() override;
 
   void oplusImpl(const number_t* update_) override;
+
+  //// counts the changes of the estimate (setEstimate, oplus, pop) by more than setting_lazyRelinTH,
+  //// used to invalidate precalc values.
+  void updateCache() override;
+
+  int version() const { return version_; }
+
+ private:
+  int version_;
+  EstimateType linRef_;
 };
 
 class VertexInverseDepthDSO final : public g2o::BaseVertex<1, double> {
@@ -112,6 +133,16 @@ class VertexCamDSO final : public g2o::BaseVertex<4, Vec4> {
   void setToOriginImpl() override;
 
   void oplusImpl(const number_t* update_) override;
+
+  //// counts the changes of the estimate (setEstimate, oplus, pop) by more than setting_lazyRelinTH,
+  //// used to invalidate precalc values.
+  void updateCache() override;
+
+  int version() const { return version_; }
+
+ private:
+  int version_;
+  EstimateType linRef_;
 };
 
 } // namespace dso
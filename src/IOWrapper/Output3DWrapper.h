@@ -29,6 +29,7 @@
 
 #include "util/NumType.h"
 #include "util/MinimalImage.h"
+#include "util/WindowSnapshot.h"
 #include "map"
 
 namespace cv {
@@ -134,6 +135,16 @@ class Output3DWrapper {
    */
   virtual void publishKeyframes(std::vector<FrameHessian*> &frames, bool final, CalibHessian* HCalib) {}
 
+  /* Usage:
+   * Called after each optimization of the window, and after frames were marginalized, with an immutable copy
+   * of the window (poses, affine brightness, active points). Unlike [publishKeyframes] the data may be
+   * kept and read from any thread at any later time without locking, just hold on to the pointer.
+   *
+   * Calling:
+   * Always called, no overhead if not used.
+   */
+  virtual void publishWindowSnapshot(const WindowSnapshotPtr &window) {}
+
   /* Usage:
    * Called once for each tracked frame, with the real-time, low-delay frame pose.
    *
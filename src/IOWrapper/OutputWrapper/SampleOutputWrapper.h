@@ -98,6 +98,15 @@ class SampleOutputWrapper : public Output3DWrapper
     }
   }
 
+  virtual void publishWindowSnapshot(const WindowSnapshotPtr &window)
+  {
+    printf("OUT: Window version %ld: %d frames, %d active points\n",
+           window->version, (int)window->frames.size(), (int)window->points.size());
+    for(const WindowSnapshot::Frame &f : window->frames)
+      printf("OUT: KF %d (id %d, time %f): %d active points, a=%f b=%f\n",
+             f.frameID, f.incomingId, f.timestamp, f.pointEnd - f.pointBegin, f.aff_g2l.a, f.aff_g2l.b);
+  }
+
   virtual void publishCamPose(FrameShell* frame, CalibHessian* HCalib)
   {
     printf("OUT: Current Frame %d (time %f, internal ID %d). CameraToWorld:\n",
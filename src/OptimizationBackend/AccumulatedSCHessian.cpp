@@ -103,10 +103,14 @@ void AccumulatedSCHessianSSE::addPoint(EFPoint* p, bool shiftPriorToZero, int ti
 }
 
 /// Get the hessian matrix Schur complement from the accumulator
-void AccumulatedSCHessianSSE::stitchDoubleInternal(MatXX* H, VecX* b,
+template<typename Scalar>
+void AccumulatedSCHessianSSE::stitchDoubleInternal(Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic>* H,
+                                                   Eigen::Matrix<Scalar,Eigen::Dynamic,1>* b,
                                                    EnergyFunctional const * const EF,
                                                    int min, int max, Vec10* stats, int tid)
 {
+  typedef Eigen::Matrix<Scalar,8,8> Mat88S;
+
   int toAggregate = NUM_THREADS;
 
   // special case: if we dont do multithreading, dont aggregate.
@@ -129,45 +133,51 @@ void AccumulatedSCHessianSSE::stitchDoubleInternal(MatXX* H, VecX* b,
     int jIdx = CPARS + j*8;
     int ijIdx = i + nf*j;
 
-    Mat8C Hpc = Mat8C::Zero();
-    Vec8 bp = Vec8::Zero();
+    Eigen::Matrix<Scalar,8,CPARS> Hpc = Eigen::Matrix<Scalar,8,CPARS>::Zero();
+    Eigen::Matrix<Scalar,8,1> bp = Eigen::Matrix<Scalar,8,1>::Zero();
 
     /// Sum of all threads
     for(int tid2=0;tid2 < toAggregate;tid2++) {
       accE[tid2][ijIdx].finish();
       accEB[tid2][ijIdx].finish();
-      Hpc += accE[tid2][ijIdx].A1m.cast<double>();
-      bp += accEB[tid2][ijIdx].A1m.cast<double>();
+      Hpc += accE[tid2][ijIdx].A1m.template cast<Scalar>();
+      bp += accEB[tid2][ijIdx].A1m.template cast<Scalar>();
     }
 
+    const Mat88S &adHij = EF->template adHostT<Scalar>(ijIdx);
+    const Mat88S &adTij = EF->template adTargetT<Scalar>(ijIdx);
+
     /// Hfc part Schur
-    H[tid].block<8,CPARS>(iIdx,0) += EF->adHost[ijIdx] * Hpc;
-    H[tid].block<8,CPARS>(jIdx,0) += EF->adTarget[ijIdx] * Hpc;
+    H[tid].template block<8,CPARS>(iIdx,0) += adHij * Hpc;
+    H[tid].template block<8,CPARS>(jIdx,0) += adTij * Hpc;
 
     /// Residual Schur of pose, photometric part
-    b[tid].segment<8>(iIdx) += EF->adHost[ijIdx] * bp;
-    b[tid].segment<8>(jIdx) += EF->adTarget[ijIdx] * bp;
+    b[tid].template segment<8>(iIdx) += adHij * bp;
+    b[tid].template segment<8>(jIdx) += adTij * bp;
 
     for(int k=0; k<nf; k++) {
       int kIdx = CPARS+k*8;
       int ijkIdx = ijIdx + k*nframes2;
       int ikIdx = i + nf*k;
 
-      Mat88 accDM = Mat88::Zero();
+      Mat88S accDM = Mat88S::Zero();
 
       for(int tid2=0; tid2 < toAggregate; tid2++) {
         accD[tid2][ijkIdx].finish();
         if(accD[tid2][ijkIdx].num == 0) {
           continue;
         }
-        accDM += accD[tid2][ijkIdx].A1m.cast<double>();
+        accDM += accD[tid2][ijkIdx].A1m.template cast<Scalar>();
       }
 
+      const Mat88S &adHik = EF->template adHostT<Scalar>(ikIdx);
+      const Mat88S &adTik = EF->template adTargetT<Scalar>(ikIdx);
+
       /// Hff part Schur
-      H[tid].block<8,8>(iIdx, iIdx) += EF->adHost[ijIdx] * accDM * EF->adHost[ikIdx].transpose();
-      H[tid].block<8,8>(jIdx, kIdx) += EF->adTarget[ijIdx] * accDM * EF->adTarget[ikIdx].transpose();
-      H[tid].block<8,8>(jIdx, iIdx) += EF->adTarget[ijIdx] * accDM * EF->adHost[ikIdx].transpose();
-      H[tid].block<8,8>(iIdx, kIdx) += EF->adHost[ijIdx] * accDM * EF->adTarget[ikIdx].transpose();
+      H[tid].template block<8,8>(iIdx, iIdx) += adHij * accDM * adHik.transpose();
+      H[tid].template block<8,8>(jIdx, kIdx) += adTij * accDM * adTik.transpose();
+      H[tid].template block<8,8>(jIdx, iIdx) += adTij * accDM * adHik.transpose();
+      H[tid].template block<8,8>(iIdx, kIdx) += adHij * accDM * adTik.transpose();
     }
   }
 
@@ -179,9 +189,9 @@ void AccumulatedSCHessianSSE::stitchDoubleInternal(MatXX* H, VecX* b,
       accbc[tid2].finish();
 
       /// Hcc part Schur
-      H[tid].topLeftCorner<CPARS,CPARS>() += accHcc[tid2].A1m.cast<double>();
+      H[tid].template topLeftCorner<CPARS,CPARS>() += accHcc[tid2].A1m.template cast<Scalar>();
       /// Residual Schur of intrinsic paramters Part
-      b[tid].head<CPARS>() += accbc[tid2].A1m.cast<double>();
+      b[tid].template head<CPARS>() += accbc[tid2].A1m.template cast<Scalar>();
     }
   }
 
@@ -194,6 +204,11 @@ void AccumulatedSCHessianSSE::stitchDoubleInternal(MatXX* H, VecX* b,
   //	}
 }
 
+template void AccumulatedSCHessianSSE::stitchDoubleInternal<double>(MatXX* H, VecX* b, EnergyFunctional const * const EF,
+                                                                    int min, int max, Vec10* stats, int tid);
+template void AccumulatedSCHessianSSE::stitchDoubleInternal<float>(MatXXf* H, VecXf* b, EnergyFunctional const * const EF,
+                                                                   int min, int max, Vec10* stats, int tid);
+
 /// Calculate Schur H b for a single thread
 void AccumulatedSCHessianSSE::stitchDouble(MatXX &H, VecX &b,
                                            EnergyFunctional const * const EF, int tid)
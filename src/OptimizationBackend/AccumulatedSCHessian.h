@@ -30,6 +30,7 @@
 #include "OptimizationBackend/MatrixAccumulators.h"
 #include "vector"
 #include <math.h>
+#include "util/settings.h"
 
 namespace dso
 {
@@ -93,22 +94,43 @@ class AccumulatedSCHessianSSE
   void addPoint(EFPoint* p, bool shiftPriorToZero, int tid=0);
 
   /// Multi-threaded get Schur complement
-  void stitchDoubleMT(IndexThreadReduce<Vec10>* red, MatXX &H, VecX &b, EnergyFunctional const * const EF, bool MT)
+  /// with floatStitch the blocks are stitched and summed up in float, only the result is double.
+  void stitchDoubleMT(IndexThreadReduce<Vec10>* red, MatXX &H, VecX &b, EnergyFunctional const * const EF, bool MT, bool floatStitch)
   {
+    if(floatStitch) {
+      MatXXf Hf;
+      VecXf bf;
+      stitchMT<float>(red, Hf, bf, EF, MT);
+      H = Hf.cast<double>();
+      b = bf.cast<double>();
+    }
+    else {
+      stitchMT<double>(red, H, b, EF, MT);
+    }
+  }
+
+  template<typename Scalar>
+  void stitchMT(IndexThreadReduce<Vec10>* red,
+                Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> &H, Eigen::Matrix<Scalar,Eigen::Dynamic,1> &b,
+                EnergyFunctional const * const EF, bool MT)
+  {
+    typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatS;
+    typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VecS;
+
     // sum up, splitting by back in square.
     if(MT) {
-      MatXX Hs[NUM_THREADS];
-      VecX bs[NUM_THREADS];
+      MatS Hs[NUM_THREADS];
+      VecS bs[NUM_THREADS];
 
       /// Allocated space
       for(int i=0;i<NUM_THREADS;i++)
       {
         assert(nframes[0] == nframes[i]);
-        Hs[i] = MatXX::Zero(nframes[0]*8+CPARS, nframes[0]*8+CPARS);
-        bs[i] = VecX::Zero(nframes[0]*8+CPARS);
+        Hs[i] = MatS::Zero(nframes[0]*8+CPARS, nframes[0]*8+CPARS);
+        bs[i] = VecS::Zero(nframes[0]*8+CPARS);
       }
 
-      red->reduce(boost::bind(&AccumulatedSCHessianSSE::stitchDoubleInternal,
+      red->reduce(boost::bind(&AccumulatedSCHessianSSE::stitchDoubleInternal<Scalar>,
                               this,Hs, bs, EF,  _1, _2, _3, _4), 0, nframes[0]*nframes[0], 0);
 
       // sum up results
@@ -121,16 +143,16 @@ class AccumulatedSCHessianSSE
       }
     }
     else {
-      H = MatXX::Zero(nframes[0]*8+CPARS, nframes[0]*8+CPARS);
-      b = VecX::Zero(nframes[0]*8+CPARS);
-      stitchDoubleInternal(&H, &b, EF,0,nframes[0]*nframes[0],0,-1);
+      H = MatS::Zero(nframes[0]*8+CPARS, nframes[0]*8+CPARS);
+      b = VecS::Zero(nframes[0]*8+CPARS);
+      stitchDoubleInternal<Scalar>(&H, &b, EF,0,nframes[0]*nframes[0],0,-1);
     }
 
     /// Symmetry
     // make diagonal by copying over parts.
     for(int h=0; h<nframes[0]; h++) {
       int hIdx = CPARS + h*8;
-      H.block<CPARS,8>(0,hIdx).noalias() = H.block<8,CPARS>(hIdx,0).transpose();
+      H.template block<CPARS,8>(0,hIdx).noalias() = H.template block<8,CPARS>(hIdx,0).transpose();
     }
   }
 
@@ -161,8 +183,11 @@ class AccumulatedSCHessianSSE
 
  private:
 
+  /// instantiated for float and double.
+  template<typename Scalar>
   void stitchDoubleInternal(
-      MatXX* H, VecX* b, EnergyFunctional const * const EF,
+      Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic>* H, Eigen::Matrix<Scalar,Eigen::Dynamic,1>* b,
+      EnergyFunctional const * const EF,
       int min, int max, Vec10* stats, int tid);
 };
 
@@ -48,7 +48,12 @@ void AccumulatedTopHessianSSE::addPoint(EFPoint* p, EnergyFunctional const * con
   VecCf  Hcd_acc = VecCf::Zero();
 
   /// Traverse all the residuals at that point
-  for(EFResidual* r : p->residualsAll) {
+  const int numRes = p->residualsAll.size();
+  for(int k=0; k<numRes; k++) {
+    EFResidual* r = p->residualsAll[k];
+    /// the jacobian is the next pointer hop, start loading it one residual ahead.
+    if(k+1 < numRes) __builtin_prefetch(p->residualsAll[k+1]->J);
+
     /// This is not the same as the running mode.
     /// Calculate only newly added residuals
     if(mode==0) {
@@ -74,6 +79,12 @@ void AccumulatedTopHessianSSE::addPoint(EFPoint* p, EnergyFunctional const * con
     RawResidualJacobian* rJ = r->J;
 
     /// ID to control variables between different frames, distinguish the same two frames, but the host target roles are interchangeable
+    /// the blocks are indexed without bounds, a stale index would write into another frame pair (or past the buffer).
+    if(r->hostIDX < 0 || r->hostIDX >= nframes[tid] || r->targetIDX < 0 || r->targetIDX >= nframes[tid]) {
+      printf("addPoint: residual %d -> %d outside the window of %d frames, skipped!\n",
+             r->hostIDX, r->targetIDX, nframes[tid]);
+      continue;
+    }
     int htIDX = r->hostIDX + r->targetIDX*nframes[tid];
 
     /// pose(6) + photometric a b(2)
@@ -262,10 +273,14 @@ void AccumulatedTopHessianSSE::stitchDouble(MatXX &H, VecX &b,
 }
 
 /// Constructing a Hessian matrix, b = Jres matrix
-void AccumulatedTopHessianSSE::stitchDoubleInternal(MatXX* H, VecX* b,
+template<typename Scalar>
+void AccumulatedTopHessianSSE::stitchDoubleInternal(Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic>* H,
+                                                    Eigen::Matrix<Scalar,Eigen::Dynamic,1>* b,
                                                     EnergyFunctional const * const EF, bool usePrior,
                                                     int min, int max, Vec10* stats, int tid)
 {
+  typedef Eigen::Matrix<Scalar,8+CPARS+1,8+CPARS+1> MatPCPCS;
+
   int toAggregate = NUM_THREADS;
 
   /// No multi-threading, why can't you unify
@@ -294,7 +309,7 @@ void AccumulatedTopHessianSSE::stitchDoubleInternal(MatXX* H, VecX* b,
     assert(aidx == k);
 
     /// (8 + 4 + 1) * (8 + 4 + 1) matrix
-    MatPCPC accH = MatPCPC::Zero();
+    MatPCPCS accH = MatPCPCS::Zero();
 
     for(int tid2=0; tid2 < toAggregate; tid2++) {
       acc[tid2][aidx].finish();
@@ -304,38 +319,46 @@ void AccumulatedTopHessianSSE::stitchDoubleInternal(MatXX* H, VecX* b,
       }
 
       /// Add up between different threads
-      accH += acc[tid2][aidx].H.cast<double>();
+      accH += acc[tid2][aidx].H.template cast<Scalar>();
     }
 
+    const Eigen::Matrix<Scalar,8,8> &adH = EF->template adHostT<Scalar>(aidx);
+    const Eigen::Matrix<Scalar,8,8> &adT = EF->template adTargetT<Scalar>(aidx);
+
     /// The relative quantity becomes an absolute quantity through adj and is added to H, b
-    H[tid].block<8,8>(hIdx, hIdx).noalias() += EF->adHost[aidx] * accH.block<8,8>(CPARS,CPARS) * EF->adHost[aidx].transpose();
-    H[tid].block<8,8>(tIdx, tIdx).noalias() += EF->adTarget[aidx] * accH.block<8,8>(CPARS,CPARS) * EF->adTarget[aidx].transpose();
-    H[tid].block<8,8>(hIdx, tIdx).noalias() += EF->adHost[aidx] * accH.block<8,8>(CPARS,CPARS) * EF->adTarget[aidx].transpose();
-    H[tid].block<8,CPARS>(hIdx,0).noalias() += EF->adHost[aidx] * accH.block<8,CPARS>(CPARS,0);
-    H[tid].block<8,CPARS>(tIdx,0).noalias() += EF->adTarget[aidx] * accH.block<8,CPARS>(CPARS,0);
-    H[tid].topLeftCorner<CPARS,CPARS>().noalias() += accH.block<CPARS,CPARS>(0,0);
-
-    b[tid].segment<8>(hIdx).noalias() += EF->adHost[aidx] * accH.block<8,1>(CPARS,CPARS+8);
-    b[tid].segment<8>(tIdx).noalias() += EF->adTarget[aidx] * accH.block<8,1>(CPARS,CPARS+8);
-    b[tid].head<CPARS>().noalias() += accH.block<CPARS,1>(0,CPARS+8);   /// Residuals * intrinsic parameters
+    H[tid].template block<8,8>(hIdx, hIdx).noalias() += adH * accH.template block<8,8>(CPARS,CPARS) * adH.transpose();
+    H[tid].template block<8,8>(tIdx, tIdx).noalias() += adT * accH.template block<8,8>(CPARS,CPARS) * adT.transpose();
+    H[tid].template block<8,8>(hIdx, tIdx).noalias() += adH * accH.template block<8,8>(CPARS,CPARS) * adT.transpose();
+    H[tid].template block<8,CPARS>(hIdx,0).noalias() += adH * accH.template block<8,CPARS>(CPARS,0);
+    H[tid].template block<8,CPARS>(tIdx,0).noalias() += adT * accH.template block<8,CPARS>(CPARS,0);
+    H[tid].template topLeftCorner<CPARS,CPARS>().noalias() += accH.template block<CPARS,CPARS>(0,0);
+
+    b[tid].template segment<8>(hIdx).noalias() += adH * accH.template block<8,1>(CPARS,CPARS+8);
+    b[tid].template segment<8>(tIdx).noalias() += adT * accH.template block<8,1>(CPARS,CPARS+8);
+    b[tid].template head<CPARS>().noalias() += accH.template block<CPARS,1>(0,CPARS+8);   /// Residuals * intrinsic parameters
   }
 
   // only do this on one thread.
   if(min==0 && usePrior) {
     /// hessian prior
-    H[tid].diagonal().head<CPARS>() += EF->cPrior;
+    H[tid].diagonal().template head<CPARS>() += EF->cPrior.template cast<Scalar>();
 
     /// H * delta update residual
-    b[tid].head<CPARS>() += EF->cPrior.cwiseProduct(EF->cDeltaF.cast<double>());
+    b[tid].template head<CPARS>() += EF->cPrior.cwiseProduct(EF->cDeltaF.cast<double>()).template cast<Scalar>();
 
     for(int h=0; h<nframes[tid]; h++) {
       /// hessian prior
-      H[tid].diagonal().segment<8>(CPARS + h*8) += EF->frames[h]->prior;
-      b[tid].segment<8>(CPARS + h*8) += EF->frames[h]->prior.cwiseProduct(EF->frames[h]->delta_prior);
+      H[tid].diagonal().template segment<8>(CPARS + h*8) += EF->frames[h]->prior.template cast<Scalar>();
+      b[tid].template segment<8>(CPARS + h*8) += EF->frames[h]->prior.cwiseProduct(EF->frames[h]->delta_prior).template cast<Scalar>();
     }
   }
 }
 
+template void AccumulatedTopHessianSSE::stitchDoubleInternal<double>(MatXX* H, VecX* b, EnergyFunctional const * const EF,
+                                                                     bool usePrior, int min, int max, Vec10* stats, int tid);
+template void AccumulatedTopHessianSSE::stitchDoubleInternal<float>(MatXXf* H, VecXf* b, EnergyFunctional const * const EF,
+                                                                    bool usePrior, int min, int max, Vec10* stats, int tid);
+
 
 
 }
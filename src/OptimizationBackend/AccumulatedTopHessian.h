@@ -30,6 +30,8 @@
 #include "vector"
 #include <math.h>
 #include "util/IndexThreadReduce.h"
+#include "util/settings.h"
+#include <algorithm>
 
 
 namespace dso
@@ -51,6 +53,7 @@ class AccumulatedTopHessianSSE
       nres[tid]=0;
       acc[tid]=0;
       nframes[tid]=0;
+      accCapacity[tid]=0;
     }
 
   };
@@ -66,14 +69,16 @@ class AccumulatedTopHessianSSE
   inline void setZero(int nFrames, int min=0, int max=1,
                       Vec10* stats=0, int tid=0)
   {
-    /// ? Under what circumstances
-    if(nFrames != nframes[tid])  {
+    /// Reallocate only if the window grew beyond anything seen so far, sized for setting_maxFrames+1 at least.
+    if(nFrames*nFrames > accCapacity[tid])  {
       if(acc[tid] != 0) delete[] acc[tid];
+      int cap = std::max(nFrames, setting_maxFrames+1);
 #if USE_XI_MODEL
-      acc[tid] = new Accumulator14[nFrames*nFrames];
+      acc[tid] = new Accumulator14[cap*cap];
 #else
-      acc[tid] = new AccumulatorApprox[nFrames*nFrames];
+      acc[tid] = new AccumulatorApprox[cap*cap];
 #endif
+      accCapacity[tid] = cap*cap;
     }
 
     /// Initialize, set initial value
@@ -92,23 +97,45 @@ class AccumulatedTopHessianSSE
 
 
   /// Get the final H and b
+  /// with floatStitch the blocks are stitched and summed up in float, only the result is double.
   void stitchDoubleMT(IndexThreadReduce<Vec10>* red, MatXX &H, VecX &b,
                       EnergyFunctional const * const EF,
-                      bool usePrior, bool MT)
+                      bool usePrior, bool MT, bool floatStitch)
   {
+    if(floatStitch) {
+      MatXXf Hf;
+      VecXf bf;
+      stitchMT<float>(red, Hf, bf, EF, usePrior, MT);
+      H = Hf.cast<double>();
+      b = bf.cast<double>();
+    }
+    else {
+      stitchMT<double>(red, H, b, EF, usePrior, MT);
+    }
+  }
+
+  template<typename Scalar>
+  void stitchMT(IndexThreadReduce<Vec10>* red,
+                Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> &H, Eigen::Matrix<Scalar,Eigen::Dynamic,1> &b,
+                EnergyFunctional const * const EF,
+                bool usePrior, bool MT)
+  {
+    typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatS;
+    typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VecS;
+
     // sum up, splitting by bock in square.
     if(MT) {
-      MatXX Hs[NUM_THREADS];
-      VecX bs[NUM_THREADS];
+      MatS Hs[NUM_THREADS];
+      VecS bs[NUM_THREADS];
       for(int i=0;i<NUM_THREADS;i++)
       {
         assert(nframes[0] == nframes[i]);
         /// All optimization variable dimensions
-        Hs[i] = MatXX::Zero(nframes[0]*8+CPARS, nframes[0]*8+CPARS);
-        bs[i] = VecX::Zero(nframes[0]*8+CPARS);
+        Hs[i] = MatS::Zero(nframes[0]*8+CPARS, nframes[0]*8+CPARS);
+        bs[i] = VecS::Zero(nframes[0]*8+CPARS);
       }
 
-      red->reduce(boost::bind(&AccumulatedTopHessianSSE::stitchDoubleInternal,
+      red->reduce(boost::bind(&AccumulatedTopHessianSSE::stitchDoubleInternal<Scalar>,
                               this,Hs, bs, EF, usePrior,  _1, _2, _3, _4), 0, nframes[0]*nframes[0], 0);
 
       // sum up results
@@ -125,9 +152,9 @@ class AccumulatedTopHessianSSE
     }
     /// Not using multithreading
     else {
-      H = MatXX::Zero(nframes[0]*8+CPARS, nframes[0]*8+CPARS);
-      b = VecX::Zero(nframes[0]*8+CPARS);
-      stitchDoubleInternal(&H, &b, EF, usePrior,0,nframes[0]*nframes[0],0,-1);
+      H = MatS::Zero(nframes[0]*8+CPARS, nframes[0]*8+CPARS);
+      b = VecS::Zero(nframes[0]*8+CPARS);
+      stitchDoubleInternal<Scalar>(&H, &b, EF, usePrior,0,nframes[0]*nframes[0],0,-1);
     }
 
     // make diagonal by copying over parts.
@@ -135,14 +162,14 @@ class AccumulatedTopHessianSSE
     {
       int hIdx = CPARS+h*8;
       /// [intrinsic parameters, position] Symmetry
-      H.block<CPARS,8>(0,hIdx).noalias() = H.block<8,CPARS>(hIdx,0).transpose();
+      H.template block<CPARS,8>(0,hIdx).noalias() = H.template block<8,CPARS>(hIdx,0).transpose();
 
       for(int t=h+1;t<nframes[0];t++)
       {
         int tIdx = CPARS+t*8;
         /// For the pose, the Hessian between the same two frames needs to be added up, that is, the symmetrical position, (J difference minus sign, just after square)
-        H.block<8,8>(hIdx, tIdx).noalias() += H.block<8,8>(tIdx, hIdx).transpose();
-        H.block<8,8>(tIdx, hIdx).noalias() = H.block<8,8>(hIdx, tIdx).transpose();
+        H.template block<8,8>(hIdx, tIdx).noalias() += H.template block<8,8>(tIdx, hIdx).transpose();
+        H.template block<8,8>(tIdx, hIdx).noalias() = H.template block<8,8>(hIdx, tIdx).transpose();
       }
     }
   }
@@ -151,6 +178,8 @@ class AccumulatedTopHessianSSE
 
   /// Frames per thread
   int nframes[NUM_THREADS];
+  /// Number of allocated accumulators per thread, >= nframes*nframes
+  int accCapacity[NUM_THREADS];
 
   /// Calculate the hessian accumulator
   EIGEN_ALIGN16 AccumulatorApprox* acc[NUM_THREADS];
@@ -172,8 +201,11 @@ class AccumulatedTopHessianSSE
 
  private:
 
+  /// instantiated for float and double.
+  template<typename Scalar>
   void stitchDoubleInternal(
-      MatXX* H, VecX* b, EnergyFunctional const * const EF, bool usePrior,
+      Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic>* H, Eigen::Matrix<Scalar,Eigen::Dynamic,1>* b,
+      EnergyFunctional const * const EF, bool usePrior,
       int min, int max, Vec10* stats, int tid);
 };
 }
@@ -129,10 +129,15 @@ EnergyFunctional::EnergyFunctional() {
   adHTdeltaF=0;
 
   nFrames = nResiduals = nPoints = 0;
+  nullspaceBasisValid = false;
+
+  connectivityStride = setting_maxFrames+1;
+  connectivity.assign(connectivityStride*connectivityStride, Eigen::Vector2i(0,0));
 
   /// Initially, frame changes are added later
-  HM = MatXX::Zero(CPARS,CPARS);
-  bM = VecX::Zero(CPARS);
+  nM = 0;
+  reserveM(CPARS+8*(setting_maxFrames+1));
+  nM = CPARS;
 
   accSSE_top_L = new AccumulatedTopHessianSSE();
   accSSE_top_A = new AccumulatedTopHessianSSE();
@@ -209,13 +214,13 @@ void EnergyFunctional::setDeltaF(CalibHessian* HCalib) {
 // accumulates & shifts L.
 /// Calculate the normal equation formed by the frame points in the energy equation
 //// A: Active
-void EnergyFunctional::accumulateAF_MT(MatXX &H, VecX &b, bool MT) {
+void EnergyFunctional::accumulateAF_MT(MatXX &H, VecX &b, bool MT, bool floatStitch) {
   if(MT) {
     red->reduce(boost::bind(&AccumulatedTopHessianSSE::setZero,
                             accSSE_top_A, nFrames,  _1, _2, _3, _4), 0, 0, 0);
     red->reduce(boost::bind(&AccumulatedTopHessianSSE::addPointsInternal<0>,
                             accSSE_top_A, &allPoints, this,  _1, _2, _3, _4), 0, allPoints.size(), 50);
-    accSSE_top_A->stitchDoubleMT(red,H,b,this,false,true);
+    accSSE_top_A->stitchDoubleMT(red,H,b,this,false,true,floatStitch);
     resInA = accSSE_top_A->nres[0];
   }
   else {
@@ -223,7 +228,7 @@ void EnergyFunctional::accumulateAF_MT(MatXX &H, VecX &b, bool MT) {
     for(EFFrame* f : frames)
       for(EFPoint* p : f->points)
         accSSE_top_A->addPoint<0>(p,this);                  /// mode 0 increase EF point
-    accSSE_top_A->stitchDoubleMT(red,H,b,this,false,false); /// without prior, get H, b
+    accSSE_top_A->stitchDoubleMT(red,H,b,this,false,false,floatStitch); /// without prior, get H, b
     resInA = accSSE_top_A->nres[0];                         /// All residuals count
   }
 }
@@ -231,13 +236,13 @@ void EnergyFunctional::accumulateAF_MT(MatXX &H, VecX &b, bool MT) {
 // accumulates & shifts L.
 /// Calculate H and b, add the prior, res is subtract the linearized residual
 //// L: Linearized
-void EnergyFunctional::accumulateLF_MT(MatXX &H, VecX &b, bool MT) {
+void EnergyFunctional::accumulateLF_MT(MatXX &H, VecX &b, bool MT, bool floatStitch) {
   if(MT) {
     red->reduce(boost::bind(&AccumulatedTopHessianSSE::setZero,
                             accSSE_top_L, nFrames,  _1, _2, _3, _4), 0, 0, 0);
     red->reduce(boost::bind(&AccumulatedTopHessianSSE::addPointsInternal<1>,
                             accSSE_top_L, &allPoints, this,  _1, _2, _3, _4), 0, allPoints.size(), 50);
-    accSSE_top_L->stitchDoubleMT(red,H,b,this,true,true);
+    accSSE_top_L->stitchDoubleMT(red,H,b,this,true,true,floatStitch);
     resInL = accSSE_top_L->nres[0];
   }
   else {
@@ -245,18 +250,18 @@ void EnergyFunctional::accumulateLF_MT(MatXX &H, VecX &b, bool MT) {
     for(EFFrame* f : frames)
       for(EFPoint* p : f->points)
         accSSE_top_L->addPoint<1>(p,this);                 /// mode 1
-    accSSE_top_L->stitchDoubleMT(red,H,b,this,true,false);
+    accSSE_top_L->stitchDoubleMT(red,H,b,this,true,false,floatStitch);
     resInL = accSSE_top_L->nres[0];
   }
 }
 
 /// Calculate the Schur complement part of the idepth
-void EnergyFunctional::accumulateSCF_MT(MatXX &H, VecX &b, bool MT) {
+void EnergyFunctional::accumulateSCF_MT(MatXX &H, VecX &b, bool MT, bool floatStitch) {
   if(MT) {
     red->reduce(boost::bind(&AccumulatedSCHessianSSE::setZero, accSSE_bot, nFrames,  _1, _2, _3, _4), 0, 0, 0);
     red->reduce(boost::bind(&AccumulatedSCHessianSSE::addPointsInternal,
                             accSSE_bot, &allPoints, true,  _1, _2, _3, _4), 0, allPoints.size(), 50);
-    accSSE_bot->stitchDoubleMT(red, H, b, this, true);
+    accSSE_bot->stitchDoubleMT(red, H, b, this, true, floatStitch);
   }
   else
   {
@@ -264,7 +269,7 @@ void EnergyFunctional::accumulateSCF_MT(MatXX &H, VecX &b, bool MT) {
     for(EFFrame* f : frames)
       for(EFPoint* p : f->points)
         accSSE_bot->addPoint(p, true);
-    accSSE_bot->stitchDoubleMT(red, H, b,this, false);
+    accSSE_bot->stitchDoubleMT(red, H, b,this, false, floatStitch);
   }
 }
 
@@ -347,7 +352,7 @@ double EnergyFunctional::calcMEnergyF() {
   assert(EFIndicesValid);
 
   VecX delta = getStitchedDeltaF();
-  return delta.dot(2*bM + HM*delta);
+  return delta.dot(2*bM() + HM()*delta);
 }
 
 /// Calculate the sum of the energy E at all points, delta is relative
@@ -450,7 +455,7 @@ EFResidual* EnergyFunctional::insertResidual(PointFrameResidual* r) {
   r->point->efPoint->residualsAll.push_back(efr);
 
   /// Increment the res count between two frames
-  connectivityMap[(((long)efr->host->frameID) << 32) + ((long)efr->target->frameID)][0]++;
+  connectivityOf(efr->host, efr->target)[0]++;
 
   nResiduals++;
   r->efResidual = efr;
@@ -470,16 +475,18 @@ EFFrame* EnergyFunctional::insertFrame(FrameHessian* fh, CalibHessian* Hcalib) {
   fh->efFrame = eff;
 
   /// Marginalize one frame, missing 8
-  assert(HM.cols() == 8*nFrames + CPARS - 8);
+  assert(nM == 8*nFrames + CPARS - 8);
 
   /// 8 parameters per frame + camera  intrinsic parameters
-  bM.conservativeResize(8*nFrames + CPARS);
-  HM.conservativeResize(8*nFrames + CPARS, 8*nFrames + CPARS);
+  reserveM(8*nFrames + CPARS);
+  nM = 8*nFrames + CPARS;
+
+  nullspaceBasisValid = false;
 
   /// block of new frame is 0
-  bM.tail<8>().setZero();
-  HM.rightCols<8>().setZero();
-  HM.bottomRows<8>().setZero();
+  bM().tail<8>().setZero();
+  HM().rightCols<8>().setZero();
+  HM().bottomRows<8>().setZero();
 
   EFIndicesValid = false;
   EFAdjointsValid=false;
@@ -491,18 +498,46 @@ EFFrame* EnergyFunctional::insertFrame(FrameHessian* fh, CalibHessian* Hcalib) {
   /// Set id
   makeIDX();
 
-  for(EFFrame* fh2 : frames) {
-    /// The first 32 bits are the historical ID of the host frame, and the last 32 bits are the historical ID of the Target
-    connectivityMap[(((long)eff->frameID) << 32) + ((long)fh2->frameID)] = Eigen::Vector2i(0,0);
+  /// Grow the connectivity matrix if the window got larger than ever before, keeping the counts.
+  if(nFrames > connectivityStride) {
+    int stride = std::max(nFrames, 2*connectivityStride);
+    std::vector<Eigen::Vector2i> grown(stride*stride, Eigen::Vector2i(0,0));
+    for(int h=0;h<nFrames-1;h++)
+      for(int t=0;t<nFrames-1;t++)
+        grown[h*stride+t] = connectivity[h*connectivityStride+t];
+    connectivity.swap(grown);
+    connectivityStride = stride;
+  }
 
-    if(fh2 != eff) {
-      connectivityMap[(((long)fh2->frameID) << 32) + ((long)eff->frameID)] = Eigen::Vector2i(0,0);
-    }
+  for(EFFrame* fh2 : frames) {
+    connectivityOf(eff, fh2) = Eigen::Vector2i(0,0);
+    connectivityOf(fh2, eff) = Eigen::Vector2i(0,0);
   }
 
   return eff;
 }
 
+Eigen::Vector2i &EnergyFunctional::connectivityOf(const EFFrame* host, const EFFrame* target) {
+  assert(host->idx >= 0 && host->idx < connectivityStride && target->idx >= 0 && target->idx < connectivityStride);
+  return connectivity[host->idx*connectivityStride + target->idx];
+}
+
+/// Write the connectivity of fh (leaving the window) into the history map.
+void EnergyFunctional::flushConnectivity(EFFrame* fh) {
+  for(EFFrame* fh2 : frames) {
+    /// The first 32 bits are the historical ID of the host frame, and the last 32 bits are the historical ID of the Target
+    connectivityMap[(((long)fh->frameID) << 32) + ((long)fh2->frameID)] = connectivityOf(fh, fh2);
+    connectivityMap[(((long)fh2->frameID) << 32) + ((long)fh->frameID)] = connectivityOf(fh2, fh);
+  }
+}
+
+const std::map<long,Eigen::Vector2i> &EnergyFunctional::getConnectivityMap() {
+  for(EFFrame* fh : frames)
+    for(EFFrame* fh2 : frames)
+      connectivityMap[(((long)fh->frameID) << 32) + ((long)fh2->frameID)] = connectivityOf(fh, fh2);
+  return connectivityMap;
+}
+
 /// Insert a point into the energy function and put it into the corresponding EFframe
 EFPoint* EnergyFunctional::insertPoint(PointHessian* ph) {
   EFPoint* efp = new EFPoint(ph, ph->host->efFrame);
@@ -541,7 +576,7 @@ void EnergyFunctional::dropResidual(EFResidual* r) {
   }
 
   /// residual key minus one
-  connectivityMap[(((long)r->host->frameID) << 32) + ((long)r->target->frameID)][0]--;
+  connectivityOf(r->host, r->target)[0]--;
   nResiduals--;
 
   /// PointFrameHessian pointer to the residual
@@ -567,67 +602,68 @@ void EnergyFunctional::marginalizeFrame(EFFrame* fh) {
 
   /// [*** step 1 ***] Move the marginalized frame to the far right, farthest
   /// HM bM is obtained by the marginalization point
+  /// In place: the 8 rows / columns are swapped past each following frame.
+  Eigen::Block<MatXX> H = HM();
+  Eigen::VectorBlock<VecX> b = bM();
   if((int)fh->idx != (int)frames.size()-1) {
     int io = fh->idx*8+CPARS;	                 // index of frame to move to end
     int ntail = 8*(nFrames-fh->idx-1);           /// Number of variables behind marginalized frames
     assert((io+8+ntail) == nFrames*8+CPARS);
 
-    Vec8 bTmp = bM.segment<8>(io);      /// Number of variables behind marginalized frames...
-    VecX tailTMP = bM.tail(ntail);      /// Back to front
-    bM.segment(io,ntail) = tailTMP;
-    bM.tail<8>() = bTmp;
-
-    /// Marginalize the frame to the right and move it to the front
-    MatXX HtmpCol = HM.block(0,io,odim,8);
-    MatXX rightColsTmp = HM.rightCols(ntail);
-    HM.block(0,io,odim,ntail) = rightColsTmp;
-    HM.rightCols(8) = HtmpCol;
-
-    /// Move the bottom edge of the frame up
-    MatXX HtmpRow = HM.block(io,0,8,odim);
-    MatXX botRowsTmp = HM.bottomRows(ntail);
-    HM.block(io,0,ntail,odim) = botRowsTmp;
-    HM.bottomRows(8) = HtmpRow;
+    for(int k=io; k+8<odim; k+=8) {
+      b.segment<8>(k).swap(b.segment<8>(k+8));
+      H.middleCols<8>(k).swap(H.middleCols<8>(k+8));
+    }
+    for(int k=io; k+8<odim; k+=8)
+      H.middleRows<8>(k).swap(H.middleRows<8>(k+8));
   }
 
   /// [*** step 2 ***] plus prior
   /// If the frame obtained from the initialization has a priori, it needs to be added when marginalizing. The lightness also has a priori
   //	// marginalize. First add prior here, instead of to active.
-  HM.bottomRightCorner<8,8>().diagonal() += fh->prior;
-  bM.tail<8>() += fh->prior.cwiseProduct(fh->delta_prior);
-
-  /// [*** step 3 ***] First scaled and then calculate Schur complement
-  //	std::cout << std::setprecision(16) << "HMPre:\n" << HM << "\n\n";
-  VecX SVec = (HM.diagonal().cwiseAbs()+VecX::Constant(HM.cols(), 10)).cwiseSqrt();
-  VecX SVecI = SVec.cwiseInverse();
+  H.bottomRightCorner<8,8>().diagonal() += fh->prior;
+  b.tail<8>() += fh->prior.cwiseProduct(fh->delta_prior);
 
-  //	std::cout << std::setprecision(16) << "SVec: " << SVec.transpose() << "\n\n";
-  //	std::cout << std::setprecision(16) << "SVecI: " << SVecI.transpose() << "\n\n";
-
-  // scale!
-  MatXX HMScaled = SVecI.asDiagonal() * HM * SVecI.asDiagonal();
-  VecX bMScaled =  SVecI.asDiagonal() * bM;
+  /// [*** step 3 ***] Schur complement, rank-8 update of the remaining block.
+  /// The diagonal scaling cancels everywhere except in the inverse of the 8x8 block, so only that is scaled.
+  //	std::cout << std::setprecision(16) << "HMPre:\n" << H << "\n\n";
+  Vec8 SVec = (H.bottomRightCorner<8,8>().diagonal().cwiseAbs()+Vec8::Constant(10)).cwiseSqrt();
+  Vec8 SVecI = SVec.cwiseInverse();
 
   // invert bottom part!
-  Mat88 hpi = HMScaled.bottomRightCorner<8,8>();
-  hpi = 0.5f*(hpi+hpi);
+  Mat88 hpi = SVecI.asDiagonal() * H.bottomRightCorner<8,8>() * SVecI.asDiagonal();
+  hpi = 0.5f*(hpi+hpi.transpose());
   hpi = hpi.inverse();
-  hpi = 0.5f*(hpi+hpi);
+  hpi = 0.5f*(hpi+hpi.transpose());
+  hpi = SVecI.asDiagonal() * hpi * SVecI.asDiagonal();
 
   // schur-complement!
-  MatXX bli = HMScaled.bottomLeftCorner(8,ndim).transpose() * hpi;
-  HMScaled.topLeftCorner(ndim,ndim).noalias() -= bli * HMScaled.bottomLeftCorner(8,ndim);
-  bMScaled.head(ndim).noalias() -= bli*bMScaled.tail<8>();
-
-  //unscale!
-  HMScaled = SVec.asDiagonal() * HMScaled * SVec.asDiagonal();
-  bMScaled = SVec.asDiagonal() * bMScaled;
+  Eigen::Block<MatXX> bli = margBli.topRows(ndim);
+  bli.noalias() = H.bottomLeftCorner(8,ndim).transpose() * hpi;
+  H.topLeftCorner(ndim,ndim).noalias() -= bli * H.bottomLeftCorner(8,ndim);
+  b.head(ndim).noalias() -= bli * b.tail<8>();
 
   // set.
-  HM = 0.5*(HMScaled.topLeftCorner(ndim,ndim) + HMScaled.topLeftCorner(ndim,ndim).transpose());
-  bM = bMScaled.head(ndim);
+  for(int c=0; c<ndim; c++)
+    for(int r=0; r<c; r++) {
+      double v = 0.5*(H(r,c) + H(c,r));
+      H(r,c) = H(c,r) = v;
+    }
+  nM = ndim;
 
   /// [*** step 4 ***] Change the ID number of EFFrame, and delete
+  /// The counts of fh go to the history, its row and column are removed from the connectivity matrix.
+  flushConnectivity(fh);
+  for(int h=0, hn=0; h<nFrames; h++) {
+    if(h == fh->idx) continue;
+    for(int t=0, tn=0; t<nFrames; t++) {
+      if(t == fh->idx) continue;
+      connectivity[hn*connectivityStride+tn] = connectivity[h*connectivityStride+t];
+      tn++;
+    }
+    hn++;
+  }
+
   // remove from vector, without changing the order!
   for(unsigned int i=fh->idx; i+1<frames.size();i++) {
     frames[i] = frames[i+1];
@@ -637,10 +673,11 @@ void EnergyFunctional::marginalizeFrame(EFFrame* fh) {
   frames.pop_back();
   nFrames--;
   fh->data->efFrame=0;
+  nullspaceBasisValid = false;
 
-  assert((int)frames.size()*8+CPARS == (int)HM.rows());
-  assert((int)frames.size()*8+CPARS == (int)HM.cols());
-  assert((int)frames.size()*8+CPARS == (int)bM.size());
+  assert((int)frames.size()*8+CPARS == (int)HM().rows());
+  assert((int)frames.size()*8+CPARS == (int)HM().cols());
+  assert((int)frames.size()*8+CPARS == (int)bM().size());
   assert((int)frames.size() == (int)nFrames);
 
   //VecX eigenvaluesPost = HM.eigenvalues().real();
@@ -676,7 +713,7 @@ void EnergyFunctional::marginalizePointsF() {
         for(EFResidual* r : p->residualsAll) {
           /// Marginalized residual count
           if(r->isActive()) {
-            connectivityMap[(((long)r->host->frameID) << 32) + ((long)r->target->frameID)][1]++;
+            connectivityOf(r->host, r->target)[1]++;
           }
         }
 
@@ -724,11 +761,13 @@ void EnergyFunctional::marginalizePointsF() {
 
   /// Weights the amount of marginalization, inaccurate linearization
   /// So the marginalized part is directly added to HM bM
-  HM += setting_margWeightFac*H;
-  bM += setting_margWeightFac*b;
+  HM() += setting_margWeightFac*H;
+  bM() += setting_margWeightFac*b;
 
-  if(setting_solverMode & SOLVER_ORTHOGONALIZE_FULL)
-    orthogonalize(&bM, &HM);
+  if(setting_solverMode & SOLVER_ORTHOGONALIZE_FULL) {
+    orthogonalizeB(bM());
+    orthogonalizeH(HM());
+  }
 
   EFIndicesValid = false;
   /// Grooming ID
@@ -753,10 +792,9 @@ void EnergyFunctional::dropPointsF() {
 
 /// Remove a point p from EFFrame
 void EnergyFunctional::removePoint(EFPoint* p) {
-  for(EFResidual* r : p->residualsAll) {
-    /// throw away all the residuals of the change
-    dropResidual(r);
-  }
+  /// throw away all the residuals, from the back so every drop is a plain pop.
+  while(!p->residualsAll.empty())
+    dropResidual(p->residualsAll.back());
 
   EFFrame* h = p->host;
   h->points[p->idxInPoints] = h->points.back();
@@ -777,6 +815,36 @@ void EnergyFunctional::orthogonalize(VecX* b, MatXX* H) {
   //	std::sort(eigenvaluesPre.data(), eigenvaluesPre.data()+eigenvaluesPre.size());
   //	std::cout << "EigPre:: " << eigenvaluesPre.transpose() << "\n";
 
+  /// Subtract the nullspace from H and b
+  if(b!=0) orthogonalizeB(*b);
+  if(H!=0) orthogonalizeH(*H);
+
+  //	VecX eigenvaluesPost = H.eigenvalues().real();
+  //	std::sort(eigenvaluesPost.data(), eigenvaluesPost.data()+eigenvaluesPost.size());
+  //	std::cout << "EigPost:: " << eigenvaluesPost.transpose() << "\n";
+}
+
+/// b -= Q*(Q'*b)
+void EnergyFunctional::orthogonalizeB(Eigen::Ref<VecX> b) {
+  const MatXX &Q = nullspaceBasis();
+  assert(Q.rows() == b.rows());
+  VecX Qtb = Q.transpose() * b;
+  b.noalias() -= Q * Qtb;
+}
+
+/// H -= Q*(Q'*H*Q)*Q', two thin products instead of the dense [dim] x [dim] projector.
+void EnergyFunctional::orthogonalizeH(Eigen::Ref<MatXX> H) {
+  const MatXX &Q = nullspaceBasis();
+  assert(Q.rows() == H.rows() && Q.rows() == H.cols());
+  MatXX QtHQ = Q.transpose() * H * Q;   // [k] x [k]
+  MatXX QQtHQ = Q * QtHQ;               // [dim] x [k]
+  H.noalias() -= QQtHQ * Q.transpose();
+}
+
+const MatXX &EnergyFunctional::nullspaceBasis() {
+  int dim = CPARS+8*nFrames;
+  if(nullspaceBasisValid && nullspaceQ.rows() == dim) return nullspaceQ;
+
   // decide to which nullspaces to orthogonalize.
   std::vector<VecX> ns;
   ns.insert(ns.end(), lastNullspaces_pose.begin(), lastNullspaces_pose.end());
@@ -792,85 +860,77 @@ void EnergyFunctional::orthogonalize(VecX* b, MatXX* H) {
   for(unsigned int i=0;i<ns.size();i++) {
     N.col(i) = ns[i].normalized();
   }
+  assert(N.rows() == dim);
+
+  /// N * (N' * N)^-1 * N' = Q*Q' for the orthonormal basis Q of range(N).
+  /// Directions with a pivot below setting_solverModeDelta (relative to the largest) count as dependent, as with the SVD before.
+  Eigen::ColPivHouseholderQR<MatXX> qr(N);
+  qr.setThreshold(setting_solverModeDelta);
+  int rank = qr.rank();
+
+  MatXX Q = qr.householderQ() * MatXX::Identity(N.rows(), rank);
+  nullspaceQ.swap(Q);
+  nullspaceBasisValid = true;
+  return nullspaceQ;
+}
 
-  /// Find pseudoinverse
-  // compute Npi := N * (N' * N)^-1 = pseudo inverse of N.
-  Eigen::JacobiSVD<MatXX> svdNN(N, Eigen::ComputeThinU | Eigen::ComputeThinV);
-
-  VecX SNN = svdNN.singularValues();
-  double minSv = 1e10, maxSv = 0;
+/// Grows the storage behind HM() / bM() to at least dim, keeping the current nM block.
+void EnergyFunctional::reserveM(int dim) {
+  if(HMStorage.rows() >= dim) return;
+
+  MatXX Hn = MatXX::Zero(dim, dim);
+  VecX bn = VecX::Zero(dim);
+  Hn.topLeftCorner(nM, nM) = HMStorage.topLeftCorner(nM, nM);
+  bn.head(nM) = bMStorage.head(nM);
+  HMStorage.swap(Hn);
+  bMStorage.swap(bn);
+  margBli.resize(dim, 8);
+}
 
-  for(int i=0;i<SNN.size();i++) {
-    if(SNN[i] < minSv) minSv = SNN[i];
-    if(SNN[i] > maxSv) maxSv = SNN[i];
+/// float LDLT of the (scaled) system, refined with residuals computed in double.
+/// Falls back to a double LDLT if the refinement does not reach setting_precisionRefineTH.
+static VecX solveLDLTRefined(const MatXX &H, const VecX &b) {
+  Eigen::LDLT<MatXXf> ldlt(H.cast<float>());
+  VecX x = ldlt.solve(b.cast<float>()).cast<double>();
+
+  const double bNorm = b.norm();
+  double relRes = 0;
+  for(int it=0; ; it++) {
+    VecX r = b - H*x;
+    relRes = r.norm() / std::max(bNorm, 1e-30);
+    if(relRes <= setting_precisionRefineTH || it >= setting_precisionRefineIts || !std::isfinite(relRes)) break;
+    x += ldlt.solve(r.cast<float>()).cast<double>();
   }
 
-  /// Setting_solverModeDelta (1e-5) times smaller than the maximum singular value, it is considered to be 0
-  /// find the inverse
-  for(int i=0;i<SNN.size();i++) {
-    if(SNN[i] > setting_solverModeDelta*maxSv)
-      SNN[i] = 1.0 / SNN[i];
-    else
-      SNN[i] = 0;
-  }
+  if(relRes <= setting_precisionRefineTH) return x;
 
-  MatXX Npi = svdNN.matrixU() * SNN.asDiagonal() * svdNN.matrixV().transpose(); 	// [dim] x 9.
-  /// Npi.transpose () is the pseudo-inverse of N
-  MatXX NNpiT = N*Npi.transpose(); 	// [dim] x [dim].
-  MatXX NNpiTS = 0.5*(NNpiT + NNpiT.transpose());	// = N * (N' * N)^-1 * N'.
-
-  /// Why did you do this?
-  /// Subtract the nullspace from H and b ???
-  if(b!=0) {
-    *b -= NNpiTS * *b;
-  }
-  if(H!=0) {
-    *H -= NNpiTS * *H * NNpiTS;
-  }
-
-  //	std::cout << std::setprecision(16) << "Orth SV: " << SNN.reverse().transpose() << "\n";
-  //	VecX eigenvaluesPost = H.eigenvalues().real();
-  //	std::sort(eigenvaluesPost.data(), eigenvaluesPost.data()+eigenvaluesPost.size());
-  //	std::cout << "EigPost:: " << eigenvaluesPost.transpose() << "\n";
+  if(!setting_debugout_runquiet)
+    printf("float solve not accurate enough (rel. residual %g), solving in double.\n", relRes);
+  return H.ldlt().solve(b);
 }
 
-/// Calculate normal equations and solve
-void EnergyFunctional::solveSystemF(int iteration, double lambda, CalibHessian* HCalib) {
-  /// Different bits control different modes
-  if(setting_solverMode & SOLVER_USE_GN) {
-    lambda=0;
-  }
-  /// Really damn GN, just a little damping
-  if(setting_solverMode & SOLVER_FIX_LAMBDA) {
-    lambda = 1e-5;
-  }
-
-  assert(EFDeltaValid);
-  assert(EFAdjointsValid);
-  assert(EFIndicesValid);
-
+/// [*** step 1, 2 ***] of solveSystemF: H and b of the camera / frame part, with the marginalization prior,
+/// the Schur complement of the points and the damping. Also stores the undamped system in lastHS / lastbS.
+void EnergyFunctional::buildSystemF(MatXX &HFinal_top, VecX &bFinal_top, double lambda, bool floatStitch) {
   /// [*** step 1 ***] Calculate normal equations first, involving marginalization, prior, Schur complement, etc.
   MatXX HL_top, HA_top, H_sc;
   VecX  bL_top, bA_top, bM_top, b_sc;
 
   /// For the new residual, the current residual used, without the idepth
-  accumulateAF_MT(HA_top, bA_top,multiThreading);
+  accumulateAF_MT(HA_top, bA_top,multiThreading,floatStitch);
 
   /// Residuals of marginalization fix, with marginalization pairs, use res_toZeroF minus the linearization part, plus the prior, the part without idepth
   /// bug: There are no points involved at all here, only a priori information, because the marginalized and deleted points are not there anymore
   /// ! The only effect here is to zero the p
   /// Calculated from previous calculations
-  accumulateLF_MT(HL_top, bL_top,multiThreading);
+  accumulateLF_MT(HL_top, bL_top,multiThreading,floatStitch);
 
   /// Schur part about idepth
-  accumulateSCF_MT(H_sc, b_sc, multiThreading);
+  accumulateSCF_MT(H_sc, b_sc, multiThreading, floatStitch);
 
   /// TODO What are HM and bM
   /// Due to the fixed linearization point, the residuals are updated every iteration
-  bM_top = (bM + HM*getStitchedDeltaF());
-
-  MatXX HFinal_top;
-  VecX bFinal_top;
+  bM_top = (bM() + HM()*getStitchedDeltaF());
 
   /// [*** step 2 ***] If it is set to solve the orthogonal system, set the corresponding nullspace part of Jacobian to 0, otherwise calculate the schur normally
   if(setting_solverMode & SOLVER_ORTHOGONALIZE_SYSTEM) {
@@ -890,7 +950,7 @@ void EnergyFunctional::solveSystemF(int iteration, double lambda, CalibHessian*
     if(!haveFirstFrame)
       orthogonalize(&bT_act, &HT_act);
 
-    HFinal_top = HT_act + HM;
+    HFinal_top = HT_act + HM();
     bFinal_top = bT_act + bM_top;
 
     lastHS = HFinal_top;
@@ -903,7 +963,7 @@ void EnergyFunctional::solveSystemF(int iteration, double lambda, CalibHessian*
     }
   }
   else {
-    HFinal_top = HL_top + HM + HA_top;
+    HFinal_top = HL_top + HM() + HA_top;
     bFinal_top = bL_top + bM_top + bA_top - b_sc;
 
     lastHS = HFinal_top - H_sc;
@@ -917,8 +977,10 @@ void EnergyFunctional::solveSystemF(int iteration, double lambda, CalibHessian*
 
     HFinal_top -= H_sc * (1.0f/(1+lambda)); /// Because Schur has a diagonal inverse, so it is a countdown
   }
+}
 
-  /// [*** step 3 ***] Solve using SVD, or solve directly with ldlt
+/// [*** step 3 ***] of solveSystemF: the step x of HFinal_top * x = bFinal_top.
+VecX EnergyFunctional::solveScaledF(const MatXX &HFinal_top, const VecX &bFinal_top, bool floatSolve) {
   VecX x;
 
   if(setting_solverMode & SOLVER_SVD) {
@@ -973,7 +1035,59 @@ void EnergyFunctional::solveSystemF(int iteration, double lambda, CalibHessian*
     std::cout << "scaled\n" << HFinalScaled << std::endl;
 #endif
 
-    x = SVecI.asDiagonal() * HFinalScaled.ldlt().solve(SVecI.asDiagonal() * bFinal_top);//  SVec.asDiagonal() * svd.matrixV() * Ub;
+    if(floatSolve)
+      x = SVecI.asDiagonal() * solveLDLTRefined(HFinalScaled, SVecI.asDiagonal() * bFinal_top);
+    else
+      x = SVecI.asDiagonal() * HFinalScaled.ldlt().solve(SVecI.asDiagonal() * bFinal_top);//  SVec.asDiagonal() * svd.matrixV() * Ub;
+  }
+
+  return x;
+}
+
+/// Calculate normal equations and solve
+void EnergyFunctional::solveSystemF(int iteration, double lambda, CalibHessian* HCalib) {
+  /// Different bits control different modes
+  if(setting_solverMode & SOLVER_USE_GN) {
+    lambda=0;
+  }
+  /// Really damn GN, just a little damping
+  if(setting_solverMode & SOLVER_FIX_LAMBDA) {
+    lambda = 1e-5;
+  }
+
+  assert(EFDeltaValid);
+  assert(EFAdjointsValid);
+  assert(EFIndicesValid);
+
+  /// [*** step 1, 2 ***] normal equations of the window, damped with lambda.
+  MatXX HFinal_top;
+  VecX bFinal_top;
+  buildSystemF(HFinal_top, bFinal_top, lambda, setting_precisionMode & PRECISION_FLOAT_STITCH);
+
+  /// [*** step 3 ***] Solve using SVD, or solve directly with ldlt
+  VecX x = solveScaledF(HFinal_top, bFinal_top, setting_precisionMode & PRECISION_FLOAT_SOLVE);
+
+  /// A/B check of the float path: build and solve the same window again in double, compare the steps and
+  /// the energy of the quadratic model (0.5 x'Hx - x'b, on the double system), take the double step if they differ too much.
+  /// lastHS / lastbS are left with the double system.
+  if(setting_precisionAB && setting_precisionMode != 0) {
+    MatXX HFinalD;
+    VecX bFinalD;
+    buildSystemF(HFinalD, bFinalD, lambda, false);
+    VecX xD = solveScaledF(HFinalD, bFinalD, false);
+
+    double stepDiff = (x - xD).norm() / std::max(xD.norm(), 1e-30);
+    double energyF = 0.5*x.dot(lastHS*x) - x.dot(lastbS);
+    double energyD = 0.5*xD.dot(lastHS*xD) - xD.dot(lastbS);
+    double energyDiff = std::abs(energyF - energyD) / std::max(std::abs(energyD), 1e-30);
+    bool fallback = !std::isfinite(stepDiff) || !std::isfinite(energyDiff) ||
+                    stepDiff > setting_precisionABTH || energyDiff > setting_precisionABTH;
+
+    printf("PRECISION A/B it %d: step |dx| %g (rel. %g), model energy float %g / double %g (rel. %g)%s\n",
+           iteration, (x - xD).norm(), stepDiff, energyF, energyD, energyDiff,
+           fallback ? ", using double!" : "");
+
+    if(fallback) x = xD;
   }
 
   /// [*** step 4 ***] If it is set to process the solution directly, directly remove the nullspace in the solution x
@@ -88,8 +88,12 @@ class EnergyFunctional {
   std::vector<EFFrame*> frames;       /// Frames in the energy function
   int nPoints, nFrames, nResiduals;   /// Number of EFPoint, number of EFframe key frames, number of residuals
 
-  MatXX HM;   /// Optimized Hessian matrix with marginalized inverse depth
-  VecX bM;    /// Optimized Jr term, marginalized inverse depth
+  /// Marginalization prior: Hessian and Jr term with the inverse depths marginalized, size CPARS+8*nFrames.
+  /// Views into fixed-capacity storage, inserting or marginalizing a frame does not reallocate.
+  Eigen::Block<MatXX> HM() { return HMStorage.topLeftCorner(nM, nM); }
+  Eigen::Block<const MatXX> HM() const { return HMStorage.topLeftCorner(nM, nM); }
+  Eigen::VectorBlock<VecX> bM() { return bMStorage.head(nM); }
+  Eigen::VectorBlock<const VecX> bM() const { return bMStorage.head(nM); }
 
   int resInA, resInL, resInM;  /// The number of residuals in calculating A, L, marginalized H, and b, respectively
   MatXX lastHS;
@@ -100,30 +104,57 @@ class EnergyFunctional {
   std::vector<VecX> lastNullspaces_scale;
   std::vector<VecX> lastNullspaces_affA;
   std::vector<VecX> lastNullspaces_affB;
+  /// lastNullspaces_* were rebuilt, the cached projector has to be recomputed.
+  inline void nullspacesChanged() { nullspaceBasisValid = false; }
 
   IndexThreadReduce<Vec10>* red;
 
-  /// History ID
-  /// 64-bit alignment
-  /// The connection relationship between keyframes,
+  /// The connection relationship between keyframes, for display.
   /// first: the first 32 represents the host ID, and the last 32 bits represents the target ID;
   /// second: the number [0] ordinary, [1] marginalized
-  std::map<long,Eigen::Vector2i> connectivityMap;
+  /// Pairs of the current window are copied over from the flat connectivity matrix first.
+  const std::map<long,Eigen::Vector2i> &getConnectivityMap();
 
  private:
+  /// History of all pairs, frames leaving the window are written here once.
+  std::map<long,Eigen::Vector2i> connectivityMap;
+
+  /// Residual counts of the window, [host->idx*connectivityStride + target->idx]; updated per residual.
+  std::vector<Eigen::Vector2i> connectivity;
+  int connectivityStride;
+  Eigen::Vector2i &connectivityOf(const EFFrame* host, const EFFrame* target);
+  void flushConnectivity(EFFrame* fh);
 
   VecX getStitchedDeltaF() const;
 
   void resubstituteF_MT(VecX x, CalibHessian* HCalib, bool MT);
   void resubstituteFPt(const VecCf &xc, Mat18f* xAd, int min, int max, Vec10* stats, int tid);
 
-  void accumulateAF_MT(MatXX &H, VecX &b, bool MT);
-  void accumulateLF_MT(MatXX &H, VecX &b, bool MT);
-  void accumulateSCF_MT(MatXX &H, VecX &b, bool MT);
+  void accumulateAF_MT(MatXX &H, VecX &b, bool MT, bool floatStitch);
+  void accumulateLF_MT(MatXX &H, VecX &b, bool MT, bool floatStitch);
+  void accumulateSCF_MT(MatXX &H, VecX &b, bool MT, bool floatStitch);
+
+  void buildSystemF(MatXX &HFinal_top, VecX &bFinal_top, double lambda, bool floatStitch);
+  VecX solveScaledF(const MatXX &HFinal_top, const VecX &bFinal_top, bool floatSolve);
 
   void calcLEnergyPt(int min, int max, Vec10* stats, int tid);
 
+  /// Removes the pose and scale nullspaces: b -= P*b, H -= P*H*P with P = N * (N' * N)^-1 * N' = Q*Q'.
   void orthogonalize(VecX* b, MatXX* H);
+  void orthogonalizeB(Eigen::Ref<VecX> b);
+  void orthogonalizeH(Eigen::Ref<MatXX> H);
+
+  /// Orthonormal basis Q of the nullspaces (QR of N), cached until the nullspaces or the frames change.
+  const MatXX &nullspaceBasis();
+  MatXX nullspaceQ;
+  bool nullspaceBasisValid;
+
+  /// Storage behind HM() / bM(), capacity grows only if the window gets larger than setting_maxFrames+1.
+  MatXX HMStorage;
+  VecX bMStorage;
+  MatXX margBli;  /// [capacity] x 8, H_ab * H_bb^-1 of the frame being marginalized.
+  int nM;
+  void reserveM(int dim);
   Mat18f* adHTdeltaF;  /// Pose increment between host and target, total number of frames × number of frames
 
   //// arbitrary public
@@ -134,6 +165,10 @@ class EnergyFunctional {
   Mat88f* adHostF;     /// Adjoint matrix, float
   Mat88f* adTargetF;
 
+  /// adjoints in the precision the Hessian is stitched in.
+  template<typename Scalar> inline const Eigen::Matrix<Scalar,8,8>& adHostT(int i) const;
+  template<typename Scalar> inline const Eigen::Matrix<Scalar,8,8>& adTargetT(int i) const;
+
  private:
   VecC cPrior;        /// <setting_initialCalibHessian information matrix
   VecCf cDeltaF;      /// Camera Increment
@@ -150,4 +185,9 @@ class EnergyFunctional {
   float currentLambda;
 };
 
+template<> inline const Mat88& EnergyFunctional::adHostT<double>(int i) const { return adHost[i]; }
+template<> inline const Mat88& EnergyFunctional::adTargetT<double>(int i) const { return adTarget[i]; }
+template<> inline const Mat88f& EnergyFunctional::adHostT<float>(int i) const { return adHostF[i]; }
+template<> inline const Mat88f& EnergyFunctional::adTargetT<float>(int i) const { return adTargetF[i]; }
+
 } // namespace dso
@@ -29,6 +29,7 @@
 #include "vector"
 #include <math.h>
 #include "OptimizationBackend/RawResidualJacobian.h"
+#include "util/ObjectPool.h"
 
 namespace dso {
 
@@ -44,7 +45,7 @@ class EnergyFunctional;
 
 class EFResidual {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+  DSO_POOL_OPERATOR_NEW(EFResidual);
 
   inline EFResidual(PointFrameResidual* org, EFPoint* point_, EFFrame* host_, EFFrame* target_)
       : data(org), point(point_), host(host_), target(target_)
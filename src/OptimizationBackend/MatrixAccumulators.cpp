@@ -0,0 +1,324 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "OptimizationBackend/MatrixAccumulators.h"
+#include "util/settings.h"
+#include <immintrin.h>
+#include <stdio.h>
+
+/// the wide kernels are compiled per function (target attribute), the rest of the library keeps the portable baseline.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSO_HAS_WIDE_ACC 1
+#define DSO_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define DSO_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define DSO_HAS_WIDE_ACC 0
+#endif
+
+namespace dso
+{
+
+/// Start of row r in the packed upper triangle of the 10 * 10 block of AccumulatorApprox.
+static const int approxRowStart[10] = {0,10,19,27,34,40,45,49,52,54};
+
+static int detectSimdLevel()
+{
+  int level = ACC_SIMD_SSE;
+#if DSO_HAS_WIDE_ACC
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) level = ACC_SIMD_AVX2;
+  if(level == ACC_SIMD_AVX2 && __builtin_cpu_supports("avx512f")) level = ACC_SIMD_AVX512;
+#endif
+  if(setting_simdLevel >= 0 && setting_simdLevel < level) level = setting_simdLevel;
+
+  const char* names[3] = {"SSE", "AVX2", "AVX-512"};
+  if(!setting_debugout_runquiet)
+    printf("ACCUMULATORS: using %s kernels\n", names[level]);
+  return level;
+}
+
+int accumulatorSimdLevel()
+{
+  static const int level = detectSimdLevel();
+  return level;
+}
+
+#if DSO_HAS_WIDE_ACC
+
+/// Index tables of the wide kernels, lane l of chunk c covers the packed value n = W*c + l.
+/// Lanes past the end point to index 10 of x / P / Q (always 0), resp. column 3 of TR (0), and add nothing.
+template<int W, int C>
+struct ApproxPattern {
+  EIGEN_ALIGN64 int row[C][W];    // 10 * 10 block: row r, column k of the packed upper triangle.
+  EIGEN_ALIGN64 int col[C][W];
+
+  ApproxPattern() {
+    int n=0;
+    for(int r=0; r<10; r++)
+      for(int k=r; k<10; k++, n++) {
+        row[n/W][n%W] = r;
+        col[n/W][n%W] = k;
+      }
+    for(; n<W*C; n++) row[n/W][n%W] = col[n/W][n%W] = 10;
+  }
+};
+
+template<int W, int C>
+struct TopRightPattern {
+  EIGEN_ALIGN64 int xIdx[C][W];   // 10 * 3 block: value n = 3*i + j needs x[i] and TR[j].
+  EIGEN_ALIGN64 int tIdx[C][W];
+
+  TopRightPattern() {
+    for(int n=0; n<W*C; n++) {
+      xIdx[n/W][n%W] = n<30 ? n/3 : 10;
+      tIdx[n/W][n%W] = n<30 ? n%3 : 3;
+    }
+  }
+};
+
+/// Lanes [0, n) set.
+DSO_TARGET_AVX2 static inline __m256i laneMask8(int n)
+{
+  return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0,1,2,3,4,5,6,7));
+}
+
+/// x = [x4, x6] of AccumulatorApprox in two registers, lo = x[0..7] and hi = x[8..9]; only the caller's 10 values are read.
+DSO_TARGET_AVX2 static inline void loadXY10AVX2(const float* const x4, const float* const x6, __m256 &lo, __m256 &hi)
+{
+  lo = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(x4)), _mm_loadu_ps(x6), 1);
+  hi = _mm256_maskload_ps(x6+4, laneMask8(2));
+}
+
+/// lane l = x[idx[l]], idx in [0, 16).
+DSO_TARGET_AVX2 static inline __m256 pick10AVX2(__m256 lo, __m256 hi, __m256i idx)
+{
+  __m256 fromHi = _mm256_castsi256_ps(_mm256_cmpgt_epi32(idx, _mm256_set1_epi32(7)));
+  return _mm256_blendv_ps(_mm256_permutevar8x32_ps(lo, idx), _mm256_permutevar8x32_ps(hi, idx), fromHi);
+}
+
+DSO_TARGET_AVX2 static void approxUpdateAVX2(float* Data,
+                                             const float* const x4, const float* const x6,
+                                             const float* const y4, const float* const y6,
+                                             const float a, const float b, const float c)
+{
+  static const ApproxPattern<8,7> pat;
+  __m256 Xlo, Xhi, Ylo, Yhi;
+  loadXY10AVX2(x4, x6, Xlo, Xhi);
+  loadXY10AVX2(y4, y6, Ylo, Yhi);
+
+  /// Data(r,k) += X[k]*P[r] + Y[k]*Q[r], P = a*X + b*Y, Q = b*X + c*Y.
+  const __m256 A = _mm256_set1_ps(a), B = _mm256_set1_ps(b), C = _mm256_set1_ps(c);
+  __m256 Plo = _mm256_fmadd_ps(A, Xlo, _mm256_mul_ps(B, Ylo));
+  __m256 Phi = _mm256_fmadd_ps(A, Xhi, _mm256_mul_ps(B, Yhi));
+  __m256 Qlo = _mm256_fmadd_ps(B, Xlo, _mm256_mul_ps(C, Ylo));
+  __m256 Qhi = _mm256_fmadd_ps(B, Xhi, _mm256_mul_ps(C, Yhi));
+
+  /// 56 lanes over the 55 packed values (Data has 60), the last lane adds 0.
+  for(int k=0; k<7; k++) {
+    __m256i ri = _mm256_load_si256((const __m256i*)pat.row[k]);
+    __m256i ci = _mm256_load_si256((const __m256i*)pat.col[k]);
+    __m256 acc = _mm256_loadu_ps(Data+8*k);
+    acc = _mm256_fmadd_ps(pick10AVX2(Xlo, Xhi, ci), pick10AVX2(Plo, Phi, ri), acc);
+    acc = _mm256_fmadd_ps(pick10AVX2(Ylo, Yhi, ci), pick10AVX2(Qlo, Qhi, ri), acc);
+    _mm256_storeu_ps(Data+8*k, acc);
+  }
+}
+
+DSO_TARGET_AVX2 static void approxTopRightAVX2(float* TopRight,
+                                               const float* const x4, const float* const x6,
+                                               const float* const y4, const float* const y6,
+                                               const float* TR0, const float* TR1)
+{
+  static const TopRightPattern<8,4> pat;
+  __m256 Xlo, Xhi, Ylo, Yhi;
+  loadXY10AVX2(x4, x6, Xlo, Xhi);
+  loadXY10AVX2(y4, y6, Ylo, Yhi);
+  __m256 T0 = _mm256_setr_ps(TR0[0],TR0[1],TR0[2],0,0,0,0,0);
+  __m256 T1 = _mm256_setr_ps(TR1[0],TR1[1],TR1[2],0,0,0,0,0);
+
+  for(int c=0; c<4; c++) {
+    __m256i xi = _mm256_load_si256((const __m256i*)pat.xIdx[c]);
+    __m256i ti = _mm256_load_si256((const __m256i*)pat.tIdx[c]);
+    __m256 t0 = _mm256_permutevar8x32_ps(T0, ti);
+    __m256 t1 = _mm256_permutevar8x32_ps(T1, ti);
+
+    /// 30 values in TopRight[32], the two lanes past them add 0.
+    __m256 acc = _mm256_loadu_ps(TopRight+8*c);
+    acc = _mm256_fmadd_ps(pick10AVX2(Xlo, Xhi, xi), t0, acc);
+    acc = _mm256_fmadd_ps(pick10AVX2(Ylo, Yhi, xi), t1, acc);
+    _mm256_storeu_ps(TopRight+8*c, acc);
+  }
+}
+
+DSO_TARGET_AVX2 static void acc9UpdateAVX2(float* SSEData, const float* const* J, const float* w, int i)
+{
+  __m256 Jv[9];
+  for(int k=0; k<9; k++) Jv[k] = _mm256_loadu_ps(J[k]+i);
+  __m256 wv = w ? _mm256_loadu_ps(w+i) : _mm256_set1_ps(1);
+
+  /// same packed layout as updateSSE: 45 entries of 4 lanes, the two 128-bit halves are folded.
+  float* pt = SSEData;
+  for(int r=0; r<9; r++) {
+    __m256 Jw = _mm256_mul_ps(Jv[r], wv);
+    for(int c=r; c<9; c++) {
+      __m256 p = _mm256_mul_ps(Jw, Jv[c]);
+      __m128 f = _mm_add_ps(_mm256_castps256_ps128(p), _mm256_extractf128_ps(p, 1));
+      _mm_store_ps(pt, _mm_add_ps(_mm_load_ps(pt), f));
+      pt+=4;
+    }
+  }
+}
+
+/// x = [x4, x6] of AccumulatorApprox in lanes 0..9, the expand load takes the 6 values of x6 into lanes 4..9.
+DSO_TARGET_AVX512 static inline __m512 loadXY10AVX512(const float* const x4, const float* const x6)
+{
+  return _mm512_mask_expandloadu_ps(_mm512_maskz_loadu_ps(0xF, x4), (__mmask16)0x3F0, x6);
+}
+
+DSO_TARGET_AVX512 static void approxUpdateAVX512(float* Data,
+                                                 const float* const x4, const float* const x6,
+                                                 const float* const y4, const float* const y6,
+                                                 const float a, const float b, const float c)
+{
+  static const ApproxPattern<16,4> pat;
+  __m512 X = loadXY10AVX512(x4, x6);
+  __m512 Y = loadXY10AVX512(y4, y6);
+  const __m512 A = _mm512_set1_ps(a), B = _mm512_set1_ps(b), C = _mm512_set1_ps(c);
+  __m512 P = _mm512_fmadd_ps(A, X, _mm512_mul_ps(B, Y));
+  __m512 Q = _mm512_fmadd_ps(B, X, _mm512_mul_ps(C, Y));
+
+  /// 64 lanes over the 55 packed values, Data has 60: the last chunk only touches 12.
+  for(int k=0; k<4; k++) {
+    __m512i ri = _mm512_load_si512(pat.row[k]);
+    __m512i ci = _mm512_load_si512(pat.col[k]);
+    __mmask16 m = k<3 ? (__mmask16)0xFFFF : (__mmask16)0x0FFF;
+    __m512 acc = _mm512_maskz_loadu_ps(m, Data+16*k);
+    acc = _mm512_fmadd_ps(_mm512_permutexvar_ps(ci, X), _mm512_permutexvar_ps(ri, P), acc);
+    acc = _mm512_fmadd_ps(_mm512_permutexvar_ps(ci, Y), _mm512_permutexvar_ps(ri, Q), acc);
+    _mm512_mask_storeu_ps(Data+16*k, m, acc);
+  }
+}
+
+DSO_TARGET_AVX512 static void approxTopRightAVX512(float* TopRight,
+                                                   const float* const x4, const float* const x6,
+                                                   const float* const y4, const float* const y6,
+                                                   const float* TR0, const float* TR1)
+{
+  static const TopRightPattern<16,2> pat;
+  __m512 X = loadXY10AVX512(x4, x6);
+  __m512 Y = loadXY10AVX512(y4, y6);
+  __m512 T0 = _mm512_maskz_loadu_ps(0x7, TR0);
+  __m512 T1 = _mm512_maskz_loadu_ps(0x7, TR1);
+
+  for(int c=0; c<2; c++) {
+    __m512i xi = _mm512_load_si512(pat.xIdx[c]);
+    __m512i ti = _mm512_load_si512(pat.tIdx[c]);
+    __m512 t0 = _mm512_permutexvar_ps(ti, T0);
+    __m512 t1 = _mm512_permutexvar_ps(ti, T1);
+
+    __m512 acc = _mm512_loadu_ps(TopRight+16*c);
+    acc = _mm512_fmadd_ps(_mm512_permutexvar_ps(xi, X), t0, acc);
+    acc = _mm512_fmadd_ps(_mm512_permutexvar_ps(xi, Y), t1, acc);
+    _mm512_storeu_ps(TopRight+16*c, acc);
+  }
+}
+
+DSO_TARGET_AVX512 static void acc9UpdateAVX512(float* SSEData, const float* const* J, const float* w, int i)
+{
+  __m512 Jv[9];
+  for(int k=0; k<9; k++) Jv[k] = _mm512_loadu_ps(J[k]+i);
+  __m512 wv = w ? _mm512_loadu_ps(w+i) : _mm512_set1_ps(1);
+
+  float* pt = SSEData;
+  for(int r=0; r<9; r++) {
+    __m512 Jw = _mm512_mul_ps(Jv[r], wv);
+    for(int c=r; c<9; c++) {
+      __m512 p = _mm512_mul_ps(Jw, Jv[c]);
+      __m128 f = _mm_add_ps(
+          _mm_add_ps(_mm512_extractf32x4_ps(p, 0), _mm512_extractf32x4_ps(p, 1)),
+          _mm_add_ps(_mm512_extractf32x4_ps(p, 2), _mm512_extractf32x4_ps(p, 3)));
+      _mm_store_ps(pt, _mm_add_ps(_mm_load_ps(pt), f));
+      pt+=4;
+    }
+  }
+}
+
+#endif
+
+bool accApproxUpdateWide(float* Data,
+                         const float* const x4, const float* const x6,
+                         const float* const y4, const float* const y6,
+                         const float a, const float b, const float c)
+{
+#if DSO_HAS_WIDE_ACC
+  int level = accumulatorSimdLevel();
+  if(level == ACC_SIMD_SSE) return false;
+
+  if(level >= ACC_SIMD_AVX512) approxUpdateAVX512(Data, x4, x6, y4, y6, a, b, c);
+  else approxUpdateAVX2(Data, x4, x6, y4, y6, a, b, c);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool accApproxTopRightWide(float* TopRight,
+                           const float* const x4, const float* const x6,
+                           const float* const y4, const float* const y6,
+                           const float TR00, const float TR10,
+                           const float TR01, const float TR11,
+                           const float TR02, const float TR12)
+{
+#if DSO_HAS_WIDE_ACC
+  int level = accumulatorSimdLevel();
+  if(level == ACC_SIMD_SSE) return false;
+
+  const float TR0[3] = {TR00, TR01, TR02};
+  const float TR1[3] = {TR10, TR11, TR12};
+
+  if(level >= ACC_SIMD_AVX512) approxTopRightAVX512(TopRight, x4, x6, y4, y6, TR0, TR1);
+  else approxTopRightAVX2(TopRight, x4, x6, y4, y6, TR0, TR1);
+  return true;
+#else
+  return false;
+#endif
+}
+
+int acc9UpdateWide(float* SSEData, const float* const* J, const float* w, int i, int n)
+{
+#if DSO_HAS_WIDE_ACC
+  int level = accumulatorSimdLevel();
+  if(level >= ACC_SIMD_AVX512 && n-i >= 16) {
+    acc9UpdateAVX512(SSEData, J, w, i);
+    return 16;
+  }
+  if(level >= ACC_SIMD_AVX2 && n-i >= 8) {
+    acc9UpdateAVX2(SSEData, J, w, i);
+    return 8;
+  }
+#endif
+  return 0;
+}
+
+}
@@ -24,10 +24,34 @@
 
 #pragma once
 #include "util/NumType.h"
+#include <string.h>
 
 
 namespace dso {
 
+/// Widest accumulator kernels the CPU supports, detected once via CPUID and capped by setting_simdLevel.
+enum AccumulatorSimdLevel {
+  ACC_SIMD_SSE=0,
+  ACC_SIMD_AVX2=1,     // AVX2 + FMA, 8 lanes.
+  ACC_SIMD_AVX512=2    // AVX-512F, 16 lanes.
+};
+int accumulatorSimdLevel();
+
+/// Wide kernels (MatrixAccumulators.cpp), compiled per function so the build stays portable.
+/// They return false / 0 if the CPU only has SSE, the caller then uses its own SSE / scalar code.
+bool accApproxUpdateWide(float* Data,
+                         const float* const x4, const float* const x6,
+                         const float* const y4, const float* const y6,
+                         const float a, const float b, const float c);
+bool accApproxTopRightWide(float* TopRight,
+                           const float* const x4, const float* const x6,
+                           const float* const y4, const float* const y6,
+                           const float TR00, const float TR10,
+                           const float TR01, const float TR11,
+                           const float TR02, const float TR12);
+/// Accumulates the points [i, i+8) or [i, i+16) into the 4-lane layout of Accumulator9, returns how many were taken.
+int acc9UpdateWide(float* SSEData, const float* const* J, const float* w, int i, int n);
+
 template<int i, int j>
 class AccumulatorXX {
  public:
@@ -719,6 +743,13 @@ class AccumulatorApprox {
                      const float b,
                      const float c)
   {
+    if(accApproxUpdateWide(Data, x4, x6, y4, y6, a, b, c)) {
+      num++;
+      numIn1++;
+      shiftUp(false);
+      return;
+    }
+
     Data[0] += a*x4[0]*x4[0] + c*y4[0]*y4[0] +  b*(x4[0]*y4[0] + y4[0]*x4[0]);
     Data[1] += a*x4[1]*x4[0] + c*y4[1]*y4[0] +  b*(x4[1]*y4[0] + y4[1]*x4[0]);
     Data[2] += a*x4[2]*x4[0] + c*y4[2]*y4[0] +  b*(x4[2]*y4[0] + y4[2]*x4[0]);
@@ -798,6 +829,9 @@ class AccumulatorApprox {
                              const float TR01, const float TR11,
                              const float TR02, const float TR12 )
   {
+    if(accApproxTopRightWide(TopRight_Data, x4, x6, y4, y6, TR00, TR10, TR01, TR11, TR02, TR12))
+      return;
+
     TopRight_Data[0] += x4[0]*TR00 + y4[0]*TR10;
     TopRight_Data[1] += x4[0]*TR01 + y4[0]*TR11;
     TopRight_Data[2] += x4[0]*TR02 + y4[0]*TR12;
@@ -1099,6 +1133,42 @@ class Accumulator9 {
     shiftUp(false);
   }
 
+  /// Adds the points [0, n), J[0..8] point to 9 arrays of n values, w to n weights (0 = unweighted).
+  /// Uses the widest kernel available, then 4 at a time, then one by one.
+  inline void updateBatch(const float* const* J, const float* w, int n)
+  {
+    int i=0;
+    while(n-i >= 8) {
+      int done = acc9UpdateWide(SSEData, J, w, i, n);
+      if(done == 0) break;
+      i+=done;
+      num+=done;
+      numIn1+=done/4;
+      shiftUp(false);
+    }
+
+    for(; i+3<n; i+=4) {
+      if(w)
+        updateSSE_eighted(_mm_loadu_ps(J[0]+i), _mm_loadu_ps(J[1]+i), _mm_loadu_ps(J[2]+i),
+                          _mm_loadu_ps(J[3]+i), _mm_loadu_ps(J[4]+i), _mm_loadu_ps(J[5]+i),
+                          _mm_loadu_ps(J[6]+i), _mm_loadu_ps(J[7]+i), _mm_loadu_ps(J[8]+i),
+                          _mm_loadu_ps(w+i));
+      else
+        updateSSE(_mm_loadu_ps(J[0]+i), _mm_loadu_ps(J[1]+i), _mm_loadu_ps(J[2]+i),
+                  _mm_loadu_ps(J[3]+i), _mm_loadu_ps(J[4]+i), _mm_loadu_ps(J[5]+i),
+                  _mm_loadu_ps(J[6]+i), _mm_loadu_ps(J[7]+i), _mm_loadu_ps(J[8]+i));
+    }
+
+    for(; i<n; i++) {
+      if(w)
+        updateSingleWeighted(J[0][i], J[1][i], J[2][i], J[3][i], J[4][i],
+                             J[5][i], J[6][i], J[7][i], J[8][i], w[i]);
+      else
+        updateSingle(J[0][i], J[1][i], J[2][i], J[3][i], J[4][i],
+                     J[5][i], J[6][i], J[7][i], J[8][i]);
+    }
+  }
+
   /// Do not use _m128 for calculation
   inline void updateSingle(
       const float J0,const float J1,
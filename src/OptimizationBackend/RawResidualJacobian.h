@@ -26,12 +26,13 @@
 
  
 #include "util/NumType.h"
+#include "util/ObjectPool.h"
 
 namespace dso
 {
 struct RawResidualJacobian
 {
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+  DSO_POOL_OPERATOR_NEW(RawResidualJacobian);
   // ================== new structure: save independently =============.
   /// 8 residuals per patch
   EIGEN_ALIGN16 VecNRf resF;
@@ -0,0 +1,258 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/// Throughput of the Hessian accumulators, run once per kernel level:
+///   accumulator_benchmark simd=0   (SSE)
+///   accumulator_benchmark simd=1   (AVX2, if the CPU has it)
+///   accumulator_benchmark simd=2   (AVX-512, if the CPU has it)
+/// The checksums must agree between levels up to float rounding.
+/// The last section stitches a window of setting_maxFrames frames (as AccumulatedTopHessianSSE::stitchDoubleInternal),
+/// once with the runtime window size and once with it as a template parameter.
+
+#include "util/settings.h"
+#include "OptimizationBackend/MatrixAccumulators.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+using namespace dso;
+
+int numUpdates = 2000000;
+int numRepeats = 5;
+
+void parseArgument(char* arg)
+{
+  int option;
+
+  if(1==sscanf(arg,"simd=%d",&option))
+  {
+    setting_simdLevel = option;
+    return;
+  }
+  if(1==sscanf(arg,"n=%d",&option))
+  {
+    numUpdates = option;
+    return;
+  }
+  if(1==sscanf(arg,"repeats=%d",&option))
+  {
+    numRepeats = option;
+    return;
+  }
+  printf("could not parse argument \"%s\"!!\n", arg);
+}
+
+/// random values in [-1, 1], the same for every run.
+static std::vector<float> randomValues(int n, unsigned int seed)
+{
+  std::vector<float> v(n);
+  srand(seed);
+  for(int i=0;i<n;i++) v[i] = 2.0f*rand()/(float)RAND_MAX - 1.0f;
+  return v;
+}
+
+/// the per-pair part of AccumulatedTopHessianSSE::stitchDoubleInternal, window size at runtime (NF=0) or fixed.
+template<int NF, typename MatH, typename VecB>
+static void stitchWindow(MatH &H, VecB &b, int nFrames, const AccumulatorApprox* acc, const Mat88* ad)
+{
+  const int nF = NF > 0 ? NF : nFrames;
+  H.setZero();
+  b.setZero();
+  for(int t=0; t<nF; t++)
+    for(int h=0; h<nF; h++) {
+      const int hIdx = CPARS + h*8, tIdx = CPARS + t*8, aidx = h + nF*t;
+      const Mat1313f &accHf = acc[aidx].H;
+      Eigen::Matrix<double,13,13> accH = accHf.cast<double>();
+      const Mat88 &adH = ad[2*aidx];
+      const Mat88 &adT = ad[2*aidx+1];
+      H.template block<8,8>(hIdx, hIdx).noalias() += adH * accH.block<8,8>(CPARS,CPARS) * adH.transpose();
+      H.template block<8,8>(tIdx, tIdx).noalias() += adT * accH.block<8,8>(CPARS,CPARS) * adT.transpose();
+      H.template block<8,8>(hIdx, tIdx).noalias() += adH * accH.block<8,8>(CPARS,CPARS) * adT.transpose();
+      H.template block<8,CPARS>(hIdx,0).noalias() += adH * accH.block<8,CPARS>(CPARS,0);
+      H.template block<8,CPARS>(tIdx,0).noalias() += adT * accH.block<8,CPARS>(CPARS,0);
+      H.template topLeftCorner<CPARS,CPARS>().noalias() += accH.block<CPARS,CPARS>(0,0);
+      b.template segment<8>(hIdx).noalias() += adH * accH.block<8,1>(CPARS,CPARS+8);
+      b.template segment<8>(tIdx).noalias() += adT * accH.block<8,1>(CPARS,CPARS+8);
+      b.template head<CPARS>().noalias() += accH.block<CPARS,1>(0,CPARS+8);
+    }
+}
+
+/// best of numRepeats runs, in ns per update.
+template<typename F>
+static double timeNs(F run, int updates)
+{
+  double best = 1e30;
+  for(int rep=0; rep<numRepeats; rep++) {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    run();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    if(ns < best) best = ns;
+  }
+  return best / updates;
+}
+
+int main(int argc, char** argv)
+{
+  for(int i=1; i<argc; i++)
+    parseArgument(argv[i]);
+
+  const char* names[3] = {"SSE", "AVX2", "AVX-512"};
+  int level = accumulatorSimdLevel();
+  printf("accumulator kernels: %s, %d updates, best of %d\n", names[level], numUpdates, numRepeats);
+
+  /// inputs are cycled through a small table, so the loop measures the accumulators, not memory.
+  const int tableSize = 1024;
+  std::vector<float> J = randomValues(tableSize*32, 1);
+
+  // ===================== AccumulatorApprox (top Hessian, DSO window backend) =====================
+  {
+    AccumulatorApprox acc;
+    double checksum = 0;
+    auto run = [&]() {
+      acc.initialize();
+      for(int k=0; k<numUpdates; k++) {
+        const float* v = J.data() + 32*(k & (tableSize-1));
+        acc.update(v, v+4, v+10, v+14, v[20], v[21], v[22]);
+        acc.updateTopRight(v, v+4, v+10, v+14, v[23], v[24], v[25], v[26], v[27], v[28]);
+        acc.updateBotRight(v[20], v[21], v[22], v[23], v[24], v[25]);
+      }
+      acc.finish();
+      checksum = acc.H.cast<double>().sum();
+    };
+    double ns = timeNs(run, numUpdates);
+    printf("AccumulatorApprox   update+TopRight+BotRight: %7.2f ns   (checksum %.6e)\n", ns, checksum);
+  }
+
+  // ===================== Accumulator9 (coarse initializer) =====================
+  {
+    Accumulator9 acc;
+    std::vector<float> Jb = randomValues(tableSize*10, 2);
+    const float* Jp[9];
+    for(int k=0;k<9;k++) Jp[k] = Jb.data() + k*tableSize;
+    const float* w = Jb.data() + 9*tableSize;
+    double checksum = 0;
+    auto run = [&]() {
+      acc.initialize();
+      for(int k=0; k<numUpdates; k+=tableSize)
+        acc.updateBatch(Jp, w, tableSize);
+      acc.finish();
+      checksum = acc.H.cast<double>().sum();
+    };
+    double ns = timeNs(run, numUpdates);
+    printf("Accumulator9        updateBatch (per point):  %7.2f ns   (checksum %.6e)\n", ns, checksum);
+  }
+
+  // ===================== AccumulatorXX (Schur complement) =====================
+  {
+    AccumulatorXX<8,8> acc;
+    double checksum = 0;
+    auto run = [&]() {
+      acc.initialize();
+      for(int k=0; k<numUpdates; k++) {
+        const float* v = J.data() + 32*(k & (tableSize-1));
+        acc.update(Eigen::Map<const Vec8f>(v), Eigen::Map<const Vec8f>(v+8), v[16]);
+      }
+      acc.finish();
+      checksum = acc.A1m.cast<double>().sum();
+    };
+    double ns = timeNs(run, numUpdates);
+    printf("AccumulatorXX<8,8>  update:                   %7.2f ns   (checksum %.6e)\n", ns, checksum);
+  }
+  {
+    AccumulatorXX<8,CPARS> acc;
+    double checksum = 0;
+    auto run = [&]() {
+      acc.initialize();
+      for(int k=0; k<numUpdates; k++) {
+        const float* v = J.data() + 32*(k & (tableSize-1));
+        acc.update(Eigen::Map<const Vec8f>(v), Eigen::Map<const VecCf>(v+8), v[16]);
+      }
+      acc.finish();
+      checksum = acc.A1m.cast<double>().sum();
+    };
+    double ns = timeNs(run, numUpdates);
+    printf("AccumulatorXX<8,%d>  update:                   %7.2f ns   (checksum %.6e)\n", CPARS, ns, checksum);
+  }
+  {
+    AccumulatorXX<CPARS,CPARS> acc;
+    double checksum = 0;
+    auto run = [&]() {
+      acc.initialize();
+      for(int k=0; k<numUpdates; k++) {
+        const float* v = J.data() + 32*(k & (tableSize-1));
+        acc.update(Eigen::Map<const VecCf>(v), Eigen::Map<const VecCf>(v+8), v[16]);
+      }
+      acc.finish();
+      checksum = acc.A1m.cast<double>().sum();
+    };
+    double ns = timeNs(run, numUpdates);
+    printf("AccumulatorXX<%d,%d>  update:                   %7.2f ns   (checksum %.6e)\n", CPARS, CPARS, ns, checksum);
+  }
+
+  // ===================== window stitch: runtime vs. compile-time window size =====================
+  if(setting_maxFrames == 7) {
+    const int nF = 7;
+    std::vector<AccumulatorApprox> acc(nF*nF);
+    std::vector<Mat88, Eigen::aligned_allocator<Mat88>> ad(2*nF*nF);
+    std::vector<float> A = randomValues(2*nF*nF*64, 3);
+    for(int k=0; k<nF*nF; k++) {
+      acc[k].initialize();
+      for(int i=0; i<64; i++) {
+        const float* v = J.data() + 32*((k*64+i) & (tableSize-1));
+        acc[k].update(v, v+4, v+10, v+14, v[20], v[21], v[22]);
+        acc[k].updateTopRight(v, v+4, v+10, v+14, v[23], v[24], v[25], v[26], v[27], v[28]);
+        acc[k].updateBotRight(v[20], v[21], v[22], v[23], v[24], v[25]);
+      }
+      acc[k].finish();
+    }
+    for(int k=0; k<2*nF*nF; k++)
+      ad[k] = Eigen::Map<const Mat88f>(A.data() + 64*k).cast<double>();
+
+    const int stitches = std::max(1, numUpdates / 1000);
+    double checksum[2] = {0, 0};
+    MatXX Hd(CPARS+8*nF, CPARS+8*nF);
+    VecX bd(CPARS+8*nF);
+    auto runDynamic = [&]() {
+      for(int k=0; k<stitches; k++) stitchWindow<0>(Hd, bd, nF, acc.data(), ad.data());
+      checksum[0] = Hd.sum() + bd.sum();
+    };
+    typedef Eigen::Matrix<double,CPARS+8*7,CPARS+8*7> MatW;
+    typedef Eigen::Matrix<double,CPARS+8*7,1> VecW;
+    MatW* Hs = new MatW();
+    VecW bs;
+    auto runStatic = [&]() {
+      for(int k=0; k<stitches; k++) stitchWindow<7>(*Hs, bs, nF, acc.data(), ad.data());
+      checksum[1] = Hs->sum() + bs.sum();
+    };
+    double nsDynamic = timeNs(runDynamic, stitches);
+    double nsStatic = timeNs(runStatic, stitches);
+    printf("window stitch, %d frames, runtime size:   %9.1f ns   (checksum %.6e)\n", nF, nsDynamic, checksum[0]);
+    printf("window stitch, %d frames, template size:  %9.1f ns   (checksum %.6e)\n", nF, nsStatic, checksum[1]);
+    delete Hs;
+  }
+
+  return 0;
+}
@@ -55,6 +55,8 @@ std::string vignette = "";
 std::string gammaCalib = "";
 std::string source = "";
 std::string calib = "";
+std::string trajectoryFile = "";
+int trajectoryFormat = 0;
 double rescale = 1;
 bool reverse = false;
 bool disableROS = false;
@@ -234,6 +236,62 @@ void parseArgument(char* arg) {
     }
     return;
   }
+  if(1==sscanf(arg,"simd=%d",&option))
+  {
+    setting_simdLevel = option;
+    printf("SIMD LEVEL capped at %d!\n", option);
+    return;
+  }
+  if(1==sscanf(arg,"backend=%d",&option))
+  {
+    setting_windowBackend = option;
+    printf("WINDOW BACKEND: %s!\n", option==1 ? "DSO" : "G2O");
+    return;
+  }
+  if(1==sscanf(arg,"budget=%f",&foption))
+  {
+    setting_mappingBudgetMs = foption;
+    printf("MAPPING BUDGET %.1fms per keyframe!\n", foption);
+    return;
+  }
+  if(1==sscanf(arg,"maximmature=%d",&option))
+  {
+    setting_maxImmaturePoints = option;
+    printf("IMMATURE POINT BUDGET %d in the window!\n", option);
+    return;
+  }
+  if(1==sscanf(arg,"trackdeadline=%f",&foption))
+  {
+    setting_trackingDeadlineMs = foption;
+    printf("TRACKING DEADLINE %.1fms per frame!\n", foption);
+    return;
+  }
+  if(1==sscanf(arg,"precision=%d",&option))
+  {
+    setting_precisionMode = option;
+    printf("SOLVER PRECISION: %s stitching, %s solve!\n",
+           (option & PRECISION_FLOAT_STITCH) ? "float" : "double",
+           (option & PRECISION_FLOAT_SOLVE) ? "float (refined)" : "double");
+    return;
+  }
+  if(1==sscanf(arg,"precisionAB=%d",&option))
+  {
+    if(option==1)
+    {
+      setting_precisionAB = true;
+      printf("SOLVER PRECISION A/B COMPARISON!\n");
+    }
+    return;
+  }
+  if(1==sscanf(arg,"backendAB=%d",&option))
+  {
+    if(option==1)
+    {
+      setting_windowBackendAB = true;
+      printf("WINDOW BACKEND A/B COMPARISON!\n");
+    }
+    return;
+  }
   if(1==sscanf(arg,"prefetch=%d",&option))
   {
     if(option==1)
@@ -284,6 +342,20 @@ void parseArgument(char* arg) {
     return;
   }
 
+  if(1==sscanf(arg,"traj=%s",buf))
+  {
+    trajectoryFile = buf;
+    printf("streaming trajectory to %s!\n", trajectoryFile.c_str());
+    return;
+  }
+
+  if(1==sscanf(arg,"trajformat=%d",&option))
+  {
+    trajectoryFormat = option;
+    printf("TRAJECTORY FORMAT %s!\n", option==1 ? "TUM" : "KITTI");
+    return;
+  }
+
   if(1==sscanf(arg,"rescale=%f",&foption))
   {
     rescale = foption;
@@ -366,6 +438,8 @@ int main( int argc, char** argv ) {
   FullSystem* fullSystem = new FullSystem();
   fullSystem->setGammaFunction(reader->getPhotometricGamma());
   fullSystem->linearizeOperation = (playbackSpeed==0);
+  if(trajectoryFile != "")
+    fullSystem->streamTrajectory(trajectoryFile, trajectoryFormat);
 
 
   IOWrap::PangolinDSOViewer* viewer = 0;
@@ -506,6 +580,8 @@ int main( int argc, char** argv ) {
                                 fullSystem = new FullSystem();
                                 fullSystem->setGammaFunction(reader->getPhotometricGamma());
                                 fullSystem->linearizeOperation = (playbackSpeed==0);
+                                if(trajectoryFile != "")
+                                  fullSystem->streamTrajectory(trajectoryFile, trajectoryFormat);
 
                                 fullSystem->outputWrapper = wraps;
 
@@ -524,7 +600,8 @@ int main( int argc, char** argv ) {
                           struct timeval tv_end;
                           gettimeofday(&tv_end, NULL);
 
-                          fullSystem->printResult("/home/jiatianwu/project/sdso/result.txt");
+                          if(trajectoryFile == "")
+                            fullSystem->printResult("/home/jiatianwu/project/sdso/result.txt");
 
                           int numFramesProcessed = abs(idsToPlay[0]-idsToPlay.back());
                           double numSecondsProcessed = fabs(reader->getTimestamp(idsToPlay[0])-reader->getTimestamp(idsToPlay.back()));
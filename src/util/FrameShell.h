@@ -47,6 +47,8 @@ class FrameShell {
   SE3 camToWorld;		// Write: TRACKING, while frame is still fresh; MAPPING: only when locked [shellPoseMutex].
   AffLight aff_g2l;
   bool poseValid;
+  bool poseFinal;               // camToWorld will not change anymore (non-KF: mapped, KF: marginalized) [shellPoseMutex].
+  int trackingQuality;          // CoarseTrackingQuality of the tracking result.
 
   // statisitcs
   int statistics_outlierResOnThis;
@@ -59,6 +61,8 @@ class FrameShell {
   {
     id=0;
     poseValid=true;
+    poseFinal=false;
+    trackingQuality=0;
     camToWorld = SE3();
     timestamp=0;
     marginalizedAt=-1;
@@ -34,7 +34,11 @@ namespace dso {
 
 #define SSEE(val,idx) (*(((float*)&val)+idx))
 
-#define MAX_RES_PER_POINT 8
+/// residual pattern size, fixed at compile time so the per-residual kernels are unrolled (8 or 12, see settings.h).
+#ifndef DSO_PATTERN_SIZE
+#define DSO_PATTERN_SIZE 8
+#endif
+#define MAX_RES_PER_POINT DSO_PATTERN_SIZE
 #define NUM_THREADS 6
 
 #define todouble(x) (x).cast<double>()
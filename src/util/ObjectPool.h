@@ -0,0 +1,197 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <new>
+#include "boost/thread.hpp"
+#include <Eigen/Core>
+
+namespace dso {
+
+/// Fixed size slab pool for one object type.
+/// Points and residuals are created and deleted in the ten thousands per keyframe,
+/// and individually (outlier removal, marginalization), so they are kept on a free list
+/// of cache line aligned slots instead of going through malloc every time.
+/// Every thread allocates from and releases to its own cache (no lock); only when that runs empty
+/// or holds 2*BatchSlots slots, BatchSlots slots are moved from / to the shared list under the mutex.
+/// Slots freed by another thread simply join that thread's cache.
+/// Slabs are never returned to the system while objects are alive, the pool only grows to its peak.
+/// Build with DSO_POOL_POISON to fill freed slots with 0xDB, so a use-after-free shows up as garbage.
+template<typename T>
+class ObjectPool {
+ public:
+  static ObjectPool& instance() {
+    static ObjectPool pool;
+    return pool;
+  }
+
+  inline void* allocate(size_t size) {
+    // derived or otherwise larger types do not fit into a slot.
+    if(size > SlotSize)
+      return Eigen::internal::aligned_malloc(size);
+
+    ThreadCache& tc = threadCache();
+    if(tc.head == 0) refill(tc);
+
+    FreeSlot* s = tc.head;
+    tc.head = s->next;
+    tc.count--;
+    return s;
+  }
+
+  inline void release(void* p, size_t size) {
+    if(p == 0) return;
+    if(size > SlotSize)
+    {
+      Eigen::internal::aligned_free(p);
+      return;
+    }
+
+#ifdef DSO_POOL_POISON
+    memset(p, 0xDB, SlotSize);
+#endif
+
+    ThreadCache& tc = threadCache();
+    FreeSlot* s = (FreeSlot*)p;
+    s->next = tc.head;
+    tc.head = s;
+    tc.count++;
+    if(tc.count >= 2*BatchSlots) flush(tc, BatchSlots);
+  }
+
+  /// slots handed out to threads: live objects plus the thread caches.
+  size_t held() { boost::unique_lock<boost::mutex> lock(mtx); return nHeld; }
+  size_t peak() { boost::unique_lock<boost::mutex> lock(mtx); return nPeak; }
+  size_t capacity() { boost::unique_lock<boost::mutex> lock(mtx); return chunks.size()*SlotsPerChunk; }
+
+  void printStats(const char* name) {
+    boost::unique_lock<boost::mutex> lock(mtx);
+    printf("POOL %s: %d held (live + thread caches), %d peak, %d slots of %d bytes (%.1f MB)\n",
+           name, (int)nHeld, (int)nPeak, (int)(chunks.size()*SlotsPerChunk), (int)SlotSize,
+           chunks.size()*SlotsPerChunk*SlotSize / (1024.0*1024.0));
+  }
+
+ private:
+  struct FreeSlot { FreeSlot* next; };
+
+  /// free slots owned by one thread, given back to the shared list when the thread exits.
+  struct ThreadCache {
+    FreeSlot* head;
+    int count;
+    ThreadCache() : head(0), count(0) {}
+    ~ThreadCache() { if(count > 0) ObjectPool::instance().flush(*this, count); }
+  };
+
+  static const size_t SlotAlign = 64;
+  static const size_t SlotSize = ((sizeof(T) + SlotAlign - 1) / SlotAlign) * SlotAlign;
+  static const size_t SlotsPerChunk = 256;
+  static const int BatchSlots = 64;
+
+  ObjectPool() : freeList(0), nHeld(0), nPeak(0) {}
+
+  ~ObjectPool() {
+    // objects still alive at exit (e.g. points of a lost system) keep their memory.
+    if(nHeld != 0) return;
+    for(char* c : chunks)
+      free(c);
+  }
+
+  static inline ThreadCache& threadCache() {
+    static thread_local ThreadCache tc;
+    return tc;
+  }
+
+  /// moves BatchSlots slots from the shared list into the (empty) cache.
+  void refill(ThreadCache &tc) {
+    boost::unique_lock<boost::mutex> lock(mtx);
+    for(int i=0; i<BatchSlots; i++)
+    {
+      if(freeList == 0) grow();
+      FreeSlot* s = freeList;
+      freeList = s->next;
+      s->next = tc.head;
+      tc.head = s;
+    }
+    tc.count += BatchSlots;
+    nHeld += BatchSlots;
+    if(nHeld > nPeak) nPeak = nHeld;
+  }
+
+  /// moves n slots from the cache back to the shared list.
+  void flush(ThreadCache &tc, int n) {
+    FreeSlot* first = tc.head;
+    FreeSlot* last = first;
+    for(int i=1; i<n; i++)
+      last = last->next;
+    tc.head = last->next;
+    tc.count -= n;
+
+    boost::unique_lock<boost::mutex> lock(mtx);
+    last->next = freeList;
+    freeList = first;
+    nHeld -= n;
+  }
+
+  void grow() {
+    void* mem = 0;
+    if(posix_memalign(&mem, SlotAlign, SlotSize*SlotsPerChunk) != 0 || mem == 0)
+      throw std::bad_alloc();
+
+    char* c = (char*)mem;
+#ifdef DSO_POOL_POISON
+    memset(c, 0xDB, SlotSize*SlotsPerChunk);
+#endif
+    chunks.push_back(c);
+
+    // thread the new slots into the free list, lowest address first.
+    for(int i=SlotsPerChunk-1; i>=0; i--)
+    {
+      FreeSlot* s = (FreeSlot*)(c + i*SlotSize);
+      s->next = freeList;
+      freeList = s;
+    }
+  }
+
+  boost::mutex mtx;
+  FreeSlot* freeList;
+  std::vector<char*> chunks;
+  size_t nHeld;
+  size_t nPeak;
+};
+
+}
+
+/// Replaces EIGEN_MAKE_ALIGNED_OPERATOR_NEW for types that are allocated through ObjectPool<T>.
+/// Slots are 64 byte aligned, which covers every Eigen alignment requirement.
+#define DSO_POOL_OPERATOR_NEW(T) \
+  static void* operator new(size_t size) { return ::dso::ObjectPool<T>::instance().allocate(size); } \
+  static void operator delete(void* p, size_t size) { ::dso::ObjectPool<T>::instance().release(p, size); } \
+  static void* operator new(size_t, void* ptr) { return ptr; } \
+  static void operator delete(void*, void*) {} \
+  static void* operator new[](size_t size) { return Eigen::internal::aligned_malloc(size); } \
+  static void operator delete[](void* p) { Eigen::internal::aligned_free(p); }
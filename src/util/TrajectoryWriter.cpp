@@ -0,0 +1,117 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "util/TrajectoryWriter.h"
+#include <iomanip>
+#include <stdio.h>
+
+namespace dso
+{
+
+TrajectoryWriter::TrajectoryWriter(const std::string &file, int format)
+  : format(format), running(true)
+{
+  out.open(file.c_str(), std::ios::trunc | std::ios::out);
+  out << std::setprecision(15);
+  if(!out.is_open())
+    printf("TRAJECTORY: could not open %s, poses are not written!\n", file.c_str());
+
+  lastCamToWorld = SE3();
+  writerThread = boost::thread(&TrajectoryWriter::writerLoop, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    running = false;
+    queueSignal.notify_all();
+  }
+  writerThread.join();
+  out.close();
+}
+
+void TrajectoryWriter::push(double timestamp, const SE3 &camToWorld, bool valid)
+{
+  Pose p;
+  p.timestamp = timestamp;
+  p.camToWorld = camToWorld;
+  p.valid = valid;
+
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  queue.push_back(p);
+  queueSignal.notify_all();
+}
+
+void TrajectoryWriter::writerLoop()
+{
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  while(true)
+  {
+    while(queue.size() == 0 && running)
+      queueSignal.wait(lock);
+
+    if(queue.size() == 0 && !running)
+      return;
+
+    // take everything queued, write it without holding the lock.
+    std::deque<Pose, Eigen::aligned_allocator<Pose>> batch;
+    batch.swap(queue);
+    lock.unlock();
+
+    for(const Pose &p : batch)
+      write(p);
+    out.flush();
+
+    lock.lock();
+  }
+}
+
+void TrajectoryWriter::write(const Pose &p)
+{
+  if(!out.is_open()) return;
+
+  if(p.valid) lastCamToWorld = p.camToWorld;
+  const SE3 &c2w = lastCamToWorld;
+
+  if(format == TRAJECTORY_TUM)
+  {
+    out << p.timestamp <<
+        " " << c2w.translation().transpose() <<
+        " " << c2w.so3().unit_quaternion().x() <<
+        " " << c2w.so3().unit_quaternion().y() <<
+        " " << c2w.so3().unit_quaternion().z() <<
+        " " << c2w.so3().unit_quaternion().w() << "\n";
+  }
+  else
+  {
+    const Eigen::Matrix<double,3,3> R = c2w.so3().matrix();
+    const Eigen::Matrix<double,3,1> T = c2w.translation();
+    out << R(0,0) <<" "<<R(0,1)<<" "<<R(0,2)<<" "<<T(0,0)<<" "<<
+        R(1,0) <<" "<<R(1,1)<<" "<<R(1,2)<<" "<<T(1,0)<<" "<<
+        R(2,0) <<" "<<R(2,1)<<" "<<R(2,2)<<" "<<T(2,0)<<"\n";
+  }
+}
+
+}
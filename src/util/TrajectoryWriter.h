@@ -0,0 +1,75 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include "util/NumType.h"
+#include "boost/thread.hpp"
+#include <fstream>
+#include <deque>
+#include <string>
+
+namespace dso
+{
+
+enum TrajectoryFormat {TRAJECTORY_KITTI=0, TRAJECTORY_TUM};
+
+/// Append-only pose log, written on its own thread.
+/// One line per pushed pose, in push order: KITTI (row-major 3x4 camToWorld)
+/// or TUM (timestamp tx ty tz qx qy qz qw). An invalid pose repeats the last valid one, like printResult.
+class TrajectoryWriter
+{
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+  TrajectoryWriter(const std::string &file, int format);
+  /// writes everything still queued, then closes the file.
+  ~TrajectoryWriter();
+
+  void push(double timestamp, const SE3 &camToWorld, bool valid);
+
+  inline bool isOpen() const { return out.is_open(); }
+
+ private:
+  struct Pose {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    double timestamp;
+    SE3 camToWorld;
+    bool valid;
+  };
+
+  void writerLoop();
+  void write(const Pose &p);
+
+  std::ofstream out;
+  int format;
+  SE3 lastCamToWorld;
+
+  boost::mutex queueMutex;
+  boost::condition_variable queueSignal;
+  std::deque<Pose, Eigen::aligned_allocator<Pose>> queue;
+  bool running;
+  boost::thread writerThread;
+};
+
+}
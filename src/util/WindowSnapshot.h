@@ -0,0 +1,79 @@
+/**
+ * This file is part of DSO.
+ *
+ * Copyright 2016 Technical University of Munich and Intel.
+ * Developed by Jakob Engel <engelj at in dot tum dot de>,
+ * for more information see <http://vision.in.tum.de/dso>.
+ * If you use this code, please cite the respective publications as
+ * listed on the above website.
+ *
+ * DSO is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DSO is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DSO. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include "util/NumType.h"
+#include "boost/shared_ptr.hpp"
+#include <vector>
+
+namespace dso
+{
+
+/// Immutable copy of the active window, published by the mapper after each optimization.
+/// The mapper never changes a published snapshot, it builds a new one and swaps the pointer
+/// (boost::atomic_store); readers take the pointer (boost::atomic_load) and keep it as long as they like,
+/// without any of the mapping locks.
+struct WindowSnapshot
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+  struct Frame
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    int shellId;            // FrameShell::id
+    int incomingId;         // FrameShell::incoming_id
+    int frameID;            // keyframe id, FrameHessian::frameID
+    double timestamp;
+    SE3 camToWorld;
+    AffLight aff_g2l;
+    int pointBegin;         // active points of this frame are points[pointBegin, pointEnd).
+    int pointEnd;
+  };
+
+  struct Point
+  {
+    float u, v;
+    float idepth;           // idepth_scaled.
+    float idepthHessian;
+    int numGoodResiduals;
+  };
+
+  long version;             // increases with every published snapshot.
+  float fx, fy, cx, cy;     // calibration used for this optimization.
+
+  std::vector<Frame, Eigen::aligned_allocator<Frame>> frames;
+  std::vector<Point> points;
+
+  /// the window is small (setting_maxFrames), a linear search is fine.
+  inline const Frame* find(int shellId) const
+  {
+    for(const Frame &f : frames)
+      if(f.shellId == shellId) return &f;
+    return 0;
+  }
+};
+
+typedef boost::shared_ptr<const WindowSnapshot> WindowSnapshotPtr;
+
+}
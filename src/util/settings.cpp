@@ -30,6 +30,7 @@ int pyrLevelsUsed = PYR_LEVELS;
 
 /* Parameters controlling when KF's are taken */
 float setting_keyframesPerSecond = 0;   // if !=0, takes a fixed number of KF per second.
+bool setting_pipelineKeyFrames = true;  // finish a keyframe (point & frame marginalization, new traces) while the next frames are tracked.
 bool setting_realTimeMaxKF = false;   // if true, takes as many KF's as possible (will break the system if the camera stays stationary)
 float setting_maxShiftWeightT= 0.04f * (640 + 480);   // original is 0.04f * (640+480);
 float setting_maxShiftWeightR= 0.0f * (640 + 480);    // original is 0.0f * (640+480);
@@ -50,6 +51,18 @@ float setting_initialCalibHessian = 5e9;
 /* some modes for solving the resulting linear system (e.g. orthogonalize wrt. unobservable dimensions) */
 int setting_solverMode = SOLVER_FIX_LAMBDA | SOLVER_ORTHOGONALIZE_X_LATER;  /// lambda
 double setting_solverModeDelta = 0.00001;
+int setting_precisionMode = 0;            // PRECISION_* flags: stitch the active part / solve the system in float.
+int setting_precisionRefineIts = 4;       // float solve: max. refinement steps with double residuals,
+double setting_precisionRefineTH = 1e-10; // until |b-Hx| < TH*|b|, otherwise the system is solved in double.
+bool setting_precisionAB = false;         // solve every window step also in double and print the difference to the float step (debug, slow).
+double setting_precisionABTH = 1e-3;      // use the double step if the float one differs by more than this (relative, step or model energy).
+int setting_g2oLinearSolver = 0;   // linear solver of the g2o problems: 0 = auto (by size), 1 = dense, 2 = eigen, 3 = csparse, 4 = cholmod.
+int setting_g2oDenseMaxDim = 200;  // auto: use the dense solver up to this (schur reduced) dimension, cholmod above.
+int setting_windowBackend = 0;      // window optimization: 0 = g2o, 1 = DSO Gauss-Newton on the EnergyFunctional.
+bool setting_windowBackendAB = false; // run every window through both backends and print the comparison (debug, slow).
+float setting_lazyRelinTH = 1e-6f;  // reuse residuals / jacobians if no input moved more than this since (scaled state units). < 0 = always relinearize.
+int setting_simdLevel = -1;          // cap for the accumulator kernels: 0 = SSE, 1 = AVX2, 2 = AVX-512, -1 = widest the CPU has.
+bool setting_g2oMargPrior = true;     // add the marginalization prior (HM, bM) to the g2o window as a dense prior edge.
 bool setting_forceAceptStep = true;
 
 /* some thresholds on when to activate / marginalize points */
@@ -58,6 +71,13 @@ float setting_minIdepthH_marg = 50;
 
 float setting_desiredImmatureDensity = 3000; // original is 1500 immature points per frame
 float setting_desiredPointDensity = 4000; // original is 2000 aimed total points in the active window.
+float setting_mappingBudgetMs = 0;           // mapping time per keyframe to stay within by scaling both densities (0 = off).
+float setting_mappingBudgetHysteresis = 0.15; // densities are not changed while within +-15% of the budget.
+float setting_mappingBudgetMinScale = 0.25;  // bounds of that scale.
+float setting_mappingBudgetMaxScale = 1.5;
+int setting_maxImmaturePoints = 0;     // budget of immature points in the whole window, lowest priority ones are evicted before tracing. 0 = no limit (off).
+float setting_immatureAgeWeight = 0.1; // priority of an immature point is divided by (1 + weight*#traces).
+float setting_immatureMaxShrinkScore = 4; // cap on the idepth-interval shrink factor used in the priority.
 float setting_minPointsRemaining = 0.05;  // marg a frame if less than X% points remain.
 float setting_maxLogAffFacInWindow = 0.7; // marg a frame if factor between intensities to current frame is larger than 1/X or X.
 
@@ -78,6 +98,12 @@ float setting_margWeightFac = 0.5*0.5;          // factor on hessian when margin
 /* when to re-track a frame */
 float setting_reTrackThreshold = 1.5;   // original is 1.5 (larger = re-track more often)
 
+/* adaptive coarse-to-fine tracking schedule */
+float setting_trackingDeadlineMs = 0;      // coarse tracking time per frame; level 0 is skipped when it would not finish in time (0 = off).
+float setting_trackingMinUpdate = 0;       // stop iterating a level once the pose update |log(T_new*T_old^-1)| is below this (0 = fixed iterations).
+float setting_trackingConfidentFlow = 0;   // last frame moved less than this (px) and tracked well: start at setting_trackingConfidentLvl (0 = off).
+int setting_trackingConfidentLvl = 2;
+
 /* require some minimum number of residuals for a point to become valid */
 int   setting_minGoodActiveResForMarg=3;
 int   setting_minGoodResForMarg=4;
@@ -118,6 +144,10 @@ float setting_trace_GNThreshold = 0.1;				// GN stop after this stepsize.
 float setting_trace_extraSlackOnTH = 1.2;			// for energy-based outlier check, be slightly more relaxed by this factor.
 float setting_trace_slackInterval = 1.5;			// if pixel-interval is smaller than this, leave it be.
 float setting_trace_minImprovementFactor = 2;		// if pixel-interval is smaller than this, leave it be.
+bool setting_trace_coarseToFine = true;			// search long ep. segments on a coarse pyramid level first, then refine on level 0.
+int setting_trace_coarseToFineLevel = 1;			// pyramid level used for the coarse search.
+int setting_trace_coarseToFineMinSteps = 12;		// only search coarse-to-fine if the segment has more level-0 steps than this.
+float setting_trace_coarseToFineWindow = 2;		// half-width (level-0 pixel) of the refinement window around the coarse minimum.
 
 // for benchmarking different undistortion settings
 float benchmarkSetting_fxfyfac = 0;
@@ -139,6 +169,7 @@ bool debugSaveImages = false;
 bool multiThreading = true;
 bool disableAllDisplay = false;
 bool setting_onlyLogKFPoses = false;
+int setting_shellHistory = 16;          // frame shells kept after their pose was streamed out (min. 3, motion model).
 bool setting_logStuff = true;
 
 bool goStepByStep = false;
@@ -224,6 +255,14 @@ int staticPattern[10][40][2] = {
    {-200,-200}, {-200,-200}, {-200,-200}, {-200,-200}, {-200,-200}, {-200,-200}, {-200,-200}, {-200,-200}, {-200,-200}, {-200,-200}},
 };
 
+/// the SSE pattern (staticPattern[8]) plus its four diagonal corners, same padding.
+int staticPattern12[40][2] = {
+  {0,-2},	  {-1,-1},	   {1,-1},		{-2,0},		 {0,0},		  {2,0},	   {-1,1},		{0,2},		 {-2,-2},     {2,-2},
+  {-2,2},     {2,2},       {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100},
+  {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100},
+  {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}, {-100,-100}
+};
+
 int staticPatternNum[10] = {
   1,
   5,
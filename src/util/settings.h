@@ -42,12 +42,17 @@ namespace dso {
 #define SOLVER_STEPMOMENTUM (int)1024
 #define SOLVER_ORTHOGONALIZE_X_LATER (int)2048
 
+/* precision of the DSO window solve; the marginalization prior (HM, bM) is always kept in double */
+#define PRECISION_FLOAT_STITCH (int)1
+#define PRECISION_FLOAT_SOLVE (int)2
+
 // ============== PARAMETERS TO BE DECIDED ON COMPILE TIME =================
 #define PYR_LEVELS 6
 extern int pyrLevelsUsed;
 
 extern float setting_keyframesPerSecond;
 extern bool setting_realTimeMaxKF;
+extern bool setting_pipelineKeyFrames;
 extern float setting_maxShiftWeightT;
 extern float setting_maxShiftWeightR;
 extern float setting_maxShiftWeightRT;
@@ -64,6 +69,18 @@ extern float setting_initialCalibHessian;
 
 extern int setting_solverMode;
 extern double setting_solverModeDelta;
+extern int setting_precisionMode;
+extern int setting_precisionRefineIts;
+extern double setting_precisionRefineTH;
+extern bool setting_precisionAB;
+extern double setting_precisionABTH;
+extern int setting_g2oLinearSolver;
+extern int setting_g2oDenseMaxDim;
+extern int setting_windowBackend;
+extern bool setting_windowBackendAB;
+extern bool setting_g2oMargPrior;
+extern float setting_lazyRelinTH;
+extern int setting_simdLevel;
 
 extern float setting_minIdepthH_act;
 extern float setting_minIdepthH_marg;
@@ -72,6 +89,13 @@ extern float setting_maxIdepth;
 extern float setting_maxPixSearch;
 extern float setting_desiredImmatureDensity;			// done
 extern float setting_desiredPointDensity;			// done
+extern float setting_mappingBudgetMs;
+extern float setting_mappingBudgetHysteresis;
+extern float setting_mappingBudgetMinScale;
+extern float setting_mappingBudgetMaxScale;
+extern int setting_maxImmaturePoints;
+extern float setting_immatureAgeWeight;
+extern float setting_immatureMaxShrinkScore;
 extern float setting_minPointsRemaining;
 extern float setting_maxLogAffFacInWindow;
 extern int setting_minFrames;
@@ -91,6 +115,11 @@ extern float setting_minTraceQuality;
 extern int setting_minTraceTestRadius;
 extern float setting_reTrackThreshold;
 
+extern float setting_trackingDeadlineMs;
+extern float setting_trackingMinUpdate;
+extern float setting_trackingConfidentFlow;
+extern int setting_trackingConfidentLvl;
+
 extern int   setting_minGoodActiveResForMarg;
 extern int   setting_minGoodResForMarg;
 extern int   setting_minInlierVotesForMarg;
@@ -132,6 +161,10 @@ extern float setting_trace_GNThreshold;
 extern float setting_trace_extraSlackOnTH;
 extern float setting_trace_slackInterval;
 extern float setting_trace_minImprovementFactor;
+extern bool setting_trace_coarseToFine;
+extern int setting_trace_coarseToFineLevel;
+extern int setting_trace_coarseToFineMinSteps;
+extern float setting_trace_coarseToFineWindow;
 
 extern bool setting_render_displayCoarseTrackingFull;
 extern bool setting_render_renderWindowFrames;
@@ -149,6 +182,7 @@ extern bool disableAllDisplay;
 extern bool disableReconfigure;
 
 extern bool setting_onlyLogKFPoses;
+extern int setting_shellHistory;
 
 extern bool debugSaveImages;
 
@@ -168,14 +202,28 @@ void handleKey(char k);
 extern int staticPattern[10][40][2];
 extern int staticPatternNum[10];
 extern int staticPatternPadding[10];
+extern int staticPattern12[40][2];
 
 //#define patternNum staticPatternNum[setting_pattern]
 //#define patternP staticPattern[setting_pattern]
 //#define patternPadding staticPatternPadding[setting_pattern]
 
-//
+// compile-time pattern, chosen with DSO_PATTERN_SIZE (also sizes MAX_RES_PER_POINT in NumType.h).
+#ifndef DSO_PATTERN_SIZE
+#define DSO_PATTERN_SIZE 8
+#endif
+#if DSO_PATTERN_SIZE == 8
 #define patternNum 8
 #define patternP staticPattern[8]
 #define patternPadding 2
+#elif DSO_PATTERN_SIZE == 12
+#define patternNum 12
+#define patternP staticPattern12
+#define patternPadding 2
+#else
+#error "DSO_PATTERN_SIZE must be 8 or 12"
+#endif
+
+static_assert(patternNum % 4 == 0, "the SSE loops process the pattern 4 residuals at a time");
 
 } // namespace dso